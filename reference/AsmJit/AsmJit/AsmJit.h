@@ -236,7 +236,9 @@
 //! Contains classes related to loging assembler output. Currently logging
 //! is implemented in @c AsmJit::Logger class.You can override
 //! @c AsmJit::Logger::log() to log messages into your stream. There is also
-//! @c FILE based logger implemented in @c AsmJit::FileLogger class.
+//! @c FILE based logger implemented in @c AsmJit::FileLogger class and
+//! @c AsmJit::AsyncLogger, which writes to @c FILE in a background thread
+//! (the compiling thread only copies messages to its buffer).
 //!
 //! To log your assembler output to FILE stream use this code:
 //!
@@ -255,7 +257,7 @@
 //! insert text message into items stream so the @c Compiler is able to
 //! send messages to @ref Assembler in correct order.
 //!
-//! @sa @c AsmJit::Logger, @c AsmJit::FileLogger.
+//! @sa @c AsmJit::Logger, @c AsmJit::FileLogger, @c AsmJit::AsyncLogger.
 
 
 //! @defgroup AsmJit_MemoryManagement Virtual memory management.
@@ -14,6 +14,8 @@
 #include "Core/Assembler.h"
 #include "Core/Assert.h"
 #include "Core/Buffer.h"
+#include "Core/CodeCache.h"
+#include "Core/CodeCompactor.h"
 #include "Core/Compiler.h"
 #include "Core/CompilerContext.h"
 #include "Core/CompilerFunc.h"
@@ -32,6 +34,7 @@
 #include "Core/StringUtil.h"
 #include "Core/VirtualMemory.h"
 #include "Core/ZoneMemory.h"
+#include "Core/ZoneVector.h"
 
 // [Guard]
 #endif // _ASMJIT_CORE_H
@@ -32,10 +32,16 @@ Assembler::Assembler(Context* context) ASMJIT_NOTHROW :
   _logger(NULL),
   _error(kErrorOk),
   _properties(0),
+  _codeAlignment(0),
   _emitOptions(0),
   _trampolineSize(0),
   _inlineComment(NULL),
-  _unusedLinks(NULL)
+  _unusedLinks(NULL),
+  _labels(&_zoneMemory),
+  _relocData(&_zoneMemory),
+  _trampolineTable(NULL),
+  _trampolineTableCapacity(0),
+  _trampolineTableCount(0)
 {
 }
 
@@ -89,6 +95,16 @@ void Assembler::setProperty(uint32_t propertyId, uint32_t value) ASMJIT_NOTHROW
     _properties &= ~IntUtil::maskFromIndex(propertyId);
 }
 
+// ============================================================================
+// [AsmJit::Assembler - Direct Memory]
+// ============================================================================
+
+void Assembler::setDirectMemoryManager(MemoryManager* memmgr) ASMJIT_NOTHROW
+{
+  clear();
+  _buffer.setMemoryManager(memmgr);
+}
+
 // ============================================================================
 // [AsmJit::Assembler - TakeCode]
 // ============================================================================
@@ -96,9 +112,16 @@ void Assembler::setProperty(uint32_t propertyId, uint32_t value) ASMJIT_NOTHROW
 uint8_t* Assembler::takeCode() ASMJIT_NOTHROW
 {
   uint8_t* code = _buffer.take();
-  _relocData.clear();
   _zoneMemory.clear();
 
+  _unusedLinks = NULL;
+  _labels.reset();
+  _relocData.reset();
+
+  _trampolineTable = NULL;
+  _trampolineTableCapacity = 0;
+  _trampolineTableCount = 0;
+
   if (_error != kErrorOk)
     setError(kErrorOk);
 
@@ -124,9 +147,6 @@ void Assembler::reset() ASMJIT_NOTHROW
   _zoneMemory.reset();
   _buffer.reset();
 
-  _labels.reset();
-  _relocData.reset();
-
   if (_error != kErrorOk)
     setError(kErrorOk);
 }
@@ -142,8 +162,12 @@ void Assembler::_purge() ASMJIT_NOTHROW
   _inlineComment = NULL;
   _unusedLinks = NULL;
   
-  _labels.clear();
-  _relocData.clear();
+  _labels.reset();
+  _relocData.reset();
+
+  _trampolineTable = NULL;
+  _trampolineTableCapacity = 0;
+  _trampolineTableCount = 0;
 }
 
 // ============================================================================
@@ -184,10 +208,69 @@ void Assembler::embed(const void* data, size_t len) ASMJIT_NOTHROW
   _buffer.emitData(data, len);
 }
 
+// ============================================================================
+// [AsmJit::Assembler - Reloc]
+// ============================================================================
+
+size_t Assembler::relocCode(void* dst, sysuint_t addressBase, MemoryManager* memmgr) const ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(memmgr);
+  return relocCode(dst, addressBase);
+}
+
+void* Assembler::getPlacementHint() const ASMJIT_NOTHROW
+{
+  size_t i;
+  size_t len = _relocData.getLength();
+
+  for (i = 0; i < len; i++)
+  {
+    const RelocData& r = _relocData[i];
+    if (r.type == kRelocTrampoline)
+      return r.address;
+  }
+
+  return NULL;
+}
+
 // ============================================================================
 // [AsmJit::Assembler - Helpers]
 // ============================================================================
 
+// Hash of the trampoline target, the low bits of addresses are not random.
+static inline uint32_t _HashAddress(const void* address) ASMJIT_NOTHROW
+{
+  uint64_t h = (uint64_t)(sysuint_t)address;
+
+  h ^= h >> 33;
+  h *= ASMJIT_UINT64_C(0xFF51AFD7ED558CCD);
+  h ^= h >> 33;
+
+  return (uint32_t)h;
+}
+
+// Put @a relocId to the first free slot or to the slot of the same target
+// of @a table, returns the replaced index or kInvalidValue.
+static inline uint32_t _PutTrampoline(uint32_t* table, uint32_t capacity,
+  const Assembler::RelocData* relocData, uint32_t relocId) ASMJIT_NOTHROW
+{
+  void* address = relocData[relocId].address;
+  uint32_t mask = capacity - 1;
+  uint32_t i = _HashAddress(address) & mask;
+
+  for (;;)
+  {
+    uint32_t id = table[i];
+    if (id == kInvalidValue || relocData[id].address == address)
+    {
+      table[i] = relocId;
+      return id;
+    }
+
+    i = (i + 1) & mask;
+  }
+}
+
 Assembler::LabelLink* Assembler::_newLabelLink() ASMJIT_NOTHROW
 {
   LabelLink* link = _unusedLinks;
@@ -211,6 +294,39 @@ Assembler::LabelLink* Assembler::_newLabelLink() ASMJIT_NOTHROW
   return link;
 }
 
+uint32_t Assembler::_linkTrampoline(uint32_t relocId) ASMJIT_NOTHROW
+{
+  // Grow the table when it's half full, the old table is freed with the zone.
+  if ((_trampolineTableCount + 1) * 2 > _trampolineTableCapacity)
+  {
+    uint32_t capacity = _trampolineTableCapacity ? _trampolineTableCapacity * 2 : 64;
+    uint32_t* table = reinterpret_cast<uint32_t*>(_zoneMemory.alloc(capacity * sizeof(uint32_t)));
+
+    // The relocation is the first to its target then, it only reserves one
+    // more trampoline.
+    if (table == NULL)
+      return kInvalidValue;
+
+    memset(table, 0xFF, capacity * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < _trampolineTableCapacity; i++)
+    {
+      uint32_t id = _trampolineTable[i];
+      if (id != kInvalidValue)
+        _PutTrampoline(table, capacity, _relocData.getData(), id);
+    }
+
+    _trampolineTable = table;
+    _trampolineTableCapacity = capacity;
+  }
+
+  uint32_t prev = _PutTrampoline(_trampolineTable, _trampolineTableCapacity, _relocData.getData(), relocId);
+  if (prev == kInvalidValue)
+    _trampolineTableCount++;
+
+  return prev;
+}
+
 } // AsmJit namespace
 
 // [Api-End]
@@ -13,8 +13,8 @@
 #include "../Core/Context.h"
 #include "../Core/Defs.h"
 #include "../Core/Logger.h"
-#include "../Core/PodVector.h"
 #include "../Core/ZoneMemory.h"
+#include "../Core/ZoneVector.h"
 
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
@@ -93,6 +93,10 @@ struct Assembler
     uint32_t type;
     //! @brief Size of relocation (4 or 8 bytes).
     uint32_t size;
+    //! @brief Index of the previous @c kRelocTrampoline relocation to the same
+    //! address or @c kInvalidValue (only for @c kRelocTrampoline), the
+    //! relocations to one address share the trampoline.
+    uint32_t prevRelocId;
     //! @brief Offset from code begin address.
     sysint_t offset;
 
@@ -106,6 +110,12 @@ struct Assembler
     };
   };
 
+  //! @brief Function relocating code and relocation data copied from an
+  //! assembler, see @c getRelocFunc().
+  typedef size_t (*RelocFunc)(void* dst, sysuint_t addressBase, MemoryManager* memmgr,
+    const uint8_t* code, size_t codeSize, const RelocData* relocData, size_t relocCount,
+    Logger* logger);
+
   // --------------------------------------------------------------------------
   // [Context]
   // --------------------------------------------------------------------------
@@ -157,6 +167,20 @@ struct Assembler
   //! @brief Set assembler property.
   ASMJIT_API virtual void setProperty(uint32_t propertyId, uint32_t value) ASMJIT_NOTHROW;
 
+  //! @brief Get alignment of the code in memory.
+  //!
+  //! @sa @c setCodeAlignment().
+  inline uint32_t getCodeAlignment() const ASMJIT_NOTHROW
+  { return _codeAlignment; }
+
+  //! @brief Set alignment of the code in memory, zero means the default
+  //! alignment of the memory manager (64 bytes by default).
+  //!
+  //! The alignment is requested by @ref JitContext when allocating memory
+  //! for the code and it must be power of 2.
+  inline void setCodeAlignment(uint32_t alignment) ASMJIT_NOTHROW
+  { _codeAlignment = alignment; }
+
   // --------------------------------------------------------------------------
   // [Capacity]
   // --------------------------------------------------------------------------
@@ -165,6 +189,43 @@ struct Assembler
   inline size_t getCapacity() const ASMJIT_NOTHROW
   { return _buffer.getCapacity(); }
 
+  //! @brief Reserve internal code buffer for @a size bytes of code.
+  //!
+  //! Use it when the code size is known (or can be estimated) before emitting
+  //! to prevent reallocation of the buffer. Returns false on out of memory.
+  inline bool reserve(size_t size) ASMJIT_NOTHROW
+  { return _buffer.reserve(size); }
+
+  // --------------------------------------------------------------------------
+  // [Direct Memory]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get memory manager the code is emitted to directly (NULL if the
+  //! code is emitted to the heap).
+  inline MemoryManager* getDirectMemoryManager() const ASMJIT_NOTHROW
+  { return _buffer.getMemoryManager(); }
+
+  //! @brief Set memory manager the code is emitted to directly (NULL to emit
+  //! the code to the heap, default).
+  //!
+  //! The code buffer is allocated by @a memmgr, which should be the memory
+  //! manager of @ref JitContext used by @c make(). The context then relocates
+  //! the code in place and takes the memory, so the code is not copied. After
+  //! @c make() the assembler contains no code and it must be cleared before
+  //! it's used again.
+  //!
+  //! The code is still copied if it can't stay where it was emitted: if
+  //! @ref JitContext places the code on NUMA node or allocates permanent
+  //! memory, if the buffer is not aligned to @c getCodeAlignment() and if
+  //! it's not within 32-bit displacement of @c getPlacementHint() (the code
+  //! is copied near the called functions, so it doesn't need trampolines).
+  //!
+  //! The current code is discarded, so call it before emitting. Growing the
+  //! buffer can require to move it to other memory (which is slower than
+  //! @c realloc() on the heap), so use @c reserve() if the code size can be
+  //! estimated.
+  ASMJIT_API void setDirectMemoryManager(MemoryManager* memmgr) ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Offset]
   // --------------------------------------------------------------------------
@@ -203,6 +264,9 @@ struct Assembler
   // --------------------------------------------------------------------------
 
   //! @brief Take internal code buffer and NULL all pointers (you take the ownership).
+  //!
+  //! Labels and relocation data are discarded, they are released together
+  //! with the zone memory.
   ASMJIT_API uint8_t* takeCode() ASMJIT_NOTHROW;
 
   // --------------------------------------------------------------------------
@@ -240,7 +304,7 @@ struct Assembler
   //! call absolute address directly).
   //!
   //! Currently only _emitJmpOrCallReloc() method can increase trampoline size
-  //! value.
+  //! value. Calls or jumps to the same address share one trampoline.
   inline size_t getTrampolineSize() const ASMJIT_NOTHROW
   { return _trampolineSize; }
 
@@ -417,8 +481,9 @@ struct Assembler
   //! want only to store the code for later reuse (or load, etc...).
   //! @param addressBase Base address used for relocation. When using JIT code
   //! generation, this will be the same as @a dst, only casted to system
-  //! integer type. But when generating code for remote process then the value
-  //! can be different.
+  //! integer type. But when generating code for remote process or when the
+  //! memory is mapped twice (see @c MemoryManager::getWritableAddress()) then
+  //! the value can be different.
   //!
   //! @retval The bytes used. Code-generator can create trampolines which are
   //! used when calling other functions inside the JIT code. However, these
@@ -429,12 +494,43 @@ struct Assembler
   //! @c getCodeSize().
   virtual size_t relocCode(void* dst, sysuint_t addressBase) const ASMJIT_NOTHROW = 0;
 
+  //! @brief Relocate code to a given address @a dst, sharing trampolines
+  //! with other code allocated by @a memmgr.
+  //!
+  //! Trampolines are taken from @a memmgr (see
+  //! @c MemoryManager::getTrampoline()), so the code calling the same function
+  //! as other code placed near it doesn't need its own trampoline. Only when
+  //! the memory manager can't provide the trampoline it's written after the
+  //! code. The @a addressBase must be the address returned by @a memmgr.
+  //! Default implementation ignores @a memmgr.
+  //!
+  //! @overload
+  ASMJIT_API virtual size_t relocCode(void* dst, sysuint_t addressBase, MemoryManager* memmgr) const ASMJIT_NOTHROW;
+
   //! @brief Simplifed version of @c relocCode() method designed for JIT.
   //!
   //! @overload
   inline size_t relocCode(void* dst) const ASMJIT_NOTHROW
   { return relocCode(dst, (uintptr_t)dst); }
 
+  //! @brief Get function which relocates code and relocation data copied
+  //! from the assembler.
+  //!
+  //! The function relocates the code the same way as @c relocCode() with
+  //! @a memmgr, but it doesn't need the assembler, so it's used to relocate
+  //! the code again when the assembler doesn't exist anymore (see
+  //! @c CodeCompactor). The destination must have space also for
+  //! trampolines (see @c getTrampolineSize()).
+  virtual RelocFunc getRelocFunc() const ASMJIT_NOTHROW = 0;
+
+  //! @brief Get address which should be near to the relocated code.
+  //!
+  //! Returns the first absolute address called or jumped to by the code that
+  //! can require trampoline, or NULL if there is no such address. If the
+  //! code is relocated near to it (see @c MemoryManager::allocNear()), the
+  //! trampolines are not needed.
+  ASMJIT_API void* getPlacementHint() const ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Make]
   // --------------------------------------------------------------------------
@@ -454,6 +550,11 @@ struct Assembler
 
   ASMJIT_API LabelLink* _newLabelLink() ASMJIT_NOTHROW;
 
+  //! @brief Add trampoline relocation @a relocId to the table of trampoline
+  //! targets, returns index of the previous relocation to the same address
+  //! or @c kInvalidValue if it's the first one.
+  ASMJIT_API uint32_t _linkTrampoline(uint32_t relocId) ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -472,6 +573,8 @@ struct Assembler
   uint32_t _error;
   //! @brief Properties.
   uint32_t _properties;
+  //! @brief Alignment of the code in memory.
+  uint32_t _codeAlignment;
   //! @brief Emit flags for next instruction (cleared after emit).
   uint32_t _emitOptions;
   //! @brief Size of possible trampolines.
@@ -483,10 +586,19 @@ struct Assembler
   //! @brief Linked list of unused links (@c LabelLink* structures)
   LabelLink* _unusedLinks;
 
-  //! @brief Labels data.
-  PodVector<LabelData> _labels;
-  //! @brief Relocations data.
-  PodVector<RelocData> _relocData;
+  //! @brief Labels data (allocated by @c _zoneMemory).
+  ZoneVector<LabelData> _labels;
+  //! @brief Relocations data (allocated by @c _zoneMemory).
+  ZoneVector<RelocData> _relocData;
+
+  //! @brief Hash table of targets of trampoline relocations, each slot is
+  //! index of the last relocation to the target or @c kInvalidValue
+  //! (allocated by @c _zoneMemory).
+  uint32_t* _trampolineTable;
+  //! @brief Capacity of @c _trampolineTable (power of 2).
+  uint32_t _trampolineTableCapacity;
+  //! @brief Count of targets in @c _trampolineTable.
+  uint32_t _trampolineTableCount;
 };
 
 //! @}
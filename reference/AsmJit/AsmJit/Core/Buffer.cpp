@@ -9,12 +9,38 @@
 // [Dependencies - AsmJit]
 #include "../Core/Buffer.h"
 #include "../Core/Defs.h"
+#include "../Core/MemoryManager.h"
 
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
 
 namespace AsmJit {
 
+// ============================================================================
+// [AsmJit::Buffer - Helpers]
+// ============================================================================
+
+// Get capacity the buffer of @a capacity bytes grows to so it contains at
+// least @a needed bytes.
+static size_t _GetGrowCapacity(size_t capacity, size_t needed) ASMJIT_NOTHROW
+{
+  size_t to = (capacity < 512) ? 1024 : capacity;
+
+  while (to < needed)
+  {
+    // Large buffers grow by 50% to waste less memory.
+    size_t step = (to < 1048576) ? to : (to >> 1);
+
+    // Overflow.
+    if (to + step < to)
+      return needed;
+
+    to += step;
+  }
+
+  return to;
+}
+
 // ============================================================================
 // [AsmJit::Buffer]
 // ============================================================================
@@ -23,7 +49,7 @@ void Buffer::emitData(const void* ptr, size_t len) ASMJIT_NOTHROW
 {
   size_t max = getCapacity() - getOffset();
 
-  if (max < len && !realloc(getOffset() + len))
+  if (max < len && !realloc(_GetGrowCapacity(_capacity, getOffset() + len)))
   {
     return;
   }
@@ -39,13 +65,45 @@ bool Buffer::realloc(size_t to) ASMJIT_NOTHROW
     size_t len = getOffset();
     uint8_t *newdata;
 
-    if (_data != NULL)
-      newdata = (uint8_t*)ASMJIT_REALLOC(_data, to);
+    if (_memoryManager == NULL)
+    {
+      if (_data != NULL)
+        newdata = (uint8_t*)ASMJIT_REALLOC(_data, to);
+      else
+        newdata = (uint8_t*)ASMJIT_MALLOC(to);
+
+      if (newdata == NULL)
+        return false;
+    }
+    else if (_address != NULL && _memoryManager->grow(_address, to))
+    {
+      newdata = _data;
+    }
     else
-      newdata = (uint8_t*)ASMJIT_MALLOC(to);
+    {
+      // Memory following the buffer is used, move it. Twice as much memory
+      // is allocated and the tail is returned, so the next grow() will most
+      // likely succeed (the buffer would be copied again otherwise).
+      void* address = (to * 2 > to) ? _memoryManager->alloc(to * 2, kMemAllocFreeable) : NULL;
+
+      if (address != NULL)
+        _memoryManager->shrink(address, to);
+      else
+        address = _memoryManager->alloc(to, kMemAllocFreeable);
+
+      if (address == NULL)
+        return false;
+
+      newdata = (uint8_t*)_memoryManager->getWritableAddress(address);
+
+      if (_address != NULL)
+      {
+        memcpy(newdata, _data, len);
+        _memoryManager->free(_address);
+      }
 
-    if (newdata == NULL)
-      return false;
+      _address = address;
+    }
 
     _data = newdata;
     _cur = newdata + len;
@@ -60,42 +118,90 @@ bool Buffer::realloc(size_t to) ASMJIT_NOTHROW
 
 bool Buffer::grow() ASMJIT_NOTHROW
 {
-  size_t to = _capacity;
-
-  if (to < 512)
-    to = 1024;
-  else if (to > 65536)
-    to += 65536;
-  else
-    to <<= 1;
+  size_t to = _GetGrowCapacity(_capacity, _capacity + 1);
+  if (to <= _capacity)
+    return false;
 
   return realloc(to);
 }
 
+bool Buffer::reserve(size_t size) ASMJIT_NOTHROW
+{
+  // Buffer is grown by ensureSpace() when less than kBufferGrow bytes remain.
+  size_t needed = size + kBufferGrow;
+  if (needed < size)
+    return false;
+
+  if (needed <= _capacity)
+    return true;
+
+  // Grow geometrically, reserve() can be called repeatedly with slightly
+  // larger sizes (once per function by Compiler) and the buffer would be
+  // copied each time otherwise.
+  return realloc(_GetGrowCapacity(_capacity, needed));
+}
+
+void Buffer::setMemoryManager(MemoryManager* memmgr) ASMJIT_NOTHROW
+{
+  if (_memoryManager == memmgr)
+    return;
+
+  reset();
+  _memoryManager = memmgr;
+}
+
 void Buffer::reset() ASMJIT_NOTHROW
 {
   if (_data == NULL)
     return;
-  ASMJIT_FREE(_data);
+
+  if (_memoryManager != NULL)
+    _memoryManager->free(_address);
+  else
+    ASMJIT_FREE(_data);
 
   _data = NULL;
   _cur = NULL;
   _max = NULL;
   _capacity = 0;
+  _address = NULL;
 }
 
 uint8_t* Buffer::take() ASMJIT_NOTHROW
 {
   uint8_t* data = _data;
 
+  if (_memoryManager != NULL && data != NULL)
+  {
+    data = (uint8_t*)ASMJIT_MALLOC(_capacity);
+    if (data != NULL)
+      memcpy(data, _data, getOffset());
+
+    _memoryManager->free(_address);
+  }
+
   _data = NULL;
   _cur = NULL;
   _max = NULL;
   _capacity = 0;
+  _address = NULL;
 
   return data;
 }
 
+void* Buffer::takeAddress() ASMJIT_NOTHROW
+{
+  void* address = _address;
+
+  _data = NULL;
+  _cur = NULL;
+  _max = NULL;
+  _capacity = 0;
+  _address = NULL;
+
+  return address;
+}
+
 } // AsmJit namespace
 
 // [Api-End]
@@ -25,6 +25,7 @@ namespace AsmJit {
 // ============================================================================
 
 struct Buffer;
+struct MemoryManager;
 
 // ============================================================================
 // [AsmJit::Buffer]
@@ -64,6 +65,11 @@ struct Buffer;
 //!   ...
 //! }
 //! @endcode
+//!
+//! Buffer is allocated on the heap by default. If memory manager is set by
+//! @c setMemoryManager(), the buffer is allocated by the memory manager and
+//! the code is emitted directly to its writable view, so it doesn't need to
+//! be copied to the executable memory later (see @c takeAddress()).
 struct Buffer
 {
   // --------------------------------------------------------------------------
@@ -74,13 +80,15 @@ struct Buffer
     _data(NULL),
     _cur(NULL),
     _max(NULL),
-    _capacity(0)
+    _capacity(0),
+    _memoryManager(NULL),
+    _address(NULL)
   {
   }
 
   inline ~Buffer() ASMJIT_NOTHROW
   {
-    if (_data) ASMJIT_FREE(_data);
+    if (_data) reset();
   }
 
   //! @brief Get start of buffer.
@@ -98,6 +106,21 @@ struct Buffer
   //! @brief Get capacity of buffer.
   inline size_t getCapacity() const ASMJIT_NOTHROW { return _capacity; }
 
+  //! @brief Get memory manager the buffer is allocated by (NULL if it's
+  //! allocated on the heap).
+  inline MemoryManager* getMemoryManager() const ASMJIT_NOTHROW { return _memoryManager; }
+
+  //! @brief Set memory manager the buffer is allocated by (NULL to allocate
+  //! it on the heap).
+  //!
+  //! The current buffer is freed, so it should be called before emitting.
+  ASMJIT_API void setMemoryManager(MemoryManager* memmgr) ASMJIT_NOTHROW;
+
+  //! @brief Get address of the buffer in memory allocated by the memory
+  //! manager (@c getData() returns its writable view), NULL if the buffer is
+  //! allocated on the heap.
+  inline void* getAddress() const ASMJIT_NOTHROW { return _address; }
+
   //! @brief Ensure space for next instruction
   inline bool ensureSpace() ASMJIT_NOTHROW { return (_cur >= _max) ? grow() : true; }
 
@@ -122,10 +145,18 @@ struct Buffer
 
   //! @brief Used to grow the buffer.
   //!
-  //! It will typically realloc to twice size of capacity(), but if capacity()
-  //! is large, it will use smaller steps.
+  //! It will typically realloc to twice size of capacity(), if capacity() is
+  //! large (1MB and more) it grows by half of capacity(). The growth is always
+  //! geometric, so emitting code of any size copies it only a few times.
   ASMJIT_API bool grow() ASMJIT_NOTHROW;
 
+  //! @brief Reserve space for @a size bytes, so they can be emitted without
+  //! growing the buffer.
+  //!
+  //! If the buffer has to be reallocated, it grows the same way as by
+  //! @c grow(), so it can be called repeatedly with increasing sizes.
+  ASMJIT_API bool reserve(size_t size) ASMJIT_NOTHROW;
+
   //! @brief Clear everything, but not deallocate buffer.
   inline void clear() ASMJIT_NOTHROW { _cur = _data; }
 
@@ -133,8 +164,17 @@ struct Buffer
   ASMJIT_API void reset() ASMJIT_NOTHROW;
 
   //! @brief Take ownership of the buffer data and purge @c Buffer instance.
+  //!
+  //! The data are always allocated on the heap, if the buffer is allocated by
+  //! the memory manager, they are copied and the buffer is freed.
   ASMJIT_API uint8_t* take() ASMJIT_NOTHROW;
 
+  //! @brief Take ownership of memory allocated by the memory manager and
+  //! purge @c Buffer instance, returns its address (see @c getAddress()).
+  //!
+  //! The memory must be freed by the memory manager.
+  ASMJIT_API void* takeAddress() ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Emit]
   // --------------------------------------------------------------------------
@@ -336,6 +376,11 @@ struct Buffer
 
   //! @brief Buffer capacity (in bytes).
   size_t _capacity;
+
+  //! @brief Memory manager the buffer is allocated by or NULL.
+  MemoryManager* _memoryManager;
+  //! @brief Address of the buffer allocated by the memory manager.
+  void* _address;
 };
 
 //! @}
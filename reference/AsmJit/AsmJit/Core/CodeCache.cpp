@@ -0,0 +1,325 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+#define _ASMJIT_BEING_COMPILED
+
+// [Dependencies - AsmJit]
+#include "../Core/Assembler.h"
+#include "../Core/CodeCache.h"
+
+// [Api-Begin]
+#include "../Core/ApiBegin.h"
+
+namespace AsmJit {
+
+// ============================================================================
+// [AsmJit::CodeCacheListener]
+// ============================================================================
+
+CodeCacheListener::CodeCacheListener() ASMJIT_NOTHROW {}
+CodeCacheListener::~CodeCacheListener() ASMJIT_NOTHROW {}
+
+// ============================================================================
+// [AsmJit::CodeCache - Helpers]
+// ============================================================================
+
+// Get hash bucket of @a key (bucketCount must be power of 2).
+static inline size_t _GetBucket(uint64_t key, size_t bucketCount) ASMJIT_NOTHROW
+{
+  uint64_t h = key * ASMJIT_UINT64_C(0x9E3779B97F4A7C15);
+  return (size_t)(h >> 32) & (bucketCount - 1);
+}
+
+// ============================================================================
+// [AsmJit::CodeCache - Construction / Destruction]
+// ============================================================================
+
+CodeCache::CodeCache(size_t limit) ASMJIT_NOTHROW :
+  _listener(NULL),
+  _limit(limit),
+  _first(NULL),
+  _last(NULL),
+  _buckets(NULL),
+  _bucketCount(0),
+  _count(0),
+  _usedBytes(0),
+  _hits(0),
+  _misses(0),
+  _evictions(0)
+{
+  _jitContext.setMemoryManager(&_memoryManager);
+}
+
+CodeCache::~CodeCache() ASMJIT_NOTHROW
+{
+  clear();
+  if (_buckets) ASMJIT_FREE(_buckets);
+}
+
+// ============================================================================
+// [AsmJit::CodeCache - Accessors]
+// ============================================================================
+
+void CodeCache::setLimit(size_t limit) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  _limit = limit;
+  _evict(0, NULL);
+}
+
+// ============================================================================
+// [AsmJit::CodeCache - Interface]
+// ============================================================================
+
+void* CodeCache::get(uint64_t key) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  Entry* entry = (_count != 0) ? *_findEntry(key) : NULL;
+  if (entry == NULL)
+  {
+    _misses++;
+    return NULL;
+  }
+
+  _hits++;
+
+  // Move to the front of the list (most recently used).
+  if (entry != _first)
+  {
+    Entry* prev = entry->prev;
+    Entry* next = entry->next;
+
+    prev->next = next;
+    if (next) next->prev = prev; else _last = prev;
+
+    entry->prev = NULL;
+    entry->next = _first;
+    _first->prev = entry;
+    _first = entry;
+  }
+
+  return entry->func;
+}
+
+uint32_t CodeCache::generate(uint64_t key, void** dest, Assembler* assembler) ASMJIT_NOTHROW
+{
+  size_t codeSize = assembler->getCodeSize();
+  AutoLock locked(_lock);
+
+  // Replace the function already stored under the key.
+  if (_count != 0)
+  {
+    Entry** pEntry = _findEntry(key);
+    if (*pEntry) _removeEntry(pEntry, true);
+  }
+
+  if (_count >= _bucketCount && !_growBuckets())
+  {
+    *dest = NULL;
+    return kErrorNoHeapMemory;
+  }
+
+  Entry* entry = reinterpret_cast<Entry*>(ASMJIT_MALLOC(sizeof(Entry)));
+  if (entry == NULL)
+  {
+    *dest = NULL;
+    return kErrorNoHeapMemory;
+  }
+
+  // Make room for the function.
+  _evict(codeSize, NULL);
+
+  uint32_t error = _jitContext.generate(dest, assembler);
+  if (error != kErrorOk)
+  {
+    ASMJIT_FREE(entry);
+    return error;
+  }
+
+  Entry** pBucket = &_buckets[_GetBucket(key, _bucketCount)];
+
+  entry->key = key;
+  entry->func = *dest;
+  entry->size = codeSize;
+
+  entry->prev = NULL;
+  entry->next = _first;
+  entry->hashNext = *pBucket;
+
+  if (_first) _first->prev = entry; else _last = entry;
+  _first = entry;
+  *pBucket = entry;
+
+  _count++;
+  _usedBytes += codeSize;
+
+  // The function might need new chunk of virtual memory.
+  _evict(0, entry);
+  return kErrorOk;
+}
+
+bool CodeCache::remove(uint64_t key) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+  if (_count == 0) return false;
+
+  Entry** pEntry = _findEntry(key);
+  if (*pEntry == NULL) return false;
+
+  _removeEntry(pEntry, false);
+  _memoryManager.reclaim();
+  return true;
+}
+
+void CodeCache::clear() ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  Entry* entry = _first;
+  while (entry)
+  {
+    Entry* next = entry->next;
+
+    if (!_memoryManager.retire(entry->func))
+      _memoryManager.free(entry->func);
+    ASMJIT_FREE(entry);
+
+    entry = next;
+  }
+
+  if (_buckets) memset(_buckets, 0, _bucketCount * sizeof(Entry*));
+
+  _first = NULL;
+  _last = NULL;
+  _count = 0;
+  _usedBytes = 0;
+
+  _memoryManager.reclaim();
+}
+
+// ============================================================================
+// [AsmJit::CodeCache - Helpers]
+// ============================================================================
+
+// Get pointer to the link where the entry of @a key is (or should be).
+CodeCache::Entry** CodeCache::_findEntry(uint64_t key) ASMJIT_NOTHROW
+{
+  Entry** pEntry = &_buckets[_GetBucket(key, _bucketCount)];
+
+  while (*pEntry != NULL && (*pEntry)->key != key)
+    pEntry = &(*pEntry)->hashNext;
+
+  return pEntry;
+}
+
+// Remove entry from the cache and free its function, the listener is called
+// if @a evict is true.
+void CodeCache::_removeEntry(Entry** pEntry, bool evict) ASMJIT_NOTHROW
+{
+  Entry* entry = *pEntry;
+  *pEntry = entry->hashNext;
+
+  if (entry->prev) entry->prev->next = entry->next; else _first = entry->next;
+  if (entry->next) entry->next->prev = entry->prev; else _last = entry->prev;
+
+  if (evict)
+  {
+    if (_listener) _listener->onEvict(entry->key, entry->func);
+    _evictions++;
+  }
+
+  // Threads can still execute the function if they are registered by the
+  // memory manager, retire() frees it when it's safe.
+  if (!_memoryManager.retire(entry->func))
+    _memoryManager.free(entry->func);
+
+  _count--;
+  _usedBytes -= entry->size;
+
+  ASMJIT_FREE(entry);
+}
+
+bool CodeCache::_growBuckets() ASMJIT_NOTHROW
+{
+  size_t bucketCount = _bucketCount ? _bucketCount * 2 : 64;
+  Entry** buckets = reinterpret_cast<Entry**>(ASMJIT_MALLOC(bucketCount * sizeof(Entry*)));
+  if (buckets == NULL) return false;
+
+  memset(buckets, 0, bucketCount * sizeof(Entry*));
+
+  // Rehash all entries.
+  Entry* entry;
+  for (entry = _first; entry != NULL; entry = entry->next)
+  {
+    Entry** pBucket = &buckets[_GetBucket(entry->key, bucketCount)];
+    entry->hashNext = *pBucket;
+    *pBucket = entry;
+  }
+
+  if (_buckets) ASMJIT_FREE(_buckets);
+
+  _buckets = buckets;
+  _bucketCount = bucketCount;
+  return true;
+}
+
+// Evict least recently used functions (except @a keep) until there is room
+// for @a size bytes.
+//
+// Functions must fit into the limit, but the memory manager also allocates
+// the virtual memory in chunks that can't be freed while they contain some
+// function, so the allocated memory is checked too. Retired functions are
+// not counted, they are freed by reclaim() when all registered threads are
+// quiescent and evicting more functions can't free them sooner.
+void CodeCache::_evict(size_t size, Entry* keep) ASMJIT_NOTHROW
+{
+  bool evicted = false;
+
+  while (_last != NULL && _last != keep)
+  {
+    size_t allocated = _memoryManager.getAllocatedBytes();
+    size_t retired = _memoryManager.getRetiredBytes();
+
+    if (retired > allocated) retired = allocated;
+    if (_usedBytes + size <= _limit && allocated - retired <= _limit) break;
+
+    Entry** pEntry = _findEntry(_last->key);
+    _removeEntry(pEntry, true);
+    evicted = true;
+  }
+
+  if (evicted) _memoryManager.reclaim();
+}
+
+// ============================================================================
+// [AsmJit::CodeCacheContext - Construction / Destruction]
+// ============================================================================
+
+CodeCacheContext::CodeCacheContext(CodeCache* cache, uint64_t key) :
+  _cache(cache),
+  _key(key)
+{
+}
+
+CodeCacheContext::~CodeCacheContext()
+{
+}
+
+// ============================================================================
+// [AsmJit::CodeCacheContext - Interface]
+// ============================================================================
+
+uint32_t CodeCacheContext::generate(void** dest, Assembler* assembler)
+{
+  return _cache->generate(_key, dest, assembler);
+}
+
+} // AsmJit namespace
+
+// [Api-End]
+#include "../Core/ApiEnd.h"
@@ -0,0 +1,311 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// [Guard]
+#ifndef _ASMJIT_CORE_CODECACHE_H
+#define _ASMJIT_CORE_CODECACHE_H
+
+// [Dependencies - AsmJit]
+#include "../Core/Build.h"
+#include "../Core/Context.h"
+#include "../Core/Defs.h"
+#include "../Core/Lock.h"
+#include "../Core/MemoryManager.h"
+
+// [Api-Begin]
+#include "../Core/ApiBegin.h"
+
+namespace AsmJit {
+
+//! @addtogroup AsmJit_MemoryManagement
+//! @{
+
+// ============================================================================
+// [AsmJit::CodeCacheListener]
+// ============================================================================
+
+//! @brief Code cache listener interface.
+struct CodeCacheListener
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API CodeCacheListener() ASMJIT_NOTHROW;
+  ASMJIT_API virtual ~CodeCacheListener() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! @brief Called before the function @a func stored under @a key is evicted
+  //! from the cache (or replaced by new function with the same key).
+  //!
+  //! The code cache is locked while calling this method, so it must not call
+  //! the code cache.
+  virtual void onEvict(uint64_t key, void* func) ASMJIT_NOTHROW = 0;
+
+  ASMJIT_NO_COPY(CodeCacheListener)
+};
+
+// ============================================================================
+// [AsmJit::CodeCache]
+// ============================================================================
+
+//! @brief Cache of generated functions with limited size.
+//!
+//! Functions are stored under a key supplied by the caller (usually hash of
+//! whatever the function was generated for). The memory for functions is
+//! allocated by own @c VirtualMemoryManager of the code cache. When the
+//! functions stored would need more memory than the limit, the least recently
+//! used ones are evicted (see @c CodeCacheListener).
+//!
+//! Example:
+//!
+//! @code
+//! CodeCache cache(1024 * 1024);
+//!
+//! void* fn = cache.get(key);
+//! if (fn == NULL)
+//! {
+//!   CodeCacheContext context(&cache, key);
+//!   X86Compiler c(&context);
+//!
+//!   // Generate the function.
+//!   ...
+//!
+//!   fn = c.make();
+//! }
+//! @endcode
+//!
+//! @note The function returned by @c get() can be evicted by other thread
+//! while it's still executed. If it's possible, the threads calling the
+//! functions must be registered by the memory manager of the code cache (see
+//! @c MemoryManager::registerThread()), evicted functions are then freed
+//! only after all threads passed quiescent state.
+struct CodeCache
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a @c CodeCache instance, which allocates at most @a limit
+  //! bytes of virtual memory.
+  //!
+  //! Memory manager allocates virtual memory in chunks (64kB), so the limit
+  //! should be much larger than that.
+  ASMJIT_API CodeCache(size_t limit) ASMJIT_NOTHROW;
+  //! @brief Destroy the @c CodeCache instance, all functions are freed
+  //! (without calling the listener).
+  ASMJIT_API ~CodeCache() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get the memory manager used to allocate functions.
+  inline VirtualMemoryManager* getMemoryManager() ASMJIT_NOTHROW
+  { return &_memoryManager; }
+
+  //! @brief Get the listener.
+  inline CodeCacheListener* getListener() const ASMJIT_NOTHROW
+  { return _listener; }
+
+  //! @brief Set the listener.
+  inline void setListener(CodeCacheListener* listener) ASMJIT_NOTHROW
+  { _listener = listener; }
+
+  //! @brief Get the maximum count of bytes allocated.
+  inline size_t getLimit() const ASMJIT_NOTHROW
+  { return _limit; }
+
+  //! @brief Set the maximum count of bytes allocated, functions are evicted
+  //! if needed.
+  ASMJIT_API void setLimit(size_t limit) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get function stored under @a key or NULL if there is no such
+  //! function.
+  ASMJIT_API void* get(uint64_t key) ASMJIT_NOTHROW;
+
+  //! @brief Generate code of @a assembler and store it under @a key.
+  //!
+  //! Function already stored under @a key is replaced. This method is used by
+  //! @c CodeCacheContext.
+  //!
+  //! @return Error value, see @c kError.
+  ASMJIT_API uint32_t generate(uint64_t key, void** dest, Assembler* assembler) ASMJIT_NOTHROW;
+
+  //! @brief Remove function stored under @a key (without calling the
+  //! listener). Returns @c false if there is no such function.
+  ASMJIT_API bool remove(uint64_t key) ASMJIT_NOTHROW;
+
+  //! @brief Remove all functions (without calling the listener).
+  ASMJIT_API void clear() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Statistics]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get count of functions stored.
+  inline size_t getCount() const ASMJIT_NOTHROW
+  { return _count; }
+
+  //! @brief Get count of bytes used by functions stored.
+  inline size_t getUsedBytes() const ASMJIT_NOTHROW
+  { return _usedBytes; }
+
+  //! @brief Get count of bytes allocated by the memory manager.
+  inline size_t getAllocatedBytes() ASMJIT_NOTHROW
+  { return _memoryManager.getAllocatedBytes(); }
+
+  //! @brief Get how many times @c get() found the function.
+  inline size_t getHits() const ASMJIT_NOTHROW
+  { return _hits; }
+
+  //! @brief Get how many times @c get() didn't find the function.
+  inline size_t getMisses() const ASMJIT_NOTHROW
+  { return _misses; }
+
+  //! @brief Get how many functions were evicted.
+  inline size_t getEvictions() const ASMJIT_NOTHROW
+  { return _evictions; }
+
+  // --------------------------------------------------------------------------
+  // [Entry]
+  // --------------------------------------------------------------------------
+
+  //! @internal
+  //!
+  //! @brief Function stored in the cache.
+  struct Entry
+  {
+    //! @brief Key.
+    uint64_t key;
+    //! @brief Function.
+    void* func;
+    //! @brief Size of the function.
+    size_t size;
+
+    //! @brief Previous (more recently used) entry.
+    Entry* prev;
+    //! @brief Next (less recently used) entry.
+    Entry* next;
+    //! @brief Next entry in the same hash bucket.
+    Entry* hashNext;
+  };
+
+  // --------------------------------------------------------------------------
+  // [Helpers]
+  // --------------------------------------------------------------------------
+
+  //! @internal
+  ASMJIT_API Entry** _findEntry(uint64_t key) ASMJIT_NOTHROW;
+  //! @internal
+  ASMJIT_API void _removeEntry(Entry** pEntry, bool evict) ASMJIT_NOTHROW;
+  //! @internal
+  ASMJIT_API bool _growBuckets() ASMJIT_NOTHROW;
+  //! @internal
+  ASMJIT_API void _evict(size_t size, Entry* keep) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Lock for thread safety.
+  Lock _lock;
+  //! @brief Memory manager.
+  VirtualMemoryManager _memoryManager;
+  //! @brief Context used to generate functions.
+  JitContext _jitContext;
+  //! @brief Listener.
+  CodeCacheListener* _listener;
+
+  //! @brief Maximum count of bytes allocated.
+  size_t _limit;
+
+  //! @brief Most recently used entry.
+  Entry* _first;
+  //! @brief Least recently used entry.
+  Entry* _last;
+
+  //! @brief Hash buckets.
+  Entry** _buckets;
+  //! @brief Count of hash buckets (power of 2).
+  size_t _bucketCount;
+
+  //! @brief Count of entries.
+  size_t _count;
+  //! @brief Count of bytes used by entries.
+  size_t _usedBytes;
+
+  //! @brief Statistics.
+  size_t _hits;
+  size_t _misses;
+  size_t _evictions;
+
+  ASMJIT_NO_COPY(CodeCache)
+};
+
+// ============================================================================
+// [AsmJit::CodeCacheContext]
+// ============================================================================
+
+//! @brief Context which stores generated code into @c CodeCache under a
+//! given key.
+struct CodeCacheContext : public Context
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a @c CodeCacheContext instance.
+  ASMJIT_API CodeCacheContext(CodeCache* cache, uint64_t key);
+  //! @brief Destroy the @c CodeCacheContext instance.
+  ASMJIT_API virtual ~CodeCacheContext();
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get the code cache.
+  inline CodeCache* getCodeCache() const
+  { return _cache; }
+
+  //! @brief Get the key.
+  inline uint64_t getKey() const
+  { return _key; }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API virtual uint32_t generate(void** dest, Assembler* assembler);
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Code cache.
+  CodeCache* _cache;
+  //! @brief Key.
+  uint64_t _key;
+
+  ASMJIT_NO_COPY(CodeCacheContext)
+};
+
+//! @}
+
+} // AsmJit namespace
+
+// [Api-End]
+#include "../Core/ApiEnd.h"
+
+// [Guard]
+#endif // _ASMJIT_CORE_CODECACHE_H
@@ -0,0 +1,406 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+#define _ASMJIT_BEING_COMPILED
+
+// [Dependencies - AsmJit]
+#include "../Core/Assembler.h"
+#include "../Core/CodeCompactor.h"
+
+// [Api-Begin]
+#include "../Core/ApiBegin.h"
+
+namespace AsmJit {
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Entry Stub]
+// ============================================================================
+
+// Entry stub is an indirect jump through the address stored in the stub
+// itself, so it's redirected by writing the address only (not an
+// instruction). The address is aligned, it's written atomically and other
+// threads jump either to the old or to the new code.
+//
+// X86: jmp dword [stub + 8]  ; FF 25 <stub + 8>
+// X64: jmp qword [rip + 2]   ; FF 25 02 00 00 00
+enum
+{
+  //! @brief Size (and alignment) of entry stub.
+  kStubSize = 16,
+  //! @brief Offset of the target address in entry stub.
+  kStubTargetOffset = 8
+};
+
+static inline void _SetStubTarget(uint8_t* rw, void* target) ASMJIT_NOTHROW
+{
+  *reinterpret_cast<void* volatile*>(rw + kStubTargetOffset) = target;
+}
+
+static void _WriteStub(uint8_t* rw, uint8_t* stub, void* target) ASMJIT_NOTHROW
+{
+  memset(rw, 0xCC, kStubSize);
+
+  rw[0] = 0xFF;
+  rw[1] = 0x25;
+
+#if defined(ASMJIT_X64)
+  ASMJIT_UNUSED(stub);
+  *reinterpret_cast<uint32_t*>(rw + 2) = kStubTargetOffset - 6;
+#else
+  *reinterpret_cast<uint32_t*>(rw + 2) = (uint32_t)(sysuint_t)(stub + kStubTargetOffset);
+#endif // ASMJIT_X64
+
+  _SetStubTarget(rw, target);
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Helpers]
+// ============================================================================
+
+// Get hash bucket of @a stub (bucketCount must be power of 2).
+static inline size_t _GetBucket(const void* stub, size_t bucketCount) ASMJIT_NOTHROW
+{
+  uint64_t h = (uint64_t)(sysuint_t)stub * ASMJIT_UINT64_C(0x9E3779B97F4A7C15);
+  return (size_t)(h >> 32) & (bucketCount - 1);
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Construction / Destruction]
+// ============================================================================
+
+CodeCompactor::CodeCompactor() ASMJIT_NOTHROW :
+  _active(0),
+  _buckets(NULL),
+  _bucketCount(0),
+  _count(0),
+  _usedBytes(0),
+  _moves(0)
+{
+  _stubManager.setDensity(kStubSize);
+}
+
+CodeCompactor::~CodeCompactor() ASMJIT_NOTHROW
+{
+  size_t i;
+  for (i = 0; i < _bucketCount; i++)
+  {
+    Entry* entry = _buckets[i];
+    while (entry)
+    {
+      Entry* next = entry->hashNext;
+      ASMJIT_FREE(entry);
+      entry = next;
+    }
+  }
+
+  if (_buckets) ASMJIT_FREE(_buckets);
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Interface]
+// ============================================================================
+
+uint32_t CodeCompactor::generate(void** dest, Assembler* assembler) ASMJIT_NOTHROW
+{
+  if (assembler->getCodeSize() == 0)
+  {
+    *dest = NULL;
+    return kErrorNoFunction;
+  }
+
+  AutoLock locked(_lock);
+
+  if (_count >= _bucketCount && !_growBuckets())
+  {
+    *dest = NULL;
+    return kErrorNoHeapMemory;
+  }
+
+  // The assembler doesn't have to exist when the code is relocated again,
+  // so the code and relocation data are copied.
+  size_t dataSize = assembler->_buffer.getOffset();
+  size_t relocCount = assembler->_relocData.getLength();
+
+  Entry* entry = reinterpret_cast<Entry*>(ASMJIT_MALLOC(
+    sizeof(Entry) + relocCount * sizeof(Assembler::RelocData) + dataSize));
+  if (entry == NULL)
+  {
+    *dest = NULL;
+    return kErrorNoHeapMemory;
+  }
+
+  entry->dataSize = dataSize;
+  entry->relocCount = relocCount;
+  entry->trampolineSize = assembler->getTrampolineSize();
+  entry->alignment = assembler->getCodeAlignment();
+  entry->hint = assembler->getPlacementHint();
+  entry->reloc = assembler->getRelocFunc();
+
+  memcpy((void*)entry->getRelocData(), assembler->_relocData.getData(), relocCount * sizeof(Assembler::RelocData));
+  memcpy((void*)entry->getData(), assembler->_buffer.getData(), dataSize);
+
+  uint8_t* stub = reinterpret_cast<uint8_t*>(_stubManager.alloc(kStubSize));
+  void* code = (stub != NULL)
+    ? _relocEntry(getMemoryManager(), entry, assembler->getLogger(), &entry->size)
+    : NULL;
+
+  if (code == NULL)
+  {
+    if (stub) _stubManager.free(stub);
+    ASMJIT_FREE(entry);
+
+    *dest = NULL;
+    return kErrorNoVirtualMemory;
+  }
+
+  _WriteStub(reinterpret_cast<uint8_t*>(_stubManager.getWritableAddress(stub)), stub, code);
+
+  Entry** pBucket = &_buckets[_GetBucket(stub, _bucketCount)];
+
+  entry->stub = stub;
+  entry->code = code;
+  entry->moved = NULL;
+  entry->movedSize = 0;
+  entry->hashNext = *pBucket;
+  *pBucket = entry;
+
+  _count++;
+  _usedBytes += entry->size;
+
+  *dest = stub;
+  return kErrorOk;
+}
+
+void* CodeCompactor::getCode(void* func) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  Entry* entry = (_count != 0) ? *_findEntry(func) : NULL;
+  return entry != NULL ? entry->code : NULL;
+}
+
+bool CodeCompactor::remove(void* func) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+  if (_count == 0) return false;
+
+  Entry** pEntry = _findEntry(func);
+  Entry* entry = *pEntry;
+  if (entry == NULL) return false;
+
+  *pEntry = entry->hashNext;
+
+  // Threads can still execute the stub and the code.
+  VirtualMemoryManager* memmgr = getMemoryManager();
+  if (!memmgr->retire(entry->code)) memmgr->free(entry->code);
+  if (!_stubManager.retire(entry->stub)) _stubManager.free(entry->stub);
+
+  _count--;
+  _usedBytes -= entry->size;
+
+  ASMJIT_FREE(entry);
+  return true;
+}
+
+uint32_t CodeCompactor::compact() ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  VirtualMemoryManager* src = &_memoryManagers[_active];
+  VirtualMemoryManager* dst = &_memoryManagers[_active ^ 1];
+
+  uint32_t error = kErrorOk;
+  size_t i;
+  Entry* entry;
+
+  // Relocate all functions into the other memory manager, new chunks are
+  // used only by the moved code.
+  for (i = 0; i < _bucketCount && error == kErrorOk; i++)
+  {
+    for (entry = _buckets[i]; entry != NULL; entry = entry->hashNext)
+    {
+      entry->moved = _relocEntry(dst, entry, NULL, &entry->movedSize);
+      if (entry->moved == NULL)
+      {
+        error = kErrorNoVirtualMemory;
+        break;
+      }
+    }
+  }
+
+  if (error != kErrorOk)
+  {
+    for (i = 0; i < _bucketCount; i++)
+    {
+      for (entry = _buckets[i]; entry != NULL; entry = entry->hashNext)
+      {
+        if (entry->moved) dst->free(entry->moved);
+        entry->moved = NULL;
+      }
+    }
+    return error;
+  }
+
+  // Redirect entry stubs, the old code is freed when no thread executes it.
+  for (i = 0; i < _bucketCount; i++)
+  {
+    for (entry = _buckets[i]; entry != NULL; entry = entry->hashNext)
+    {
+      _SetStubTarget(reinterpret_cast<uint8_t*>(_stubManager.getWritableAddress(entry->stub)), entry->moved);
+      if (!src->retire(entry->code)) src->free(entry->code);
+
+      _usedBytes = _usedBytes - entry->size + entry->movedSize;
+
+      entry->code = entry->moved;
+      entry->size = entry->movedSize;
+      entry->moved = NULL;
+      _moves++;
+    }
+  }
+
+  _active ^= 1;
+  src->reclaim();
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Deferred Free]
+// ============================================================================
+
+bool CodeCompactor::registerThread() ASMJIT_NOTHROW
+{
+  return _memoryManagers[0].registerThread() &&
+         _memoryManagers[1].registerThread() &&
+         _stubManager.registerThread();
+}
+
+void CodeCompactor::unregisterThread() ASMJIT_NOTHROW
+{
+  _memoryManagers[0].unregisterThread();
+  _memoryManagers[1].unregisterThread();
+  _stubManager.unregisterThread();
+}
+
+void CodeCompactor::quiescent() ASMJIT_NOTHROW
+{
+  _memoryManagers[0].quiescent();
+  _memoryManagers[1].quiescent();
+  _stubManager.quiescent();
+}
+
+size_t CodeCompactor::reclaim() ASMJIT_NOTHROW
+{
+  return _memoryManagers[0].reclaim() +
+         _memoryManagers[1].reclaim() +
+         _stubManager.reclaim();
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Statistics]
+// ============================================================================
+
+size_t CodeCompactor::getAllocatedBytes() ASMJIT_NOTHROW
+{
+  return _memoryManagers[0].getAllocatedBytes() +
+         _memoryManagers[1].getAllocatedBytes();
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactor - Helpers]
+// ============================================================================
+
+CodeCompactor::Entry** CodeCompactor::_findEntry(void* stub) ASMJIT_NOTHROW
+{
+  Entry** pEntry = &_buckets[_GetBucket(stub, _bucketCount)];
+
+  while (*pEntry != NULL && (*pEntry)->stub != stub)
+    pEntry = &(*pEntry)->hashNext;
+
+  return pEntry;
+}
+
+bool CodeCompactor::_growBuckets() ASMJIT_NOTHROW
+{
+  size_t bucketCount = _bucketCount ? _bucketCount * 2 : 64;
+  Entry** buckets = reinterpret_cast<Entry**>(ASMJIT_MALLOC(bucketCount * sizeof(Entry*)));
+  if (buckets == NULL) return false;
+
+  memset(buckets, 0, bucketCount * sizeof(Entry*));
+
+  // Rehash all entries.
+  size_t i;
+  for (i = 0; i < _bucketCount; i++)
+  {
+    Entry* entry = _buckets[i];
+    while (entry)
+    {
+      Entry* next = entry->hashNext;
+      Entry** pBucket = &buckets[_GetBucket(entry->stub, bucketCount)];
+
+      entry->hashNext = *pBucket;
+      *pBucket = entry;
+      entry = next;
+    }
+  }
+
+  if (_buckets) ASMJIT_FREE(_buckets);
+
+  _buckets = buckets;
+  _bucketCount = bucketCount;
+  return true;
+}
+
+// Allocate memory from @a memmgr and relocate code of @a entry into it (the
+// same way as JitContext does). Returns NULL if there is no memory.
+void* CodeCompactor::_relocEntry(VirtualMemoryManager* memmgr, const Entry* entry, Logger* logger, size_t* size) ASMJIT_NOTHROW
+{
+  size_t codeSize = entry->dataSize + entry->trampolineSize;
+  size_t alignment = entry->alignment;
+
+  void* hint = entry->hint;
+  void* p = (hint != NULL)
+    ? memmgr->allocNear(codeSize, hint, kMemAllocFreeable, alignment)
+    : memmgr->alloc(codeSize, kMemAllocFreeable, alignment);
+  if (p == NULL) return NULL;
+
+  void* rw = memmgr->getWritableAddress(p);
+  size_t relocatedSize = entry->reloc(rw, (sysuint_t)p, memmgr,
+    entry->getData(), entry->dataSize, entry->getRelocData(), entry->relocCount, logger);
+
+  if (relocatedSize < codeSize)
+    memmgr->shrink(p, relocatedSize);
+
+  *size = relocatedSize;
+  return p;
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactorContext - Construction / Destruction]
+// ============================================================================
+
+CodeCompactorContext::CodeCompactorContext(CodeCompactor* compactor) :
+  _compactor(compactor)
+{
+}
+
+CodeCompactorContext::~CodeCompactorContext()
+{
+}
+
+// ============================================================================
+// [AsmJit::CodeCompactorContext - Interface]
+// ============================================================================
+
+uint32_t CodeCompactorContext::generate(void** dest, Assembler* assembler)
+{
+  return _compactor->generate(dest, assembler);
+}
+
+} // AsmJit namespace
+
+// [Api-End]
+#include "../Core/ApiEnd.h"
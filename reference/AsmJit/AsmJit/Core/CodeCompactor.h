@@ -0,0 +1,284 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// [Guard]
+#ifndef _ASMJIT_CORE_CODECOMPACTOR_H
+#define _ASMJIT_CORE_CODECOMPACTOR_H
+
+// [Dependencies - AsmJit]
+#include "../Core/Assembler.h"
+#include "../Core/Build.h"
+#include "../Core/Context.h"
+#include "../Core/Defs.h"
+#include "../Core/Lock.h"
+#include "../Core/MemoryManager.h"
+
+// [Api-Begin]
+#include "../Core/ApiBegin.h"
+
+namespace AsmJit {
+
+//! @addtogroup AsmJit_MemoryManagement
+//! @{
+
+// ============================================================================
+// [AsmJit::CodeCompactor]
+// ============================================================================
+
+//! @brief Store of movable functions, which can be compacted to reclaim
+//! memory of fragmented chunks.
+//!
+//! Function generated through @c CodeCompactorContext is relocated by its
+//! assembler into memory of the compactor and the caller gets address of a
+//! small entry stub, which jumps to the function. When the memory becomes
+//! fragmented (many chunks are used only partially), @c compact() relocates
+//! all functions again next to each other (using @c Assembler::relocCode())
+//! and redirects their stubs. The old copies are retired (see
+//! @c MemoryManager::retire()), so they are freed after all threads
+//! registered by @c registerThread() called @c quiescent().
+//!
+//! The entry stub address never changes, so it's the address to call and to
+//! embed into other code. The code and relocation data of each function are
+//! copied from its assembler (so it takes the same memory on the heap as
+//! the function), the assembler can be reused or destroyed after @c make():
+//!
+//! @code
+//! CodeCompactor compactor;
+//! CodeCompactorContext context(&compactor);
+//!
+//! X86Compiler c(&context);
+//! // ... generate function ...
+//! void* fn = c.make();
+//!
+//! // Later, for example when getUsedBytes() is much less than
+//! // getAllocatedBytes().
+//! compactor.compact();
+//!
+//! // Function is not needed anymore.
+//! compactor.remove(fn);
+//! @endcode
+struct CodeCompactor
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a @c CodeCompactor instance.
+  ASMJIT_API CodeCompactor() ASMJIT_NOTHROW;
+  //! @brief Destroy the @c CodeCompactor instance, all functions are freed.
+  ASMJIT_API ~CodeCompactor() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get the memory manager where functions are allocated now.
+  inline VirtualMemoryManager* getMemoryManager() ASMJIT_NOTHROW
+  { return &_memoryManagers[_active]; }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! @brief Generate code of @a assembler and store address of its entry
+  //! stub into @a dest. This method is used by @c CodeCompactorContext.
+  //!
+  //! @return Error value, see @c kError.
+  ASMJIT_API uint32_t generate(void** dest, Assembler* assembler) ASMJIT_NOTHROW;
+
+  //! @brief Get the current address of code of function @a func (address of
+  //! its entry stub), NULL if there is no such function.
+  //!
+  //! The address is valid only until the next @c compact().
+  ASMJIT_API void* getCode(void* func) ASMJIT_NOTHROW;
+
+  //! @brief Remove function @a func, returns @c false if there is no such
+  //! function.
+  ASMJIT_API bool remove(void* func) ASMJIT_NOTHROW;
+
+  //! @brief Relocate all functions next to each other into new chunks of
+  //! virtual memory.
+  //!
+  //! All functions are relocated first, so if there is not enough memory
+  //! nothing is changed. Then entry stubs are redirected and the old code is
+  //! retired.
+  //!
+  //! @return Error value, see @c kError.
+  ASMJIT_API uint32_t compact() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Deferred Free]
+  // --------------------------------------------------------------------------
+
+  //! @brief Register the calling thread as thread that can execute the
+  //! functions (see @c MemoryManager::registerThread()).
+  ASMJIT_API bool registerThread() ASMJIT_NOTHROW;
+  //! @brief Unregister the calling thread.
+  ASMJIT_API void unregisterThread() ASMJIT_NOTHROW;
+  //! @brief Announce that the calling thread doesn't execute any code moved
+  //! or removed so far.
+  ASMJIT_API void quiescent() ASMJIT_NOTHROW;
+  //! @brief Free code which can't be executed anymore, returns count of
+  //! bytes freed.
+  ASMJIT_API size_t reclaim() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Statistics]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get count of functions stored.
+  inline size_t getCount() const ASMJIT_NOTHROW
+  { return _count; }
+
+  //! @brief Get count of bytes used by functions stored.
+  inline size_t getUsedBytes() const ASMJIT_NOTHROW
+  { return _usedBytes; }
+
+  //! @brief Get count of bytes allocated for functions (including retired
+  //! code, not including entry stubs).
+  ASMJIT_API size_t getAllocatedBytes() ASMJIT_NOTHROW;
+
+  //! @brief Get how many times functions were moved by @c compact().
+  inline size_t getMoves() const ASMJIT_NOTHROW
+  { return _moves; }
+
+  // --------------------------------------------------------------------------
+  // [Entry]
+  // --------------------------------------------------------------------------
+
+  //! @internal
+  //!
+  //! @brief Function stored in the compactor.
+  //!
+  //! Relocation data and code copied from the assembler follow the entry.
+  struct Entry
+  {
+    //! @brief Get relocation data.
+    inline const Assembler::RelocData* getRelocData() const ASMJIT_NOTHROW
+    { return reinterpret_cast<const Assembler::RelocData*>(this + 1); }
+
+    //! @brief Get code before relocation.
+    inline const uint8_t* getData() const ASMJIT_NOTHROW
+    { return reinterpret_cast<const uint8_t*>(getRelocData() + relocCount); }
+
+    //! @brief Entry stub (address of the function for the caller).
+    void* stub;
+    //! @brief Code.
+    void* code;
+    //! @brief Size of the code.
+    size_t size;
+
+    //! @brief Size of the code before relocation (without trampolines).
+    size_t dataSize;
+    //! @brief Count of relocation data.
+    size_t relocCount;
+    //! @brief Size of possible trampolines.
+    size_t trampolineSize;
+    //! @brief Alignment of the code.
+    size_t alignment;
+    //! @brief Address which should be near to the code (see
+    //! @c Assembler::getPlacementHint()).
+    void* hint;
+    //! @brief Function relocating the code (see
+    //! @c Assembler::getRelocFunc()).
+    Assembler::RelocFunc reloc;
+
+    //! @brief Code relocated by @c compact(), but not used yet.
+    void* moved;
+    //! @brief Size of the relocated code.
+    size_t movedSize;
+    //! @brief Next entry in the same hash bucket.
+    Entry* hashNext;
+  };
+
+  // --------------------------------------------------------------------------
+  // [Helpers]
+  // --------------------------------------------------------------------------
+
+  //! @internal
+  ASMJIT_API Entry** _findEntry(void* stub) ASMJIT_NOTHROW;
+  //! @internal
+  ASMJIT_API bool _growBuckets() ASMJIT_NOTHROW;
+  //! @internal
+  ASMJIT_API void* _relocEntry(VirtualMemoryManager* memmgr, const Entry* entry, Logger* logger, size_t* size) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Lock for thread safety.
+  Lock _lock;
+  //! @brief Memory managers of code, functions are moved from one to other.
+  VirtualMemoryManager _memoryManagers[2];
+  //! @brief Index of memory manager where functions are allocated now.
+  size_t _active;
+  //! @brief Memory manager of entry stubs.
+  VirtualMemoryManager _stubManager;
+
+  //! @brief Hash buckets (indexed by entry stub).
+  Entry** _buckets;
+  //! @brief Count of hash buckets (power of 2).
+  size_t _bucketCount;
+
+  //! @brief Count of entries.
+  size_t _count;
+  //! @brief Count of bytes used by entries.
+  size_t _usedBytes;
+  //! @brief Count of moved functions.
+  size_t _moves;
+
+  ASMJIT_NO_COPY(CodeCompactor)
+};
+
+// ============================================================================
+// [AsmJit::CodeCompactorContext]
+// ============================================================================
+
+//! @brief Context which stores generated code into @c CodeCompactor.
+struct CodeCompactorContext : public Context
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a @c CodeCompactorContext instance.
+  ASMJIT_API CodeCompactorContext(CodeCompactor* compactor);
+  //! @brief Destroy the @c CodeCompactorContext instance.
+  ASMJIT_API virtual ~CodeCompactorContext();
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get the code compactor.
+  inline CodeCompactor* getCodeCompactor() const
+  { return _compactor; }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API virtual uint32_t generate(void** dest, Assembler* assembler);
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Code compactor.
+  CodeCompactor* _compactor;
+
+  ASMJIT_NO_COPY(CodeCompactorContext)
+};
+
+//! @}
+
+} // AsmJit namespace
+
+// [Api-End]
+#include "../Core/ApiEnd.h"
+
+// [Guard]
+#endif // _ASMJIT_CORE_CODECOMPACTOR_H
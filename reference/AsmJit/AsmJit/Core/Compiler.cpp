@@ -32,12 +32,15 @@ Compiler::Compiler(Context* context) ASMJIT_NOTHROW :
   _logger(NULL),
   _error(0),
   _properties(0),
+  _codeAlignment(0),
   _emitOptions(0),
   _finished(false),
   _first(NULL),
   _last(NULL),
   _current(NULL),
   _func(NULL),
+  _targets(&_zoneMemory),
+  _vars(&_zoneMemory),
   _cc(NULL),
   _varNameId(0)
 {
@@ -113,9 +116,6 @@ void Compiler::reset() ASMJIT_NOTHROW
   _zoneMemory.reset();
   _linkMemory.reset();
 
-  _targets.reset();
-  _vars.reset();
-
   if (_error != kErrorOk)
     setError(kErrorOk);
 }
@@ -133,8 +133,8 @@ void Compiler::_purge() ASMJIT_NOTHROW
   _current = NULL;
   _func = NULL;
 
-  _targets.clear();
-  _vars.clear();
+  _targets.reset();
+  _vars.reset();
 
   _cc = NULL;
   _varNameId = 0;
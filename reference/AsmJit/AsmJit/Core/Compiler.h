@@ -13,7 +13,7 @@
 #include "../Core/Context.h"
 #include "../Core/Func.h"
 #include "../Core/Operand.h"
-#include "../Core/PodVector.h"
+#include "../Core/ZoneVector.h"
 
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
@@ -95,6 +95,23 @@ struct Compiler
   inline ZoneMemory& getLinkMemory() ASMJIT_NOTHROW
   { return _linkMemory; }
 
+  //! @brief Get pool of zone chunks used by the compiler.
+  inline ZonePool* getZonePool() const ASMJIT_NOTHROW
+  { return _zoneMemory.getPool(); }
+
+  //! @brief Set pool of zone chunks used by the compiler (and by its
+  //! compiler context).
+  //!
+  //! Compiler created for each function can use pool of the thread (see
+  //! @c ZonePool::getThreadPool()), so it doesn't allocate memory for its
+  //! items when the previous compilers used the same amount of memory. The
+  //! pool must exist until the compiler is destroyed.
+  inline void setZonePool(ZonePool* pool) ASMJIT_NOTHROW
+  {
+    _zoneMemory.setPool(pool);
+    _linkMemory.setPool(pool);
+  }
+
   // --------------------------------------------------------------------------
   // [Logging]
   // --------------------------------------------------------------------------
@@ -129,6 +146,15 @@ struct Compiler
   //! @brief Set compiler property.
   ASMJIT_API virtual void setProperty(uint32_t propertyId, uint32_t value);
 
+  //! @brief Get alignment of the code in memory.
+  inline uint32_t getCodeAlignment() const ASMJIT_NOTHROW
+  { return _codeAlignment; }
+
+  //! @brief Set alignment of the code in memory, see
+  //! @ref Assembler::setCodeAlignment().
+  inline void setCodeAlignment(uint32_t alignment) ASMJIT_NOTHROW
+  { _codeAlignment = alignment; }
+
   // --------------------------------------------------------------------------
   // [Clear / Reset]
   // --------------------------------------------------------------------------
@@ -219,6 +245,8 @@ struct Compiler
   uint32_t _error;
   //! @brief Properties.
   uint32_t _properties;
+  //! @brief Alignment of the code in memory.
+  uint32_t _codeAlignment;
   //! @brief Contains options for next emitted instruction, clear after each emit.
   uint32_t _emitOptions;
   //! @brief Whether compiler was finished the job (register allocator, etc...).
@@ -233,10 +261,10 @@ struct Compiler
   //! @brief Current function.
   CompilerFuncDecl* _func;
 
-  //! @brief Targets.
-  PodVector<CompilerTarget*> _targets;
-  //! @brief Variables.
-  PodVector<CompilerVar*> _vars;
+  //! @brief Targets (allocated by @c _zoneMemory).
+  ZoneVector<CompilerTarget*> _targets;
+  //! @brief Variables (allocated by @c _zoneMemory).
+  ZoneVector<CompilerVar*> _vars;
 
   //! @brief Compiler context instance, only available after prepare().
   CompilerContext* _cc;
@@ -30,6 +30,7 @@ CompilerContext::CompilerContext(Compiler* compiler) ASMJIT_NOTHROW :
   _currentOffset(0),
   _isUnreachable(0)
 {
+  _zoneMemory.setPool(compiler->getZonePool());
 }
 
 CompilerContext::~CompilerContext() ASMJIT_NOTHROW
@@ -10,8 +10,10 @@
 #include "../Core/Assembler.h"
 #include "../Core/Context.h"
 #include "../Core/Defs.h"
+#include "../Core/IntUtil.h"
 #include "../Core/MemoryManager.h"
 #include "../Core/MemoryMarker.h"
+#include "../Core/VirtualMemory.h"
 
 namespace AsmJit {
 
@@ -29,7 +31,8 @@ Context::~Context() {}
 JitContext::JitContext() :
   _memoryManager(NULL),
   _memoryMarker(NULL),
-  _allocType(kMemAllocFreeable)
+  _allocType(kMemAllocFreeable),
+  _numaPlacement(false)
 {
 }
 
@@ -37,6 +40,42 @@ JitContext::~JitContext()
 {
 }
 
+// ============================================================================
+// [AsmJit::JitContext - Helpers]
+// ============================================================================
+
+// Allocate @a size bytes for code, on NUMA node of the calling thread if
+// @a numaPlacement is true, otherwise near @a hint if it's not NULL.
+static void* _AllocCode(MemoryManager* memmgr, size_t size, const void* hint,
+  uint32_t type, size_t alignment, bool numaPlacement)
+{
+  if (numaPlacement)
+    return memmgr->allocOnNumaNode(size, VirtualMemory::getCurrentNumaNode(), type, alignment);
+
+  if (hint != NULL)
+    return memmgr->allocNear(size, hint, type, alignment);
+  else
+    return memmgr->alloc(size, type, alignment);
+}
+
+// Get whether code of @a size bytes at @a p can reach @a hint by 32-bit
+// displacement (always true in 32-bit mode).
+static bool _IsNear(const void* p, size_t size, const void* hint)
+{
+#if defined(ASMJIT_X64)
+  size_t a = (size_t)p;
+  size_t h = (size_t)hint;
+
+  size_t distance = (h > a) ? h - a : a + size - h;
+  return distance <= (size_t)0x7FFFFFFF;
+#else
+  ASMJIT_UNUSED(p);
+  ASMJIT_UNUSED(size);
+  ASMJIT_UNUSED(hint);
+  return true;
+#endif // ASMJIT_X64
+}
+
 // ============================================================================
 // [AsmJit::JitContext - Generate]
 // ============================================================================
@@ -57,18 +96,60 @@ uint32_t JitContext::generate(void** dest, Assembler* assembler)
   if (memmgr == NULL)
     memmgr = MemoryManager::getGlobal();
 
-  void* p = memmgr->alloc(codeSize, getAllocType());
-  if (p == NULL)
+  size_t alignment = assembler->getCodeAlignment();
+  void* p = NULL;
+
+  // Code emitted directly to memory of the memory manager is relocated in
+  // place (the buffer must have space for trampolines). Placement of the
+  // code is not changed, so it's not used with NUMA placement, if the buffer
+  // is not aligned and if it's not near the called functions (the code is
+  // copied near them, so it doesn't need trampolines).
+  Buffer& buffer = assembler->_buffer;
+  void* hint = assembler->getPlacementHint();
+  bool direct = buffer.getMemoryManager() == memmgr &&
+                getAllocType() == kMemAllocFreeable &&
+                !_numaPlacement;
+
+  if (direct)
   {
-    *dest = NULL;
-    return kErrorNoVirtualMemory;
+    if (!buffer.realloc(codeSize))
+    {
+      *dest = NULL;
+      return kErrorNoVirtualMemory;
+    }
+
+    p = buffer.getAddress();
+    if (alignment != 0 && ((sysuint_t)p & (alignment - 1)) != 0)
+      direct = false;
+    if (hint != NULL && !_IsNear(p, codeSize, hint))
+      direct = false;
   }
 
-  // Relocate the code.
-  size_t relocatedSize = assembler->relocCode(p);
+  if (!direct)
+  {
+    // Place the code near the called functions if possible, so it can call
+    // them directly.
+    p = _AllocCode(memmgr, codeSize, hint, getAllocType(), alignment, _numaPlacement);
+    if (p == NULL)
+    {
+      *dest = NULL;
+      return kErrorNoVirtualMemory;
+    }
+  }
+
+  // Relocate the code, it's written to the writable view of memory if the
+  // memory manager maps it twice. Trampolines are shared with other code
+  // placed near by the memory manager.
+  void* rw = memmgr->getWritableAddress(p);
+  size_t relocatedSize = assembler->relocCode(rw, (sysuint_t)p, memmgr);
 
-  // Return unused memory to MemoryManager.
-  if (relocatedSize < codeSize)
+  // Take the memory from the assembler.
+  if (direct)
+    buffer.takeAddress();
+
+  // Return unused memory to MemoryManager (buffer is usually larger than the
+  // code).
+  if (direct || relocatedSize < codeSize)
     memmgr->shrink(p, relocatedSize);
 
   // Mark memory if MemoryMarker provided.
@@ -80,6 +161,302 @@ uint32_t JitContext::generate(void** dest, Assembler* assembler)
   return kErrorOk;
 }
 
+// ============================================================================
+// [AsmJit::JitContext - Generate Batch]
+// ============================================================================
+
+// Assembler of the batch and its index, entries are sorted by assembler
+// address, so relocation targets are found by binary search.
+struct BatchEntry
+{
+  const void* address;
+  size_t index;
+};
+
+static int ASMJIT_CDECL _CompareBatchEntries(const void* a, const void* b)
+{
+  const void* x = reinterpret_cast<const BatchEntry*>(a)->address;
+  const void* y = reinterpret_cast<const BatchEntry*>(b)->address;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Fill @a entries by @a count @a assemblers sorted by their addresses.
+static void _SortAssemblers(BatchEntry* entries, Assembler** assemblers, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    entries[i].address = assemblers[i];
+    entries[i].index = i;
+  }
+  qsort(entries, count, sizeof(BatchEntry), _CompareBatchEntries);
+}
+
+// Get index of assembler at @a address in sorted @a entries or @a count if
+// there is no such assembler.
+static size_t _FindAssembler(const BatchEntry* entries, size_t count, const void* address)
+{
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].address < address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < count && entries[lo].address == address)
+    return entries[lo].index;
+  return count;
+}
+
+// Get index of function at @a offset in @a offsets (increasing) or @a count
+// if there is no such function.
+static size_t _FindFunction(void** offsets, size_t count, sysuint_t offset)
+{
+  size_t lo = 0;
+  size_t hi = count;
+
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((sysuint_t)offsets[mid] < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo < count && (sysuint_t)offsets[lo] == offset)
+    return lo;
+  return count;
+}
+
+// Get size of code of @a assembler placed in the batch. Space for trampolines
+// to functions of the batch is not needed, they are always near.
+static size_t _GetBatchCodeSize(Assembler* assembler, const BatchEntry* entries, size_t count)
+{
+  size_t trampolineSize = assembler->getTrampolineSize();
+  if (trampolineSize == 0)
+    return assembler->getCodeSize();
+
+  // There is one trampoline for each target.
+  size_t targets = 0;
+  size_t near = 0;
+
+  size_t i;
+  size_t len = assembler->_relocData.getLength();
+
+  for (i = 0; i < len; i++)
+  {
+    // Only the first relocation to each target is counted.
+    const Assembler::RelocData& r = assembler->_relocData[i];
+    if (r.type != kRelocTrampoline || r.prevRelocId != kInvalidValue) continue;
+
+    targets++;
+    if (_FindAssembler(entries, count, r.address) < count) near++;
+  }
+
+  if (targets != 0)
+    trampolineSize -= trampolineSize / targets * near;
+  return assembler->getOffset() + trampolineSize;
+}
+
+// Replace targets of all relocations of @a assembler which are assemblers of
+// the batch by addresses of their functions (@a base + offset stored in
+// @a dest). If @a restore is true, the functions are replaced back.
+static void _RelocBatchTargets(Assembler* assembler, Assembler** assemblers, const BatchEntry* entries,
+  void** dest, size_t count, sysuint_t base, size_t size, bool restore)
+{
+  size_t i;
+  size_t len = assembler->_relocData.getLength();
+
+  for (i = 0; i < len; i++)
+  {
+    Assembler::RelocData& r = assembler->_relocData[i];
+    if (r.type == kRelocRelToAbs) continue;
+
+    size_t j;
+    if (!restore)
+    {
+      j = _FindAssembler(entries, count, r.address);
+      if (j < count) r.address = (void*)(base + (sysuint_t)dest[j]);
+    }
+    else if ((sysuint_t)r.address - base < (sysuint_t)size)
+    {
+      j = _FindFunction(dest, count, (sysuint_t)r.address - base);
+      if (j < count) r.address = (void*)assemblers[j];
+    }
+  }
+}
+
+uint32_t JitContext::generateBatch(void** dest, Assembler** assemblers, size_t count)
+{
+  size_t i;
+  size_t j;
+
+  for (i = 0; i < count; i++)
+    dest[i] = NULL;
+
+  if (count == 0)
+    return kErrorNoFunction;
+
+  // Relocation targets are looked up in assemblers sorted by address.
+  BatchEntry* entries = reinterpret_cast<BatchEntry*>(ASMJIT_MALLOC(count * sizeof(BatchEntry)));
+  if (entries == NULL)
+    return kErrorNoHeapMemory;
+  _SortAssemblers(entries, assemblers, count);
+
+  // Compute offsets of functions (stored in dest until relocated), each one
+  // is aligned at least to 16 bytes.
+  size_t offset = 0;
+  size_t alignment = 16;
+  void* hint = NULL;
+
+  for (i = 0; i < count; i++)
+  {
+    Assembler* assembler = assemblers[i];
+    size_t codeSize = _GetBatchCodeSize(assembler, entries, count);
+
+    // Disallow empty code generation.
+    uint32_t error = assembler->getError();
+    if (error == kErrorOk && codeSize == 0)
+      error = kErrorNoFunction;
+
+    if (error != kErrorOk)
+    {
+      for (j = 0; j < i; j++) dest[j] = NULL;
+      ASMJIT_FREE(entries);
+      return error;
+    }
+
+    size_t a = assembler->getCodeAlignment();
+    if (a < 16) a = 16;
+    if (alignment < a) alignment = a;
+
+    offset = IntUtil::roundUp<size_t>(offset, a);
+    dest[i] = (void*)offset;
+    offset += codeSize;
+
+    // Place the batch near the first function called (outside of the batch).
+    if (hint == NULL)
+    {
+      size_t len = assembler->_relocData.getLength();
+      for (j = 0; j < len; j++)
+      {
+        const Assembler::RelocData& r = assembler->_relocData[j];
+        if (r.type == kRelocTrampoline && _FindAssembler(entries, count, r.address) == count)
+        {
+          hint = r.address;
+          break;
+        }
+      }
+    }
+  }
+
+  // Switch to global memory manager if not provided.
+  MemoryManager* memmgr = getMemoryManager();
+
+  if (memmgr == NULL)
+    memmgr = MemoryManager::getGlobal();
+
+  size_t size = offset;
+  uint8_t* p = (uint8_t*)_AllocCode(memmgr, size, hint, getAllocType(), alignment, _numaPlacement);
+
+  if (p == NULL)
+  {
+    for (i = 0; i < count; i++) dest[i] = NULL;
+    ASMJIT_FREE(entries);
+    return kErrorNoVirtualMemory;
+  }
+
+  // Relocate all functions, calls to the functions of the batch are
+  // relocated as calls to their final addresses.
+  uint8_t* rw = (uint8_t*)memmgr->getWritableAddress(p);
+  size_t relocatedSize = 0;
+
+  for (i = 0; i < count; i++)
+  {
+    Assembler* assembler = assemblers[i];
+    size_t functionOffset = (size_t)dest[i];
+
+    _RelocBatchTargets(assembler, assemblers, entries, dest, count, (sysuint_t)p, size, false);
+    relocatedSize = assembler->relocCode(rw + functionOffset, (sysuint_t)(p + functionOffset), memmgr);
+    _RelocBatchTargets(assembler, assemblers, entries, dest, count, (sysuint_t)p, size, true);
+
+    // Mark memory if MemoryMarker provided.
+    if (_memoryMarker)
+      _memoryMarker->mark(p + functionOffset, relocatedSize);
+  }
+
+  ASMJIT_FREE(entries);
+
+  // Return unused memory after the last function to MemoryManager.
+  relocatedSize += (size_t)dest[count - 1];
+  if (relocatedSize < size)
+    memmgr->shrink(p, relocatedSize);
+
+  // Return the functions.
+  for (i = 0; i < count; i++)
+    dest[i] = p + (size_t)dest[i];
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [AsmJit::JitContext - Generate Replicas]
+// ============================================================================
+
+uint32_t JitContext::generateReplicas(void** dest, Assembler* assembler)
+{
+  uint32_t count = VirtualMemory::getNumaNodeCount();
+  uint32_t i;
+
+  for (i = 0; i < count; i++)
+    dest[i] = NULL;
+
+  // Disallow empty code generation.
+  size_t codeSize = assembler->getCodeSize();
+  if (codeSize == 0)
+    return kErrorNoFunction;
+
+  // Switch to global memory manager if not provided.
+  MemoryManager* memmgr = getMemoryManager();
+
+  if (memmgr == NULL)
+    memmgr = MemoryManager::getGlobal();
+
+  size_t alignment = assembler->getCodeAlignment();
+
+  for (i = 0; i < count; i++)
+  {
+    void* p = memmgr->allocOnNumaNode(codeSize, i, getAllocType(), alignment);
+    if (p == NULL)
+    {
+      while (i > 0)
+      {
+        memmgr->free(dest[--i]);
+        dest[i] = NULL;
+      }
+      return kErrorNoVirtualMemory;
+    }
+
+    void* rw = memmgr->getWritableAddress(p);
+    size_t relocatedSize = assembler->relocCode(rw, (sysuint_t)p, memmgr);
+
+    if (relocatedSize < codeSize)
+      memmgr->shrink(p, relocatedSize);
+
+    if (_memoryMarker)
+      _memoryMarker->mark(p, relocatedSize);
+
+    dest[i] = p;
+  }
+
+  return kErrorOk;
+}
+
 // ============================================================================
 // [AsmJit::JitContext - GetGlobal]
 // ============================================================================
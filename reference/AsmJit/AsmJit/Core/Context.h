@@ -54,7 +54,7 @@ struct Context
   //! it to allocate memory for JIT code, saving code to remote process or a 
   //! shared library.
   //!
-  //! @retrurn Error value, see @c kError.
+  //! @return Error value, see @c kError.
   virtual uint32_t generate(void** dest, Assembler* assembler) = 0;
 
   ASMJIT_NO_COPY(Context)
@@ -100,6 +100,20 @@ struct JitContext : public Context
   inline void setAllocType(uint32_t allocType)
   { _allocType = allocType; }
 
+  //! @brief Get whether to place code on NUMA node of the calling thread.
+  inline bool getNumaPlacement() const
+  { return _numaPlacement; }
+
+  //! @brief Set whether to place code on NUMA node of the calling thread.
+  //!
+  //! If enabled, the code is allocated by
+  //! @c MemoryManager::allocOnNumaNode() on the node where the thread which
+  //! generates it runs (so the thread generating code for a worker thread
+  //! should run on the same node). It's not placed near the called functions
+  //! then, it can need trampolines.
+  inline void setNumaPlacement(bool numaPlacement)
+  { _numaPlacement = numaPlacement; }
+
   // --------------------------------------------------------------------------
   // [Memory Marker]
   // --------------------------------------------------------------------------
@@ -118,6 +132,36 @@ struct JitContext : public Context
 
   ASMJIT_API virtual uint32_t generate(void** dest, Assembler* assembler);
 
+  //! @brief Allocate one block of memory for code generated in @a count
+  //! @a assemblers and reloc each of them into it.
+  //!
+  //! This is faster than calling @c Assembler::make() for each function,
+  //! memory is allocated only once and the functions are placed next to
+  //! each other. Code of function in the batch can call other function of
+  //! the same batch by using address of its assembler as the target (for
+  //! example <code>a.call(imm((sysint_t)(void*)&b))</code>), these calls are
+  //! relocated to direct calls (without trampolines).
+  //!
+  //! Entry points are stored into @a dest. The whole batch is one block of
+  //! memory, it's freed by freeing the first function (the other functions
+  //! can't be freed separately).
+  //!
+  //! @return Error value, see @c kError.
+  ASMJIT_API uint32_t generateBatch(void** dest, Assembler** assemblers, size_t count);
+
+  //! @brief Reloc code generated in @a assembler into memory of each NUMA
+  //! node.
+  //!
+  //! Code which is called often by threads running on all nodes can be
+  //! replicated, so each thread calls the replica placed on its own node
+  //! (<code>dest[VirtualMemory::getCurrentNumaNode()]</code>). The @a dest
+  //! must have room for @c VirtualMemory::getNumaNodeCount() entries, each
+  //! replica is freed separately. Node ids can have gaps, replicas of the
+  //! missing nodes are placed on any node.
+  //!
+  //! @return Error value, see @c kError.
+  ASMJIT_API uint32_t generateReplicas(void** dest, Assembler* assembler);
+
   // --------------------------------------------------------------------------
   // [Statics]
   // --------------------------------------------------------------------------
@@ -135,6 +179,8 @@ struct JitContext : public Context
 
   //! @brief Type of allocation.
   uint32_t _allocType;
+  //! @brief Whether to place code on NUMA node of the calling thread.
+  bool _numaPlacement;
 
   ASMJIT_NO_COPY(JitContext)
 };
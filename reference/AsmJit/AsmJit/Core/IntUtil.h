@@ -11,6 +11,11 @@
 // [Dependencies - AsmJit]
 #include "../Core/Assert.h"
 
+// [Dependencies - MSVC]
+#if defined(_MSC_VER) && (_MSC_VER >= 1400)
+# include <intrin.h>
+#endif // _MSC_VER
+
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
 
@@ -117,24 +122,35 @@ namespace IntUtil
   // [Bits]
   // --------------------------------------------------------------------------
 
-  // From http://graphics.stanford.edu/~seander/bithacks.html .
   static inline uint32_t bitCount(uint32_t x)
   {
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_popcount(x);
+#else
+    // From http://graphics.stanford.edu/~seander/bithacks.html .
     x = x - ((x >> 1) & 0x55555555U);
     x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
     return (((x + (x >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24;
+#endif // __GNUC__
   }
 
   static inline uint32_t findFirstBit(uint32_t mask) ASMJIT_NOTHROW
   {
-    for (uint32_t i = 0; i < sizeof(uint32_t) * 8; i++, mask >>= 1)
-    {
-      if (mask & 0x1)
-        return i;
-    }
-
     // kInvalidValue.
-    return 0xFFFFFFFF;
+    if (mask == 0)
+      return 0xFFFFFFFF;
+
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_ctz(mask);
+#elif defined(_MSC_VER) && (_MSC_VER >= 1400)
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (uint32_t)i;
+#else
+    uint32_t i = 0;
+    for (; (mask & 0x1) == 0; i++, mask >>= 1) {}
+    return i;
+#endif
   }
 
   // --------------------------------------------------------------------------
@@ -126,6 +126,245 @@ struct AutoLock
   ASMJIT_NO_COPY(AutoLock)
 };
 
+// ============================================================================
+// [AsmJit::Event]
+// ============================================================================
+
+//! @brief Auto-reset event - used to wake a waiting thread.
+//!
+//! @c signal() wakes a thread waiting in @c wait(). If no thread waits, the
+//! event stays signaled and the next @c wait() returns immediately.
+struct Event
+{
+  // --------------------------------------------------------------------------
+  // [Windows]
+  // --------------------------------------------------------------------------
+
+#if defined(ASMJIT_WINDOWS)
+  typedef HANDLE Handle;
+
+  //! @brief Create a new @ref Event instance.
+  inline Event() ASMJIT_NOTHROW { _handle = CreateEvent(NULL, FALSE, FALSE, NULL); }
+  //! @brief Destroy the @ref Event instance.
+  inline ~Event() ASMJIT_NOTHROW { CloseHandle(_handle); }
+
+  //! @brief Wait until the event is signaled and reset it.
+  inline void wait() ASMJIT_NOTHROW { WaitForSingleObject(_handle, INFINITE); }
+  //! @brief Signal the event.
+  inline void signal() ASMJIT_NOTHROW { SetEvent(_handle); }
+#endif // ASMJIT_WINDOWS
+
+  // --------------------------------------------------------------------------
+  // [Posix]
+  // --------------------------------------------------------------------------
+
+#if defined(ASMJIT_POSIX)
+  struct Handle
+  {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool signaled;
+  };
+
+  //! @brief Create a new @ref Event instance.
+  inline Event() ASMJIT_NOTHROW
+  {
+    pthread_mutex_init(&_handle.mutex, NULL);
+    pthread_cond_init(&_handle.cond, NULL);
+    _handle.signaled = false;
+  }
+
+  //! @brief Destroy the @ref Event instance.
+  inline ~Event() ASMJIT_NOTHROW
+  {
+    pthread_cond_destroy(&_handle.cond);
+    pthread_mutex_destroy(&_handle.mutex);
+  }
+
+  //! @brief Wait until the event is signaled and reset it.
+  inline void wait() ASMJIT_NOTHROW
+  {
+    pthread_mutex_lock(&_handle.mutex);
+    while (!_handle.signaled)
+      pthread_cond_wait(&_handle.cond, &_handle.mutex);
+    _handle.signaled = false;
+    pthread_mutex_unlock(&_handle.mutex);
+  }
+
+  //! @brief Signal the event.
+  inline void signal() ASMJIT_NOTHROW
+  {
+    pthread_mutex_lock(&_handle.mutex);
+    _handle.signaled = true;
+    pthread_cond_signal(&_handle.cond);
+    pthread_mutex_unlock(&_handle.mutex);
+  }
+#endif // ASMJIT_POSIX
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get handle.
+  inline Handle& getHandle() ASMJIT_NOTHROW { return _handle; }
+  //! @overload
+  inline const Handle& getHandle() const ASMJIT_NOTHROW { return _handle; }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Handle.
+  Handle _handle;
+
+  // Disable copy.
+  ASMJIT_NO_COPY(Event)
+};
+
+// ============================================================================
+// [AsmJit::ThreadLocal]
+// ============================================================================
+
+//! @brief Calling convention of @ref ThreadLocal::Destructor.
+#if defined(ASMJIT_WINDOWS)
+# define ASMJIT_THREAD_LOCAL_CALL ASMJIT_STDCALL
+#else
+# define ASMJIT_THREAD_LOCAL_CALL
+#endif // ASMJIT_WINDOWS
+
+//! @brief Thread local pointer.
+//!
+//! Each thread sees its own value, which is initially @c NULL. The key is
+//! a limited resource of the system, so it's allocated only by @c create()
+//! (or by the constructor taking a destructor) and the allocation can fail
+//! (see @c isValid()). Without the key @c get() returns @c NULL and @c set()
+//! fails.
+//!
+//! The destructor is called when a thread with non-NULL value exits (Windows
+//! before Vista doesn't support it, the value is not destroyed then).
+//! Windows also calls it for values of all threads when the key is freed by
+//! @c destroy(), so the owner has to call @c destroy() while the values are
+//! still valid (Posix doesn't destroy them, the owner frees them itself).
+struct ThreadLocal
+{
+  //! @brief Function called when a thread with non-NULL value exits.
+  typedef void (ASMJIT_THREAD_LOCAL_CALL *Destructor)(void* value);
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a new @ref ThreadLocal instance without the key.
+  inline ThreadLocal() ASMJIT_NOTHROW : _valid(false) {}
+
+  //! @brief Create a new @ref ThreadLocal instance and allocate its key.
+  inline ThreadLocal(Destructor destructor) ASMJIT_NOTHROW : _valid(false)
+  { create(destructor); }
+
+  //! @brief Destroy the @ref ThreadLocal instance.
+  inline ~ThreadLocal() ASMJIT_NOTHROW { destroy(); }
+
+  //! @brief Get whether the key is allocated.
+  inline bool isValid() const ASMJIT_NOTHROW { return _valid; }
+
+  // --------------------------------------------------------------------------
+  // [Windows]
+  // --------------------------------------------------------------------------
+
+#if defined(ASMJIT_WINDOWS)
+  typedef DWORD Handle;
+
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600
+  //! @brief Allocate the key (if not allocated yet), returns @c isValid().
+  inline bool create(Destructor destructor) ASMJIT_NOTHROW
+  {
+    if (!_valid)
+    {
+      _handle = FlsAlloc(destructor);
+      _valid = (_handle != FLS_OUT_OF_INDEXES);
+    }
+    return _valid;
+  }
+
+  //! @brief Free the key, destructor is called for values of all threads.
+  inline void destroy() ASMJIT_NOTHROW
+  { if (_valid) { _valid = false; FlsFree(_handle); } }
+
+  //! @brief Get value of the current thread.
+  inline void* get() const ASMJIT_NOTHROW
+  { return _valid ? FlsGetValue(_handle) : NULL; }
+  //! @brief Set value of the current thread, returns @c false on failure.
+  inline bool set(void* value) ASMJIT_NOTHROW
+  { return _valid && FlsSetValue(_handle, value) != 0; }
+#else
+  //! @brief Allocate the key (if not allocated yet), returns @c isValid().
+  //!
+  //! @note Destructor is not supported by Windows TLS and it's ignored.
+  inline bool create(Destructor destructor) ASMJIT_NOTHROW
+  {
+    ASMJIT_UNUSED(destructor);
+
+    if (!_valid)
+    {
+      _handle = TlsAlloc();
+      _valid = (_handle != TLS_OUT_OF_INDEXES);
+    }
+    return _valid;
+  }
+
+  //! @brief Free the key.
+  inline void destroy() ASMJIT_NOTHROW
+  { if (_valid) { _valid = false; TlsFree(_handle); } }
+
+  //! @brief Get value of the current thread.
+  inline void* get() const ASMJIT_NOTHROW
+  { return _valid ? TlsGetValue(_handle) : NULL; }
+  //! @brief Set value of the current thread, returns @c false on failure.
+  inline bool set(void* value) ASMJIT_NOTHROW
+  { return _valid && TlsSetValue(_handle, value) != 0; }
+#endif // _WIN32_WINNT
+#endif // ASMJIT_WINDOWS
+
+  // --------------------------------------------------------------------------
+  // [Posix]
+  // --------------------------------------------------------------------------
+
+#if defined(ASMJIT_POSIX)
+  typedef pthread_key_t Handle;
+
+  //! @brief Allocate the key (if not allocated yet), returns @c isValid().
+  inline bool create(Destructor destructor) ASMJIT_NOTHROW
+  {
+    if (!_valid)
+      _valid = (pthread_key_create(&_handle, destructor) == 0);
+    return _valid;
+  }
+
+  //! @brief Free the key, values of other threads are not destroyed.
+  inline void destroy() ASMJIT_NOTHROW
+  { if (_valid) { _valid = false; pthread_key_delete(_handle); } }
+
+  //! @brief Get value of the current thread.
+  inline void* get() const ASMJIT_NOTHROW
+  { return _valid ? pthread_getspecific(_handle) : NULL; }
+  //! @brief Set value of the current thread, returns @c false on failure.
+  inline bool set(void* value) ASMJIT_NOTHROW
+  { return _valid && pthread_setspecific(_handle, value) == 0; }
+#endif // ASMJIT_POSIX
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Handle.
+  Handle _handle;
+  //! @brief Whether the handle is allocated.
+  bool _valid;
+
+  // Disable copy.
+  ASMJIT_NO_COPY(ThreadLocal)
+};
+
 //! @}
 
 } // AsmJit namespace
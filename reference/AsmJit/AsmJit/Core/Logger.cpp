@@ -7,11 +7,17 @@
 #define _ASMJIT_BEING_COMPILED
 
 // [Dependencies - AsmJit]
+#include "../Core/IntUtil.h"
 #include "../Core/Logger.h"
 
 // [Dependencies - C]
 #include <stdarg.h>
 
+// [Dependencies - Posix]
+#if defined(ASMJIT_POSIX)
+# include <unistd.h>
+#endif // ASMJIT_POSIX
+
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
 
@@ -109,6 +115,445 @@ void FileLogger::setEnabled(bool enabled) ASMJIT_NOTHROW
   _used = (_enabled == true) & (_stream != NULL);
 }
 
+// ============================================================================
+// [AsmJit::AsyncLogger - Helpers]
+// ============================================================================
+
+// Ring buffer written by one logging thread and read by the logger thread.
+// Positions only increase, the index to data is position & (capacity - 1).
+struct AsyncLoggerBuffer
+{
+  AsyncLoggerBuffer* next;   // Next buffer of the logger.
+  AsyncLogger* logger;       // Logger the buffer belongs to.
+  volatile size_t head;      // Write position (changed by the logging thread).
+  volatile size_t tail;      // Read position (changed by the logger thread).
+  volatile size_t dropped;   // Count of dropped messages.
+  volatile bool released;    // Thread exited, the buffer is freed once written.
+  size_t capacity;           // Capacity of data (power of 2).
+  uint8_t data[sizeof(void*)];
+};
+
+// Full memory barrier.
+static inline void _MemoryBarrier() ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  LONG barrier;
+  InterlockedExchange(&barrier, 0);
+#else
+  __sync_synchronize();
+#endif // ASMJIT_WINDOWS
+}
+
+// Count of naps without messages before the logger thread sleeps until it's
+// woken. Waking the thread is slower than a nap, so the thread only sleeps
+// when nothing is logged for a while and not after each message.
+enum { kAsyncLoggerNaps = 10 };
+
+// Wait before the buffers are checked again when all were empty.
+static inline void _Nap() ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  Sleep(1);
+#else
+  usleep(1000);
+#endif // ASMJIT_WINDOWS
+}
+
+// Called when the thread which logged to @a buffer exits, the logger thread
+// frees the buffer once its messages are written.
+static void ASMJIT_THREAD_LOCAL_CALL _ReleaseBuffer(void* p)
+{
+  AsyncLoggerBuffer* buffer = reinterpret_cast<AsyncLoggerBuffer*>(p);
+
+  // The last message must be visible before the buffer is released.
+  _MemoryBarrier();
+  buffer->released = true;
+  buffer->logger->_wakeEvent.signal();
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI _AsyncLoggerThread(LPVOID logger)
+{
+  reinterpret_cast<AsyncLogger*>(logger)->_run();
+  return 0;
+}
+#endif // ASMJIT_WINDOWS
+
+#if defined(ASMJIT_POSIX)
+static void* _AsyncLoggerThread(void* logger)
+{
+  reinterpret_cast<AsyncLogger*>(logger)->_run();
+  return NULL;
+}
+#endif // ASMJIT_POSIX
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Construction / Destruction]
+// ============================================================================
+
+AsyncLogger::AsyncLogger(FILE* stream, size_t bufferSize) ASMJIT_NOTHROW :
+  _stream(NULL),
+  _bufferSize(IntUtil::roundUpToPowerOf2<size_t>(bufferSize < 256 ? 256 : bufferSize)),
+  _buffers(NULL),
+  _threadBuffer(_ReleaseBuffer),
+  _dropped(0),
+  _running(false),
+  _stop(false),
+  _sleeping(false)
+{
+  setStream(stream);
+
+#if defined(ASMJIT_WINDOWS)
+  _thread = CreateThread(NULL, 0, _AsyncLoggerThread, this, 0, NULL);
+  _running = (_thread != NULL);
+#endif // ASMJIT_WINDOWS
+
+#if defined(ASMJIT_POSIX)
+  _running = (pthread_create(&_thread, NULL, _AsyncLoggerThread, this) == 0);
+#endif // ASMJIT_POSIX
+}
+
+AsyncLogger::~AsyncLogger() ASMJIT_NOTHROW
+{
+  // Windows releases buffers of other threads when the key is freed, they
+  // must be still valid.
+  _threadBuffer.destroy();
+
+  if (_running)
+  {
+    _stop = true;
+    _wakeEvent.signal();
+
+#if defined(ASMJIT_WINDOWS)
+    WaitForSingleObject(_thread, INFINITE);
+    CloseHandle(_thread);
+#endif // ASMJIT_WINDOWS
+
+#if defined(ASMJIT_POSIX)
+    pthread_join(_thread, NULL);
+#endif // ASMJIT_POSIX
+  }
+
+  flush();
+
+  AsyncLoggerBuffer* buffer = _buffers;
+  while (buffer)
+  {
+    AsyncLoggerBuffer* next = buffer->next;
+    ASMJIT_FREE(buffer);
+    buffer = next;
+  }
+}
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Accessors]
+// ============================================================================
+
+void AsyncLogger::setStream(FILE* stream) ASMJIT_NOTHROW
+{
+  AutoLock locked(_drainLock);
+
+  if (_stream != NULL)
+  {
+    _drain();
+    fflush(_stream);
+  }
+
+  _stream = stream;
+  _used = (_enabled == true) & (_stream != NULL);
+}
+
+size_t AsyncLogger::getDroppedCount() const ASMJIT_NOTHROW
+{
+  // Buffers are not freed while the list is traversed.
+  AutoLock locked(const_cast<Lock&>(_drainLock));
+  size_t dropped = _dropped;
+
+  for (AsyncLoggerBuffer* buffer = _buffers; buffer != NULL; buffer = buffer->next)
+    dropped += buffer->dropped;
+
+  return dropped;
+}
+
+size_t AsyncLogger::getBufferCount() const ASMJIT_NOTHROW
+{
+  AutoLock locked(const_cast<Lock&>(_drainLock));
+  size_t count = 0;
+
+  for (AsyncLoggerBuffer* buffer = _buffers; buffer != NULL; buffer = buffer->next)
+    count++;
+
+  return count;
+}
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Flush]
+// ============================================================================
+
+void AsyncLogger::flush() ASMJIT_NOTHROW
+{
+  AutoLock locked(_drainLock);
+
+  _drain();
+  if (_stream != NULL) fflush(_stream);
+}
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Logging]
+// ============================================================================
+
+void AsyncLogger::logString(const char* buf, size_t len) ASMJIT_NOTHROW
+{
+  if (!_used)
+    return;
+
+  if (len == kInvalidSize)
+    len = strlen(buf);
+
+  // Thread local storage is not available, write the message directly.
+  if (!_threadBuffer.isValid())
+  {
+    AutoLock locked(_drainLock);
+    _drain();
+    if (_stream != NULL) fwrite(buf, 1, len, _stream);
+    return;
+  }
+
+  AsyncLoggerBuffer* buffer = _getBuffer();
+  if (buffer == NULL) return;
+
+  // Only this thread changes the head, the tail can only grow.
+  size_t head = buffer->head;
+  size_t tail = buffer->tail;
+  size_t capacity = buffer->capacity;
+
+  if (len > capacity - (head - tail))
+  {
+    buffer->dropped++;
+    return;
+  }
+
+  size_t index = head & (capacity - 1);
+  size_t first = capacity - index;
+
+  if (first >= len)
+  {
+    memcpy(buffer->data + index, buf, len);
+  }
+  else
+  {
+    memcpy(buffer->data + index, buf, first);
+    memcpy(buffer->data, buf + first, len - first);
+  }
+
+  // The message must be visible before the new head.
+  _MemoryBarrier();
+  buffer->head = head + len;
+
+  if (_running)
+  {
+    // Wake the thread if it sleeps, the head must be visible before it's
+    // checked (see _run()).
+    _MemoryBarrier();
+    if (_sleeping) _wakeEvent.signal();
+  }
+  else
+  {
+    // There is no thread to write the message.
+    AutoLock locked(_drainLock);
+    _drain();
+  }
+}
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Enabled]
+// ============================================================================
+
+void AsyncLogger::setEnabled(bool enabled) ASMJIT_NOTHROW
+{
+  _enabled = enabled;
+  _used = (_enabled == true) & (_stream != NULL);
+}
+
+// ============================================================================
+// [AsmJit::AsyncLogger - Private]
+// ============================================================================
+
+AsyncLoggerBuffer* AsyncLogger::_getBuffer() ASMJIT_NOTHROW
+{
+  AsyncLoggerBuffer* buffer = reinterpret_cast<AsyncLoggerBuffer*>(_threadBuffer.get());
+  if (buffer != NULL) return buffer;
+
+  AutoLock locked(_lock);
+
+  buffer = reinterpret_cast<AsyncLoggerBuffer*>(
+    ASMJIT_MALLOC(sizeof(AsyncLoggerBuffer) - sizeof(void*) + _bufferSize));
+
+  if (buffer == NULL)
+  {
+    _dropped++;
+    return NULL;
+  }
+
+  if (!_threadBuffer.set(buffer))
+  {
+    ASMJIT_FREE(buffer);
+    _dropped++;
+    return NULL;
+  }
+
+  buffer->next = _buffers;
+  buffer->logger = this;
+  buffer->head = 0;
+  buffer->tail = 0;
+  buffer->dropped = 0;
+  buffer->released = false;
+  buffer->capacity = _bufferSize;
+
+  // The buffer must be initialized before the logger thread can see it.
+  _MemoryBarrier();
+  _buffers = buffer;
+
+  return buffer;
+}
+
+size_t AsyncLogger::_drain() ASMJIT_NOTHROW
+{
+  size_t written = 0;
+  AsyncLoggerBuffer* buffer = _buffers;
+
+  while (buffer != NULL)
+  {
+    AsyncLoggerBuffer* next = buffer->next;
+
+    // The head of released buffer is read after the flag, so it's final.
+    bool released = buffer->released;
+    _MemoryBarrier();
+
+    size_t head = buffer->head;
+    size_t tail = buffer->tail;
+
+    if (head == tail)
+    {
+      if (released) _freeBuffer(buffer);
+      buffer = next;
+      continue;
+    }
+
+    // Read the message after the head.
+    _MemoryBarrier();
+
+    if (_stream != NULL)
+    {
+      size_t capacity = buffer->capacity;
+      size_t len = head - tail;
+      size_t index = tail & (capacity - 1);
+      size_t first = capacity - index;
+
+      if (first >= len)
+      {
+        fwrite(buffer->data + index, 1, len, _stream);
+      }
+      else
+      {
+        fwrite(buffer->data + index, 1, first, _stream);
+        fwrite(buffer->data, 1, len - first, _stream);
+      }
+    }
+
+    // The message must be read before the space is reused.
+    _MemoryBarrier();
+    buffer->tail = head;
+
+    written += head - tail;
+
+    if (released) _freeBuffer(buffer);
+    buffer = next;
+  }
+
+  return written;
+}
+
+void AsyncLogger::_freeBuffer(AsyncLoggerBuffer* buffer) ASMJIT_NOTHROW
+{
+  // Buffers can be prepended by other threads meanwhile.
+  AutoLock locked(_lock);
+
+  if (_buffers == buffer)
+  {
+    _buffers = buffer->next;
+  }
+  else
+  {
+    AsyncLoggerBuffer* prev = _buffers;
+    while (prev->next != buffer) prev = prev->next;
+    prev->next = buffer->next;
+  }
+
+  _dropped += buffer->dropped;
+  ASMJIT_FREE(buffer);
+}
+
+void AsyncLogger::_run() ASMJIT_NOTHROW
+{
+  bool unflushed = false;
+  uint32_t naps = 0;
+
+  while (!_stop)
+  {
+    size_t written;
+
+    {
+      AutoLock locked(_drainLock);
+      written = _drain();
+
+      // Flush the stream once all messages are written.
+      if (written == 0 && unflushed && _stream != NULL)
+        fflush(_stream);
+    }
+
+    if (written != 0)
+    {
+      unflushed = true;
+      naps = 0;
+      continue;
+    }
+
+    unflushed = false;
+
+    if (++naps < kAsyncLoggerNaps)
+    {
+      _Nap();
+      continue;
+    }
+    naps = 0;
+
+    // Sleep until a message is logged. Buffers are checked again after
+    // _sleeping is set, so a message logged meanwhile either is found here
+    // or the logging thread sees _sleeping and signals the event.
+    _sleeping = true;
+    _MemoryBarrier();
+
+    bool empty = true;
+    {
+      AutoLock locked(_drainLock);
+      for (AsyncLoggerBuffer* buffer = _buffers; buffer != NULL; buffer = buffer->next)
+      {
+        if (buffer->head != buffer->tail || buffer->released)
+        {
+          empty = false;
+          break;
+        }
+      }
+    }
+
+    if (empty && !_stop)
+      _wakeEvent.wait();
+
+    _sleeping = false;
+  }
+}
+
 // ============================================================================
 // [AsmJit::StringLogger - Construction / Destruction]
 // ============================================================================
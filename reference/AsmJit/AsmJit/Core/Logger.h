@@ -11,6 +11,7 @@
 // [Dependencies - AsmJit]
 #include "../Core/Build.h"
 #include "../Core/Defs.h"
+#include "../Core/Lock.h"
 #include "../Core/StringBuilder.h"
 
 // [Dependencies - C]
@@ -172,6 +173,159 @@ struct FileLogger : public Logger
   ASMJIT_NO_COPY(FileLogger)
 };
 
+// ============================================================================
+// [AsmJit::AsyncLogger]
+// ============================================================================
+
+//! @internal
+//!
+//! @brief Ring buffer of one thread logging to @c AsyncLogger.
+struct AsyncLoggerBuffer;
+
+//! @brief Logger that writes to standard C @c FILE* stream in a background
+//! thread.
+//!
+//! Each thread logging to @c AsyncLogger gets its own ring buffer where the
+//! messages are copied without locking, the background thread writes them
+//! to the stream. Message that doesn't fit to the buffer is dropped and
+//! counted (see @c getDroppedCount()), so the logging thread never waits for
+//! the stream.
+//!
+//! Messages of one thread are written in order, messages logged by more
+//! threads can be interleaved. The background thread sleeps while there are
+//! no messages and it's woken by the next one.
+//!
+//! Buffer of a thread is freed when the thread exits and all its messages
+//! are written. Threads must not exit while the logger is being destroyed.
+//!
+//! @note Windows older than Vista doesn't support thread local destructors,
+//! buffers are freed only when the logger is destroyed there.
+struct AsyncLogger : public Logger
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create a new @c AsyncLogger and start its thread.
+  //! @param stream FILE stream where logging will be sent (can be @c NULL
+  //! to disable logging).
+  //! @param bufferSize Size of buffer of each logging thread (rounded up to
+  //! power of 2).
+  ASMJIT_API AsyncLogger(FILE* stream = NULL, size_t bufferSize = 65536) ASMJIT_NOTHROW;
+
+  //! @brief Destroy the @ref AsyncLogger, all messages are written before
+  //! the thread stops.
+  ASMJIT_API virtual ~AsyncLogger() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get @c FILE* stream.
+  //!
+  //! @note Return value can be @c NULL.
+  inline FILE* getStream() const ASMJIT_NOTHROW { return _stream; }
+
+  //! @brief Set @c FILE* stream, messages logged before are written to the
+  //! previous stream.
+  //!
+  //! @param stream @c FILE stream where to log output (can be @c NULL to
+  //! disable logging).
+  ASMJIT_API void setStream(FILE* stream) ASMJIT_NOTHROW;
+
+  //! @brief Get size of buffer of each logging thread.
+  inline size_t getBufferSize() const ASMJIT_NOTHROW { return _bufferSize; }
+
+  //! @brief Get count of messages dropped, because the buffer was full.
+  ASMJIT_API size_t getDroppedCount() const ASMJIT_NOTHROW;
+
+  //! @brief Get count of buffers of logging threads.
+  ASMJIT_API size_t getBufferCount() const ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Flush]
+  // --------------------------------------------------------------------------
+
+  //! @brief Write all messages logged so far to the stream and flush it.
+  ASMJIT_API void flush() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Logging]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API virtual void logString(const char* buf, size_t len = kInvalidSize) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Enabled]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_API virtual void setEnabled(bool enabled) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Private]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get buffer of the calling thread (created when used first time).
+  ASMJIT_API AsyncLoggerBuffer* _getBuffer() ASMJIT_NOTHROW;
+
+  //! @brief Write messages of all buffers to the stream, returns count of
+  //! bytes written (@c _drainLock must be locked).
+  //!
+  //! Buffers of exited threads are freed once written.
+  ASMJIT_API size_t _drain() ASMJIT_NOTHROW;
+
+  //! @brief Remove @a buffer from the list and free it (@c _drainLock must be
+  //! locked).
+  ASMJIT_API void _freeBuffer(AsyncLoggerBuffer* buffer) ASMJIT_NOTHROW;
+
+  //! @brief Body of the thread.
+  ASMJIT_API void _run() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief C file stream.
+  FILE* _stream;
+  //! @brief Size of buffer of each logging thread.
+  size_t _bufferSize;
+
+  //! @brief Buffers of all threads (buffers are prepended, removed only
+  //! while @c _drainLock is locked).
+  AsyncLoggerBuffer* volatile _buffers;
+  //! @brief Buffer of the calling thread.
+  ThreadLocal _threadBuffer;
+  //! @brief Count of messages dropped, because buffer can't be allocated.
+  size_t _dropped;
+
+  //! @brief Lock used to add and remove buffers.
+  Lock _lock;
+  //! @brief Lock held while writing messages to the stream.
+  Lock _drainLock;
+
+  //! @brief Event used to wake the thread.
+  Event _wakeEvent;
+
+  //! @brief Whether the thread is running.
+  bool _running;
+  //! @brief Whether the thread should stop.
+  volatile bool _stop;
+  //! @brief Whether the thread waits for @c _wakeEvent (or is going to).
+  volatile bool _sleeping;
+
+#if defined(ASMJIT_WINDOWS)
+  //! @brief Thread handle.
+  HANDLE _thread;
+#endif // ASMJIT_WINDOWS
+
+#if defined(ASMJIT_POSIX)
+  //! @brief Thread handle.
+  pthread_t _thread;
+#endif // ASMJIT_POSIX
+
+  ASMJIT_NO_COPY(AsyncLogger)
+};
+
 // ============================================================================
 // [AsmJit::StringLogger]
 // ============================================================================
@@ -8,6 +8,7 @@
 
 // [Dependencies - AsmJit]
 #include "../Core/Assert.h"
+#include "../Core/IntUtil.h"
 #include "../Core/Lock.h"
 #include "../Core/MemoryManager.h"
 #include "../Core/VirtualMemory.h"
@@ -29,15 +30,16 @@
 // I think that implementation is not small and probably not too much readable,
 // so there is small know how.
 //
-// - Implementation is based on bit arrays and binary trees. Bit arrays 
+// - Implementation is based on bit arrays and page map. Bit arrays 
 //   contains information about allocated and unused blocks of memory. Each
 //   block size describes MemNode::density member. Count of blocks are
 //   stored in MemNode::blocks member. For example if density is 64 and 
 //   count of blocks is 20, memory node contains 64*20 bytes of memory and
 //   smallest possible allocation (and also alignment) is 64 bytes. So density
-//   describes also memory alignment. Binary trees are used to enable fast
-//   lookup into all addresses allocated by memory manager instance. This is
-//   used mainly in MemoryManagerPrivate::free().
+//   describes also memory alignment. Page map (radix tree indexed by page
+//   number) is used to enable fast lookup into all addresses allocated by
+//   memory manager instance. This is used mainly in
+//   MemoryManagerPrivate::free().
 //
 //   Bit array looks like this (empty = unused, X = used) - Size of block 64
 //   -------------------------------------------------------------------------
@@ -46,22 +48,174 @@
 //   Bits array shows that there are 12 allocated blocks of 64 bytes, so total 
 //   allocated size is 768 bytes. Maximum count of continuous blocks is 12
 //   (see largest gap).
+//
+// - Bit arrays are the backing store, but they are not searched when
+//   allocating. Each run of unused blocks is described by MemRun structure
+//   and linked into one of size-class lists (bins) of MemoryManagerPrivate.
+//   Runs up to kMemBinExact blocks have a bin for each count of blocks, larger
+//   runs share power-of-2 bins. Bit mask of non-empty bins is used to find the
+//   bin where the request fits, so the allocation doesn't depend on count of
+//   nodes or on their fragmentation.
+//
+// - Each node contains an index of its free runs (MemNode::runs). The first
+//   and the last block of each free run points to its MemRun, all other
+//   entries are NULL. This is used to coalesce freed blocks with neighbor
+//   runs without traversing the bit arrays.
+//
+// - Optionally, each thread has its own cache (MemThreadCache) of small
+//   allocated blocks, grouped by count of blocks into magazines. Allocation
+//   takes a block from the magazine and free puts it into the list of pending
+//   blocks, both without locking. The lock is only taken to refill an empty
+//   magazine or to return full list of pending blocks, always in batches.
+//
+// - Optionally, nodes are placed into arenas (MemArena) backed by large pages
+//   instead of being allocated separately. Arena is split to slots of the
+//   default node size and uses its own bit array of used slots.
+//
+// - Free runs are not shared by all nodes, they are linked into bins of heap
+//   (MemHeap) where their node belongs to. Nodes of the default heap are
+//   placed anywhere. Other heaps contain nodes placed within rel32 range of
+//   some address (see allocNear()), these nodes are always in arenas.
+//
+// - Trampolines created by getTrampoline() are shared by all code in the
+//   same node calling the same target. They are stored in blocks allocated
+//   from the node (MemTrampolines) and released together with the node when
+//   nothing else is used in it.
+//
+// - Memory freed by retire() is kept in the list of retired blocks until all
+//   registered threads pass a quiescent state. Each retire() increments the
+//   global epoch and the retired block remembers the epoch before. Thread
+//   announces a quiescent state by storing the current global epoch into its
+//   MemThreadCache, a retired block can be freed when all registered threads
+//   stored greater epoch.
+//
+// - Empty nodes are kept (with their free run) while all kept empty nodes
+//   fit into the retain threshold, so the memory isn't mapped and unmapped
+//   again when the usage oscillates. Pages of large nodes (larger than the
+//   default node size) and of arena slots, which became completely unused,
+//   are discarded (returned to the system, but left mapped).
+//
+// - Optionally, one large region of virtual memory is reserved and all nodes
+//   of the default heap are placed into it. The region is an arena whose
+//   slots are committed when used and decommitted when freed.
+//
+// - Memory allocated by allocOnNumaNode() is in heaps of NUMA nodes. Their
+//   nodes are always in arenas, which are bound to the NUMA node before
+//   their pages are touched (or placed by the first touch where binding is
+//   not supported).
+//
+// - free() doesn't take the lock. It clears bits of the freed blocks by
+//   atomic operations and pushes the blocks to the lock-free list of freed
+//   blocks (the link is stored in the freed block itself). The list is
+//   returned to the free runs by the next allocation or, when it becomes
+//   long, by the thread which freed the last block. So the lock is only
+//   needed to create, restructure or release nodes.
+//
+// - Permanent memory is carved from permanent nodes by bumping their used
+//   bytes. When thread caches are used, each thread owns one permanent node
+//   (stored in its MemThreadCache) where it allocates without the lock.
+//   When the node is full, the thread gives it up and takes other node with
+//   enough space (so the tail of the node given up is used by the next
+//   thread refilling) or a new node.
 
 namespace AsmJit {
 
+// ============================================================================
+// [Atomic Operations]
+// ============================================================================
+
+// Atomic operations on words shared with threads not holding the lock, they
+// return the previous value. Only compare-exchange is needed on Windows.
+static inline size_t _AtomicCompareExchange(volatile size_t* p, size_t old, size_t value) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  return (size_t)InterlockedCompareExchangePointer((PVOID*)p, (PVOID)value, (PVOID)old);
+#else
+  return __sync_val_compare_and_swap(p, old, value);
+#endif // ASMJIT_WINDOWS
+}
+
+static inline size_t _AtomicExchange(volatile size_t* p, size_t value) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  size_t old;
+  do { old = *p; } while (_AtomicCompareExchange(p, old, value) != old);
+  return old;
+#else
+  // Acquire barrier only, it's enough to read the data published before.
+  return __sync_lock_test_and_set(p, value);
+#endif // ASMJIT_WINDOWS
+}
+
+static inline size_t _AtomicAdd(volatile size_t* p, size_t value) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  size_t old;
+  do { old = *p; } while (_AtomicCompareExchange(p, old, old + value) != old);
+  return old;
+#else
+  return __sync_fetch_and_add(p, value);
+#endif // ASMJIT_WINDOWS
+}
+
+static inline size_t _AtomicSub(volatile size_t* p, size_t value) ASMJIT_NOTHROW
+{
+  return _AtomicAdd(p, (size_t)0 - value);
+}
+
+static inline size_t _AtomicAnd(volatile size_t* p, size_t mask) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  size_t old;
+  do { old = *p; } while (_AtomicCompareExchange(p, old, old & mask) != old);
+  return old;
+#else
+  return __sync_fetch_and_and(p, mask);
+#endif // ASMJIT_WINDOWS
+}
+
+static inline size_t _AtomicOr(volatile size_t* p, size_t mask) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  size_t old;
+  do { old = *p; } while (_AtomicCompareExchange(p, old, old | mask) != old);
+  return old;
+#else
+  return __sync_fetch_and_or(p, mask);
+#endif // ASMJIT_WINDOWS
+}
+
+// Read word written by other threads, memory read after it sees the data
+// written before the word was stored.
+static inline size_t _AtomicLoad(const volatile size_t* p) ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  // Volatile read has acquire semantics on MSVC.
+  return *p;
+#elif defined(__ATOMIC_ACQUIRE)
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+  return __sync_fetch_and_add(const_cast<volatile size_t*>(p), 0);
+#endif // ASMJIT_WINDOWS
+}
+
 // ============================================================================
 // [Bits Manipulation]
 // ============================================================================
 
 #define BITS_PER_ENTITY (sizeof(size_t) * 8)
 
+// Bit arrays of nodes are cleared by free() without the lock, so words which
+// can contain bits of other allocations are changed by atomic operations.
+// Whole words in the middle of the range belong to the caller only.
+
 static void _SetBit(size_t* buf, size_t index) ASMJIT_NOTHROW
 {
   size_t i = index / BITS_PER_ENTITY; // size_t[]
   size_t j = index % BITS_PER_ENTITY; // size_t[][] bit index
 
   buf += i;
-  *buf |= (size_t)1 << j;
+  _AtomicOr(buf, (size_t)1 << j);
 }
 
 static void _ClearBit(size_t* buf, size_t index) ASMJIT_NOTHROW
@@ -70,7 +224,7 @@ static void _ClearBit(size_t* buf, size_t index) ASMJIT_NOTHROW
   size_t j = index % BITS_PER_ENTITY; // size_t[][] bit index
 
   buf += i;
-  *buf &= ~((size_t)1 << j);
+  _AtomicAnd(buf, ~((size_t)1 << j));
 }
 
 static void _SetBits(size_t* buf, size_t index, size_t len) ASMJIT_NOTHROW
@@ -87,7 +241,7 @@ static void _SetBits(size_t* buf, size_t index, size_t len) ASMJIT_NOTHROW
   // Offset.
   buf += i;
 
-  *buf++ |= ((~(size_t)0) >> (BITS_PER_ENTITY - c)) << j;
+  _AtomicOr(buf++, ((~(size_t)0) >> (BITS_PER_ENTITY - c)) << j);
   len -= c;
 
   while (len >= BITS_PER_ENTITY)
@@ -98,7 +252,7 @@ static void _SetBits(size_t* buf, size_t index, size_t len) ASMJIT_NOTHROW
 
   if (len)
   {
-    *buf |= ((~(size_t)0) >> (BITS_PER_ENTITY - len));
+    _AtomicOr(buf, ((~(size_t)0) >> (BITS_PER_ENTITY - len)));
   }
 }
 
@@ -116,7 +270,7 @@ static void _ClearBits(size_t* buf, size_t index, size_t len) ASMJIT_NOTHROW
   // Offset.
   buf += i;
 
-  *buf++ &= ~(((~(size_t)0) >> (BITS_PER_ENTITY - c)) << j);
+  _AtomicAnd(buf++, ~(((~(size_t)0) >> (BITS_PER_ENTITY - c)) << j));
   len -= c;
 
   while (len >= BITS_PER_ENTITY)
@@ -127,48 +281,67 @@ static void _ClearBits(size_t* buf, size_t index, size_t len) ASMJIT_NOTHROW
 
   if (len)
   {
-    *buf &= (~(size_t)0) << len;
+    _AtomicAnd(buf, (~(size_t)0) << len);
   }
 }
 
-// ============================================================================
-// [AsmJit::MemNode]
-// ============================================================================
-
-#define M_DIV(x, y) ((x) / (y))
-#define M_MOD(x, y) ((x) % (y))
+// Get index of the first set bit in @a x (x must be non-zero).
+static inline size_t _FindFirstBit(size_t x) ASMJIT_NOTHROW
+{
+  uint32_t lo = (uint32_t)x;
+  if (lo != 0 || sizeof(size_t) == 4)
+    return IntUtil::findFirstBit(lo);
+  else
+    return 32 + IntUtil::findFirstBit((uint32_t)((uint64_t)x >> 32));
+}
 
-template<typename T>
-struct RbNode
+// Get count of set bits in @a x.
+static inline size_t _BitCount(size_t x) ASMJIT_NOTHROW
 {
-  // --------------------------------------------------------------------------
-  // [Node red-black tree tree, key is mem pointer].
-  // --------------------------------------------------------------------------
+  size_t n = IntUtil::bitCount((uint32_t)x);
+  if (sizeof(size_t) > 4)
+    n += IntUtil::bitCount((uint32_t)((uint64_t)x >> 32));
+  return n;
+}
 
-  // Implementation is based on article by Julienne Walker (Public Domain),
-  // including C code and original comments. Thanks for the excellent article.
+// Get index of the first bit which is @a value in range [index, end), or
+// @a end if there is no such bit. Whole words are skipped using bit scan.
+//
+// Words are read atomically, free() calls it without the lock.
+static size_t _FindBit(const size_t* buf, size_t index, size_t end, bool value) ASMJIT_NOTHROW
+{
+  if (index >= end) return end;
 
-  // Left[0] and right[1] nodes.
-  T* node[2];
-  // Whether the node is RED.
-  uint32_t red;
+  size_t flip = value ? (size_t)0 : ~(size_t)0;
+  const size_t* p = buf + index / BITS_PER_ENTITY;
+  const size_t* pEnd = buf + (end + BITS_PER_ENTITY - 1) / BITS_PER_ENTITY;
 
-  // --------------------------------------------------------------------------
-  // [Chunk Memory]
-  // --------------------------------------------------------------------------
+  // Ignore bits before index in the first word.
+  size_t bits = (_AtomicLoad(p) ^ flip) & ((~(size_t)0) << (index % BITS_PER_ENTITY));
 
-  // Virtual memory address.
-  uint8_t* mem;
-};
+  while (bits == 0)
+  {
+    if (++p == pEnd) return end;
+    bits = _AtomicLoad(p) ^ flip;
+  }
 
-// Get whether the node is red (NULL or node with red flag).
-template<typename T>
-inline bool isRed(RbNode<T>* node)
-{
-  return node != NULL && node->red;
+  index = (size_t)(p - buf) * BITS_PER_ENTITY + _FindFirstBit(bits);
+  return index < end ? index : end;
 }
 
-struct MemNode : public RbNode<MemNode>
+// ============================================================================
+// [AsmJit::MemNode]
+// ============================================================================
+
+#define M_DIV(x, y) ((x) / (y))
+#define M_MOD(x, y) ((x) % (y))
+
+struct MemRun;
+struct MemArena;
+struct MemHeap;
+struct MemTrampolines;
+
+struct MemNode
 {
   // --------------------------------------------------------------------------
   // [Node double-linked list]
@@ -181,16 +354,26 @@ struct MemNode : public RbNode<MemNode>
   // [Chunk Data]
   // --------------------------------------------------------------------------
 
+  uint8_t* mem;         // Virtual memory address.
   size_t size;          // How many bytes contain this node.
   size_t blocks;        // How many blocks are here.
   size_t density;       // Minimum count of allocated bytes in this node (also alignment).
   size_t used;          // How many bytes are used in this node.
-  size_t largestBlock;  // Contains largest block that can be allocated.
+  uint8_t* rw;          // Writable view of mem (same as mem if not mapped twice).
+  MemArena* arena;      // Arena where the node is placed or NULL.
+  MemHeap* heap;        // Heap where the free runs of the node are linked.
 
   size_t* baUsed;       // Contains bits about used blocks.
                         // (0 = unused, 1 = used).
   size_t* baCont;       // Contains bits about continuous blocks.
                         // (0 = stop, 1 = continue).
+  MemRun** runs;        // Free runs index (first and last block of each
+                        // free run points to its MemRun, otherwise NULL).
+
+  MemTrampolines* trampolines;
+                        // Shared trampolines of the node.
+  size_t trampolinesUsed;
+                        // How many bytes are used by shared trampolines.
 
   // --------------------------------------------------------------------------
   // [Methods]
@@ -198,21 +381,272 @@ struct MemNode : public RbNode<MemNode>
 
   // Get available space.
   inline size_t getAvailable() const ASMJIT_NOTHROW { return size - used; }
+};
+
+// ============================================================================
+// [AsmJit::MemMap]
+// ============================================================================
+
+enum
+{
+  //! @brief Page shift used by the page map (nodes are aligned to 4kB at least).
+  kMemMapPageShift = 12,
+  //! @brief Count of address bits covered by the page map, nodes above are
+  //! not in the page map.
+  kMemMapAddressBits = sizeof(void*) > 4 ? 48 : 32,
+  //! @brief Count of page number bits used to index the second and the third
+  //! level of the page map.
+  kMemMapLevelBits = sizeof(void*) > 4 ? 12 : 10,
+  //! @brief Count of page number bits used to index the first level.
+  kMemMapRootBits = kMemMapAddressBits - kMemMapPageShift - kMemMapLevelBits * 2,
+
+  //! @brief Size of the second and the third level table.
+  kMemMapLevelSize = 1 << kMemMapLevelBits,
+  //! @brief Size of the first level table.
+  kMemMapRootSize = 1 << kMemMapRootBits
+};
+
+// Get whether @a p is above addresses covered by the page map.
+static inline bool _IsAboveMap(const void* p) ASMJIT_NOTHROW
+{
+  return ((uint64_t)(size_t)p >> kMemMapAddressBits) != 0;
+}
+
+// ============================================================================
+// [AsmJit::MemRun]
+// ============================================================================
+
+//! @brief Run of unused blocks in @c MemNode.
+struct MemRun
+{
+  MemNode* node;        // Node where the run is.
+  size_t start;         // Index of the first block.
+  size_t blocks;        // Count of blocks.
+
+  MemRun* prev;         // Prev run in the same bin.
+  MemRun* next;         // Next run in the same bin (or next unused MemRun).
+};
+
+//! @brief Chunk of @c MemRun structures, allocated by @c MemoryManagerPrivate.
+struct MemRunChunk
+{
+  enum { kRunsPerChunk = 128 };
+
+  MemRunChunk* prev;    // Prev chunk.
+  MemRun runs[kRunsPerChunk];
+};
+
+enum
+{
+  //! @brief Runs up to this count of blocks have their own bin.
+  kMemBinExact = 64,
+  //! @brief Count of bins (exact bins + power-of-2 bins).
+  kMemBinCount = kMemBinExact + BITS_PER_ENTITY - 6,
+  //! @brief Count of 32-bit words in mask of non-empty bins.
+  kMemBinMaskCount = (kMemBinCount + 31) / 32
+};
+
+// Get bin of a run having @a blocks blocks (blocks must be non-zero).
+static inline size_t _GetBin(size_t blocks) ASMJIT_NOTHROW
+{
+  if (blocks <= kMemBinExact)
+    return blocks - 1;
+
+  // Index of the most significant bit, at least 6 here.
+  size_t bin = kMemBinExact - 6;
+  while (blocks >>= 1) bin++;
+
+  return bin;
+}
+
+// ============================================================================
+// [AsmJit::MemHeap]
+// ============================================================================
+
+enum
+{
+  //! @brief Nodes placed near addresses in the same region (1GB) share a heap.
+  kMemNearRegionShift = 30,
+  //! @brief Maximum distance of nodes from the center of the region. All
+  //! nodes are within 1.75GB from any address in the region.
+  kMemNearRange = 1280 * 1024 * 1024,
+  //! @brief Maximum distance of nodes from any address near them.
+  kMemNearDistance = 1792 * 1024 * 1024,
+  //! @brief NUMA node of heap which is not bound to any node.
+  kMemNumaAny = 0xFFFFFFFF
+};
+
+//! @brief Free runs of nodes placed near the same address.
+struct MemHeap
+{
+  // Free runs, segregated by size-class.
+  MemRun* bins[kMemBinCount];
+  uint32_t binMask[kMemBinMaskCount];
+
+  uint8_t* near;        // Center of the region where nodes are placed, NULL
+                        // if nodes can be placed anywhere.
+  uint32_t numaNode;    // NUMA node where nodes are placed or kMemNumaAny.
+  MemHeap* next;        // Next heap.
+};
+
+// ============================================================================
+// [AsmJit::MemArena]
+// ============================================================================
+
+//! @brief Arena of virtual memory where nodes are placed.
+struct MemArena
+{
+  uint8_t* mem;         // Virtual memory address.
+  uint8_t* rw;          // Writable view of mem.
+  size_t size;          // How many bytes contain this arena.
+
+  size_t slotSize;      // Size of one slot (node is one or more slots).
+  size_t slots;         // How many slots are here.
+  size_t used;          // How many slots are used.
+  size_t* baUsed;       // Contains bits about used slots.
+  bool largePages;      // Whether the arena is backed by large pages.
+  bool reserved;        // Whether the slots are committed only when used.
+
+  MemHeap* heap;        // Heap where the nodes of the arena belong to.
+  MemArena* next;       // Next arena.
+};
 
-  inline void fillData(MemNode* other)
+// ============================================================================
+// [AsmJit::MemTrampolines]
+// ============================================================================
+
+enum
+{
+  //! @brief Size of one shared trampoline (maximum size and alignment).
+  kMemTrampolineSize = 16,
+  //! @brief Count of trampolines in one block of @c MemTrampolines.
+  kMemTrampolinesPerBlock = 4
+};
+
+//! @brief Block of shared trampolines allocated from @c MemNode.
+struct MemTrampolines
+{
+  uint8_t* mem;         // Address of the first trampoline.
+  size_t blocks;        // Count of node blocks used.
+  size_t count;         // How many trampolines are used.
+  const void* targets[kMemTrampolinesPerBlock];
+                        // Target of each trampoline.
+  MemTrampolines* next; // Next block of the same node.
+};
+
+// ============================================================================
+// [AsmJit::MemThreadCache]
+// ============================================================================
+
+enum
+{
+  //! @brief Allocations up to this count of blocks are cached per thread.
+  kMemCacheClasses = 8,
+  //! @brief Capacity of magazine and list of pending blocks.
+  kMemCacheCapacity = 16,
+  //! @brief Count of blocks allocated at once to refill a magazine.
+  kMemCacheBatch = 8
+};
+
+struct MemoryManagerPrivate;
+struct PermanentNode;
+
+//! @brief Thread cache of allocated blocks (and epoch of the thread).
+struct MemThreadCache
+{
+  MemoryManagerPrivate* owner;   // Memory manager where the cache belongs to.
+  MemThreadCache* prev;          // Prev cache of the same memory manager.
+  MemThreadCache* next;          // Next cache of the same memory manager.
+
+  // The last epoch seen by the thread in quiescent state.
+  volatile size_t epoch;
+  // Whether the thread is registered (see registerThread()).
+  bool registered;
+
+  // Magazines of blocks ready to be allocated, index is count of blocks - 1.
+  size_t count[kMemCacheClasses];
+  void* magazines[kMemCacheClasses][kMemCacheCapacity];
+
+  // Blocks freed by the thread, but not returned to the memory manager yet.
+  size_t pendingCount;
+  void* pending[kMemCacheCapacity];
+
+  // Permanent node where the thread allocates permanent memory.
+  PermanentNode* permanent;
+};
+
+#if defined(ASMJIT_DEBUG)
+// Get whether @a p is in magazines or pending blocks of @a cache, freeing it
+// again would make the next allocations return the same block twice.
+static bool _IsCached(const MemThreadCache* cache, const void* p) ASMJIT_NOTHROW
+{
+  size_t i, j;
+
+  for (i = 0; i < cache->pendingCount; i++)
   {
-    mem = other->mem;
+    if (cache->pending[i] == p) return true;
+  }
 
-    size = other->size;
-    blocks = other->blocks;
-    density = other->density;
-    used = other->used;
-    largestBlock = other->largestBlock;
-    baUsed = other->baUsed;
-    baCont = other->baCont;
+  for (i = 0; i < kMemCacheClasses; i++)
+  {
+    for (j = 0; j < cache->count[i]; j++)
+    {
+      if (cache->magazines[i][j] == p) return true;
+    }
   }
+
+  return false;
+}
+#endif // ASMJIT_DEBUG
+
+// ============================================================================
+// [AsmJit::MemRetired]
+// ============================================================================
+
+enum
+{
+  //! @brief Count of retired blocks after which retire() reclaims them.
+  kMemRetireThreshold = 64
+};
+
+//! @brief Retired block waiting to be freed.
+struct MemRetired
+{
+  void* address;        // Address of the block.
+  size_t size;          // Size of the block.
+  size_t epoch;         // Epoch when the block was retired.
+};
+
+// ============================================================================
+// [AsmJit::MemFreed]
+// ============================================================================
+
+enum
+{
+  //! @brief Count of blocks freed without the lock after which the freeing
+  //! thread returns them to the free runs.
+  kMemFreedThreshold = 64
+};
+
+//! @brief Link of the list of blocks freed without the lock, stored in the
+//! first freed block (blocks are 16 bytes at least).
+struct MemFreed
+{
+  uint8_t* next;        // Address of the next freed block.
+  size_t blocks;        // Count of blocks freed.
 };
 
+// Full memory barrier.
+static inline void _MemoryBarrier() ASMJIT_NOTHROW
+{
+#if defined(ASMJIT_WINDOWS)
+  LONG barrier;
+  InterlockedExchange(&barrier, 0);
+#else
+  __sync_synchronize();
+#endif // ASMJIT_WINDOWS
+}
+
 // ============================================================================
 // [AsmJit::M_Permanent]
 // ============================================================================
@@ -221,8 +655,11 @@ struct MemNode : public RbNode<MemNode>
 struct PermanentNode
 {
   uint8_t* mem;            // Base pointer (virtual memory address).
+  uint8_t* rw;             // Writable view of mem.
   size_t size;             // Count of bytes allocated.
   size_t used;             // Count of bytes used.
+  MemThreadCache* owner;   // Thread cache of the thread allocating from the
+                           // node without the lock, NULL if not owned.
   PermanentNode* prev;     // Pointer to prev chunk or NULL.
 
   // Get available space.
@@ -250,27 +687,132 @@ struct MemoryManagerPrivate
   // [Allocation]
   // --------------------------------------------------------------------------
 
-  MemNode* createNode(size_t size, size_t density) ASMJIT_NOTHROW;
+  MemNode* createNode(MemHeap* heap, size_t size, size_t density) ASMJIT_NOTHROW;
+  void freeNodeMemory(MemNode* node) ASMJIT_NOTHROW;
 
-  void* allocPermanent(size_t vsize) ASMJIT_NOTHROW;
-  void* allocFreeable(size_t vsize) ASMJIT_NOTHROW;
+  void* allocPermanent(size_t vsize, size_t alignment) ASMJIT_NOTHROW;
+  void* _bumpPermanent(PermanentNode* node, size_t alignedSize, size_t alignment) ASMJIT_NOTHROW;
+  void* allocFreeable(size_t vsize, size_t alignment) ASMJIT_NOTHROW;
+  void* allocNear(size_t vsize, const void* hint, size_t alignment) ASMJIT_NOTHROW;
+  void* allocOnNumaNode(size_t vsize, uint32_t numaNode, size_t alignment) ASMJIT_NOTHROW;
 
   bool free(void* address) ASMJIT_NOTHROW;
   bool shrink(void* address, size_t used) ASMJIT_NOTHROW;
+  bool grow(void* address, size_t size) ASMJIT_NOTHROW;
   void freeAll(bool keepVirtualMemory) ASMJIT_NOTHROW;
 
+  void* getWritableAddress(void* address) ASMJIT_NOTHROW;
+  void* getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW;
+
+  // Variants of allocFreeable() and free() called with the lock held.
+  void* _allocFreeable(MemHeap* heap, size_t need, size_t alignment) ASMJIT_NOTHROW;
+  bool _free(void* address) ASMJIT_NOTHROW;
+
+  // Free without the lock, the blocks are returned to the free runs later by
+  // drainFreed() (called with the lock held).
+  bool freeLockFree(void* address) ASMJIT_NOTHROW;
+  void drainFreed() ASMJIT_NOTHROW;
+
+  // Drain freed blocks if there are some, so statistics include the nodes
+  // released by them.
+  inline void flushFreed() ASMJIT_NOTHROW
+  {
+    if (_freed == NULL) return;
+
+    AutoLock locked(_lock);
+    drainFreed();
+  }
+
+  size_t findBlocks(void* address, MemNode** pNode, size_t* pIndex) ASMJIT_NOTHROW;
+  void freeBlocks(MemNode* node, size_t bitpos, size_t cont) ASMJIT_NOTHROW;
+  void returnBlocks(MemNode* node, size_t bitpos, size_t cont) ASMJIT_NOTHROW;
+  void freeTrampolines(MemNode* node) ASMJIT_NOTHROW;
+
+  void releaseNode(MemNode* node) ASMJIT_NOTHROW;
+  void releaseRetained(size_t threshold) ASMJIT_NOTHROW;
+  void discardBlocks(MemNode* node, MemRun* run, size_t index, size_t count) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Arenas]
+  // --------------------------------------------------------------------------
+
+  uint8_t* allocArenaSlots(MemHeap* heap, size_t size, size_t* vsize, uint8_t** rw, MemArena** pArena) ASMJIT_NOTHROW;
+  void freeArenaSlots(MemArena* arena, uint8_t* vmem, size_t vsize) ASMJIT_NOTHROW;
+
+  uint8_t* allocRegionSlots(size_t size, size_t* vsize, uint8_t** rw, MemArena** pArena) ASMJIT_NOTHROW;
+  bool isRegionNear(const void* hint) ASMJIT_NOTHROW;
+
+  MemArena* createArena(MemHeap* heap, size_t slotSize, size_t size, bool reserve) ASMJIT_NOTHROW;
+  void freeArena(MemArena* arena, bool keepVirtualMemory) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Thread Cache]
+  // --------------------------------------------------------------------------
+
+  bool initThreadCache() ASMJIT_NOTHROW;
+  MemThreadCache* getThreadCache() ASMJIT_NOTHROW;
+
+  void* refillCache(MemThreadCache* cache, size_t need) ASMJIT_NOTHROW;
+  void flushCache(MemThreadCache* cache) ASMJIT_NOTHROW;
+  void drainCache(MemThreadCache* cache) ASMJIT_NOTHROW;
+  void releaseCache(MemThreadCache* cache) ASMJIT_NOTHROW;
+
+  static void ASMJIT_THREAD_LOCAL_CALL onThreadExit(void* cache) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Deferred Free]
+  // --------------------------------------------------------------------------
+
+  bool registerThread() ASMJIT_NOTHROW;
+  void unregisterThread() ASMJIT_NOTHROW;
+  void quiescent() ASMJIT_NOTHROW;
+  bool retire(void* address) ASMJIT_NOTHROW;
+  size_t _reclaim() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Free Runs]
+  // --------------------------------------------------------------------------
+
+  MemRun* newRun() ASMJIT_NOTHROW;
+  inline void deleteRun(MemRun* run) ASMJIT_NOTHROW
+  {
+    run->next = _unusedRuns;
+    _unusedRuns = run;
+  }
+
+  void linkRun(MemRun* run) ASMJIT_NOTHROW;
+  void unlinkRun(MemRun* run) ASMJIT_NOTHROW;
+
+  bool checkNode(MemNode* node) ASMJIT_NOTHROW;
+
+  MemHeap* getNearHeap(const void* hint) ASMJIT_NOTHROW;
+  MemHeap* getNumaHeap(uint32_t numaNode) ASMJIT_NOTHROW;
+  MemRun* findRun(MemHeap* heap, size_t need) ASMJIT_NOTHROW;
+  size_t takeRun(MemRun* run, size_t need) ASMJIT_NOTHROW;
+  MemRun* addFreeBlocks(MemNode* node, size_t index, size_t count) ASMJIT_NOTHROW;
+
   // Helpers to avoid ifdefs in the code.
-  inline uint8_t* allocVirtualMemory(size_t size, size_t* vsize) ASMJIT_NOTHROW
+  inline uint8_t* allocVirtualMemory(size_t size, size_t* vsize, uint8_t** rw) ASMJIT_NOTHROW
   {
+    if (_dualMapping)
+      return (uint8_t*)VirtualMemory::allocDualMapping(size, vsize, (void**)rw);
+
 #if !defined(ASMJIT_WINDOWS)
-    return (uint8_t*)VirtualMemory::alloc(size, vsize, true);
+    *rw = (uint8_t*)VirtualMemory::alloc(size, vsize, true);
 #else
-    return (uint8_t*)VirtualMemory::allocProcessMemory(_hProcess, size, vsize, true);
+    *rw = (uint8_t*)VirtualMemory::allocProcessMemory(_hProcess, size, vsize, true);
 #endif
+    return *rw;
   }
 
-  inline void freeVirtualMemory(void* vmem, size_t vsize) ASMJIT_NOTHROW
+  inline void freeVirtualMemory(void* vmem, void* rw, size_t vsize) ASMJIT_NOTHROW
   {
+    if (vmem != rw)
+    {
+      VirtualMemory::freeDualMapping(vmem, rw, vsize);
+      return;
+    }
+
 #if !defined(ASMJIT_WINDOWS)
     VirtualMemory::free(vmem, vsize);
 #else
@@ -278,16 +820,29 @@ struct MemoryManagerPrivate
 #endif
   }
 
+  inline bool discardVirtualMemory(void* vmem, void* rw, size_t vsize) ASMJIT_NOTHROW
+  {
+    if (vmem != rw)
+      return VirtualMemory::discardDualMapping(vmem, rw, vsize);
+
+#if !defined(ASMJIT_WINDOWS)
+    return VirtualMemory::discard(vmem, vsize);
+#else
+    return VirtualMemory::discardProcessMemory(_hProcess, vmem, vsize);
+#endif
+  }
+
   // --------------------------------------------------------------------------
-  // [NodeList RB-Tree]
+  // [NodeList Page Map]
   // --------------------------------------------------------------------------
 
-  bool checkTree() ASMJIT_NOTHROW;
-
-  void insertNode(MemNode* node) ASMJIT_NOTHROW;
-  MemNode* removeNode(MemNode* node) ASMJIT_NOTHROW;
+  bool insertNode(MemNode* node) ASMJIT_NOTHROW;
+  void removeNode(MemNode* node) ASMJIT_NOTHROW;
   MemNode* findPtr(uint8_t* mem) ASMJIT_NOTHROW;
 
+  bool mapNode(MemNode* node, MemNode* value) ASMJIT_NOTHROW;
+  void freeMap() ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -300,21 +855,62 @@ struct MemoryManagerPrivate
   size_t _newChunkSize;        // Default node size.
   size_t _newChunkDensity;     // Default node density.
   size_t _allocated;           // How many bytes are allocated.
-  size_t _used;                // How many bytes are used.
+  volatile size_t _used;       // How many bytes are used (changed atomically).
+  size_t _retained;            // How many bytes are in empty nodes kept.
+  size_t _released;            // How many bytes were returned to the system.
+  size_t _retainThreshold;     // Maximum bytes of empty nodes kept.
 
   // Memory nodes list.
   MemNode* _first;
   MemNode* _last;
-  MemNode* _optimal;
 
-  // Memory nodes tree.
-  MemNode* _root;
+  // Memory nodes page map, the third level contains node of each page.
+  MemNode** * _map[kMemMapRootSize];
+
+  // Free runs of nodes placed anywhere (default heap).
+  MemHeap _heap;
+  // Free runs of nodes placed near some address.
+  MemHeap* _nearHeaps;
+  // Free runs of nodes placed on some NUMA node.
+  MemHeap* _numaHeaps;
+
+  // Unused runs and chunks where runs are allocated.
+  MemRun* _unusedRuns;
+  MemRunChunk* _runChunks;
+
+  // Blocks freed without the lock, not returned to the free runs yet.
+  uint8_t* volatile _freed;
+  volatile size_t _freedCount;
 
   // Permanent memory.
   PermanentNode* _permanent;
 
+  // Arenas.
+  MemArena* _arenas;
+  // Reserved region (arena) where nodes of the default heap are placed.
+  MemArena* _region;
+  size_t _regionSize;
+
+  // Thread caches (the key is allocated by initThreadCache()).
+  ThreadLocal _threadCache;
+  MemThreadCache* _caches;
+
+  // Retired blocks, ordered by epoch.
+  MemRetired* _retired;
+  size_t _retiredCount;
+  size_t _retiredCapacity;
+  size_t _retiredBytes;
+  // Global epoch, incremented by retire().
+  volatile size_t _epoch;
+
   // Whether to keep virtual memory after destroy.
   bool _keepVirtualMemory;
+  // Whether to use thread caches.
+  bool _useThreadCache;
+  // Whether to map virtual memory twice (read/execute and read/write).
+  bool _dualMapping;
+  // Whether to place nodes into arenas backed by large pages.
+  bool _useLargePages;
 };
 
 // ============================================================================
@@ -331,20 +927,57 @@ MemoryManagerPrivate::MemoryManagerPrivate(HANDLE hProcess) ASMJIT_NOTHROW :
   _newChunkDensity(64),
   _allocated(0),
   _used(0),
-  _root(NULL),
+  _retained(0),
+  _released(0),
+  _retainThreshold(0),
   _first(NULL),
   _last(NULL),
-  _optimal(NULL),
+  _nearHeaps(NULL),
+  _numaHeaps(NULL),
+  _unusedRuns(NULL),
+  _runChunks(NULL),
+  _freed(NULL),
+  _freedCount(0),
   _permanent(NULL),
-  _keepVirtualMemory(false)
+  _arenas(NULL),
+  _region(NULL),
+  _regionSize(0),
+  _caches(NULL),
+  _retired(NULL),
+  _retiredCount(0),
+  _retiredCapacity(0),
+  _retiredBytes(0),
+  _epoch(0),
+  _keepVirtualMemory(false),
+  _useThreadCache(false),
+  _dualMapping(false),
+  _useLargePages(false)
 {
+  memset(&_heap, 0, sizeof(MemHeap));
+  _heap.numaNode = kMemNumaAny;
+  memset(_map, 0, sizeof(_map));
 }
 
 MemoryManagerPrivate::~MemoryManagerPrivate() ASMJIT_NOTHROW
 {
+  // Windows releases caches of other threads when the key is freed, they
+  // must be still valid.
+  _threadCache.destroy();
+
   // Freeable memory cleanup - Also frees the virtual memory if configured to.
   freeAll(_keepVirtualMemory);
 
+  if (_retired) ASMJIT_FREE(_retired);
+
+  // Thread caches cleanup - They are empty after freeAll().
+  MemThreadCache* cache = _caches;
+  while (cache)
+  {
+    MemThreadCache* next = cache->next;
+    ASMJIT_FREE(cache);
+    cache = next;
+  }
+
   // Permanent memory cleanup - Never frees the virtual memory.
   PermanentNode* node = _permanent;
   while (node)
@@ -362,72 +995,119 @@ MemoryManagerPrivate::~MemoryManagerPrivate() ASMJIT_NOTHROW
 // Allocates virtual memory node and MemNode structure.
 //
 // Returns MemNode* on success, otherwise NULL.
-MemNode* MemoryManagerPrivate::createNode(size_t size, size_t density) ASMJIT_NOTHROW
+MemNode* MemoryManagerPrivate::createNode(MemHeap* heap, size_t size, size_t density) ASMJIT_NOTHROW
 {
   size_t vsize;
-  uint8_t* vmem = allocVirtualMemory(size, &vsize);
+  uint8_t* rw;
+  uint8_t* vmem = NULL;
+  MemArena* arena = NULL;
+
+  // Nodes placed near some address or on NUMA node are always in arenas,
+  // nodes of the default heap are only in the reserved region if there is
+  // one.
+  if (heap == &_heap && _regionSize != 0)
+    vmem = allocRegionSlots(size, &vsize, &rw, &arena);
+  else if (heap->near != NULL || heap->numaNode != kMemNumaAny ||
+    (_useLargePages && size <= VirtualMemory::getLargePageSize()))
+    vmem = allocArenaSlots(heap, size, &vsize, &rw, &arena);
+
+  if (vmem == NULL && heap->near == NULL && _regionSize == 0)
+  {
+    vmem = allocVirtualMemory(size, &vsize, &rw);
+    if (vmem != NULL && heap->numaNode != kMemNumaAny)
+      VirtualMemory::bindNumaNode(rw, vsize, heap->numaNode);
+  }
 
   // Out of memory.
   if (vmem == NULL) return NULL;
 
   size_t blocks = (vsize / density);
   size_t bsize = (((blocks + 7) >> 3) + sizeof(size_t) - 1) & ~(size_t)(sizeof(size_t) - 1);
+  size_t rsize = blocks * sizeof(MemRun*);
 
   MemNode* node = reinterpret_cast<MemNode*>(ASMJIT_MALLOC(sizeof(MemNode)));
-  uint8_t* data = reinterpret_cast<uint8_t*>(ASMJIT_MALLOC(bsize * 2));
+  uint8_t* data = reinterpret_cast<uint8_t*>(ASMJIT_MALLOC(bsize * 2 + rsize));
 
   // Out of memory.
   if (node == NULL || data == NULL)
   {
-    freeVirtualMemory(vmem, vsize);
+    if (arena)
+      freeArenaSlots(arena, vmem, vsize);
+    else
+      freeVirtualMemory(vmem, rw, vsize);
     if (node) ASMJIT_FREE(node);
     if (data) ASMJIT_FREE(data);
     return NULL;
   }
 
-  // Initialize RbNode data.
-  node->node[0] = NULL;
-  node->node[1] = NULL;
-  node->red = 1;
-  node->mem = vmem;
-
   // Initialize MemNode data.
   node->prev = NULL;
   node->next = NULL;
 
+  node->mem = vmem;
   node->size = vsize;
   node->blocks = blocks;
   node->density = density;
   node->used = 0;
-  node->largestBlock = vsize;
+  node->rw = rw;
+  node->arena = arena;
+  node->heap = heap;
 
-  memset(data, 0, bsize * 2);
+  memset(data, 0, bsize * 2 + rsize);
   node->baUsed = reinterpret_cast<size_t*>(data);
   node->baCont = reinterpret_cast<size_t*>(data + bsize);
+  node->runs = reinterpret_cast<MemRun**>(data + bsize * 2);
+
+  node->trampolines = NULL;
+  node->trampolinesUsed = 0;
 
   return node;
 }
 
-void* MemoryManagerPrivate::allocPermanent(size_t vsize) ASMJIT_NOTHROW
+// Free virtual memory of @a node (but not the node itself).
+void MemoryManagerPrivate::freeNodeMemory(MemNode* node) ASMJIT_NOTHROW
+{
+  if (node->arena)
+    freeArenaSlots(node->arena, node->mem, node->size);
+  else
+    freeVirtualMemory(node->mem, node->rw, node->size);
+}
+
+void* MemoryManagerPrivate::allocPermanent(size_t vsize, size_t alignment) ASMJIT_NOTHROW
 {
   static const size_t permanentAlignment = 32;
-  static const size_t permanentNodeSize  = 32768;
+  static const size_t permanentNodeSize  = 65536;
 
-  size_t over = vsize % permanentAlignment;
-  if (over)
-    over = permanentAlignment - over;
+  if (alignment < permanentAlignment)
+    alignment = permanentAlignment;
 
-  size_t alignedSize = vsize + over;
-  AutoLock locked(_lock);
+  size_t alignedSize = IntUtil::roundUp<size_t>(vsize, permanentAlignment);
 
-  PermanentNode* node = _permanent;
+  // Allocate from the node owned by the calling thread, no other thread
+  // changes it.
+  MemThreadCache* cache = _useThreadCache ? getThreadCache() : NULL;
+  PermanentNode* node = (cache != NULL) ? cache->permanent : NULL;
 
-  // Try to find space in allocated chunks.
-  while (node && alignedSize > node->getAvailable()) node = node->prev;
+  if (node != NULL && IntUtil::roundUp<size_t>(node->used, alignment) + alignedSize <= node->size)
+    return _bumpPermanent(node, alignedSize, alignment);
 
-  // Or allocate new node.
-  if (node == NULL)
-  {
+  AutoLock locked(_lock);
+
+  // Give up the full node, its tail can be used by other threads.
+  if (node != NULL)
+  {
+    node->owner = NULL;
+    cache->permanent = NULL;
+  }
+
+  node = _permanent;
+
+  // Try to find space in allocated chunks not owned by other threads.
+  while (node && (node->owner != NULL || IntUtil::roundUp<size_t>(node->used, alignment) + alignedSize > node->size)) node = node->prev;
+
+  // Or allocate new node.
+  if (node == NULL)
+  {
     size_t nodeSize = permanentNodeSize;
     if (vsize > nodeSize) nodeSize = vsize;
 
@@ -435,7 +1115,7 @@ void* MemoryManagerPrivate::allocPermanent(size_t vsize) ASMJIT_NOTHROW
     // Out of memory.
     if (node == NULL) return NULL;
 
-    node->mem = allocVirtualMemory(nodeSize, &node->size);
+    node->mem = allocVirtualMemory(nodeSize, &node->size, &node->rw);
     // Out of memory.
     if (node->mem == NULL) 
     {
@@ -444,123 +1124,178 @@ void* MemoryManagerPrivate::allocPermanent(size_t vsize) ASMJIT_NOTHROW
     }
 
     node->used = 0;
+    node->owner = NULL;
     node->prev = _permanent;
     _permanent = node;
   }
 
-  // Finally, copy function code to our space we reserved for.
-  uint8_t* result = node->mem + node->used;
+  // The thread allocates from the node until it's full.
+  if (cache != NULL)
+  {
+    node->owner = cache;
+    cache->permanent = node;
+  }
+
+  return _bumpPermanent(node, alignedSize, alignment);
+}
+
+// Allocate @a alignedSize bytes at the end of used space of permanent @a node
+// (there must be enough space), called with the lock held or by the owner of
+// the node.
+void* MemoryManagerPrivate::_bumpPermanent(PermanentNode* node, size_t alignedSize, size_t alignment) ASMJIT_NOTHROW
+{
+  // Finally, copy function code to our space we reserved for (the padding
+  // before is wasted).
+  size_t offset = IntUtil::roundUp<size_t>(node->used, alignment);
+  uint8_t* result = node->mem + offset;
 
   // Update Statistics.
-  node->used += alignedSize;
-  _used += alignedSize;
+  _AtomicAdd(&_used, offset + alignedSize - node->used);
+  node->used = offset + alignedSize;
 
   // Code can be null to only reserve space for code.
   return (void*)result;
 }
 
-void* MemoryManagerPrivate::allocFreeable(size_t vsize) ASMJIT_NOTHROW
+void* MemoryManagerPrivate::allocFreeable(size_t vsize, size_t alignment) ASMJIT_NOTHROW
 {
-  size_t i;               // Current index.
-  size_t need;            // How many we need to be freed.
-  size_t minVSize;
-
-  // Align to 32 bytes (our default alignment).
-  vsize = (vsize + 31) & ~(size_t)31;
   if (vsize == 0) return NULL;
 
-  AutoLock locked(_lock);
-  MemNode* node = _optimal;
-
-  minVSize = _newChunkSize;
+  // How many blocks we need, each block is aligned to density.
+  size_t need = M_DIV((vsize + _newChunkDensity - 1), _newChunkDensity);
 
-  // Try to find memory block in existing nodes.
-  while (node)
+  if (_useThreadCache && need <= kMemCacheClasses && alignment <= _newChunkDensity)
   {
-    // Skip this node?
-    if ((node->getAvailable() < vsize) || 
-        (node->largestBlock < vsize && node->largestBlock != 0))
+    MemThreadCache* cache = getThreadCache();
+
+    if (cache != NULL)
     {
-      MemNode* next = node->next;
-      if (node->getAvailable() < minVSize && node == _optimal && next) _optimal = next;
-      node = next;
-      continue;
+      size_t& count = cache->count[need - 1];
+      if (count != 0)
+        return cache->magazines[need - 1][--count];
+
+      AutoLock locked(_lock);
+      return refillCache(cache, need);
     }
+  }
 
-    size_t* up = node->baUsed;    // Current ubits address.
-    size_t ubits;                 // Current ubits[0] value.
-    size_t bit;                   // Current bit mask.
-    size_t blocks = node->blocks; // Count of blocks in node.
-    size_t cont = 0;              // How many bits are currently freed in find loop.
-    size_t maxCont = 0;           // Largest continuous block (bits count).
-    size_t j;
+  AutoLock locked(_lock);
+  return _allocFreeable(&_heap, need, alignment);
+}
 
-    need = M_DIV((vsize + node->density - 1), node->density);
-    i = 0;
+void* MemoryManagerPrivate::allocNear(size_t vsize, const void* hint, size_t alignment) ASMJIT_NOTHROW
+{
+  if (vsize == 0) return NULL;
 
-    // Try to find node that is large enough.
-    while (i < blocks)
-    {
-      ubits = *up++;
+  size_t need = M_DIV((vsize + _newChunkDensity - 1), _newChunkDensity);
 
-      // Fast skip used blocks.
-      if (ubits == ~(size_t)0)
-      { 
-        if (cont > maxCont) maxCont = cont;
-        cont = 0;
+  AutoLock locked(_lock);
 
-        i += BITS_PER_ENTITY;
-        continue;
-      }
+  // The whole reserved region can be near, then all nodes are.
+  MemHeap* heap = isRegionNear(hint) ? &_heap : getNearHeap(hint);
+  if (heap == NULL) return NULL;
 
-      size_t max = BITS_PER_ENTITY;
-      if (i + max > blocks) max = blocks - i;
+  return _allocFreeable(heap, need, alignment);
+}
 
-      for (j = 0, bit = 1; j < max; bit <<= 1)
-      {
-        j++;
-        if ((ubits & bit) == 0)
-        {
-          if (++cont == need) { i += j; i -= cont; goto _Found; }
-          continue;
-        }
-
-        if (cont > maxCont) maxCont = cont;
-        cont = 0;
-      }
+void* MemoryManagerPrivate::allocOnNumaNode(size_t vsize, uint32_t numaNode, size_t alignment) ASMJIT_NOTHROW
+{
+  if (vsize == 0) return NULL;
 
-      i += BITS_PER_ENTITY;
-    }
+  size_t need = M_DIV((vsize + _newChunkDensity - 1), _newChunkDensity);
+
+  AutoLock locked(_lock);
 
-    // Because we traversed entire node, we can set largest node size that
-    // will be used to cache next traversing..
-    node->largestBlock = maxCont * node->density;
+  MemHeap* heap = getNumaHeap(numaNode);
+  if (heap == NULL) return NULL;
 
-    node = node->next;
-  }
+  return _allocFreeable(heap, need, alignment);
+}
+
+void* MemoryManagerPrivate::_allocFreeable(MemHeap* heap, size_t need, size_t alignment) ASMJIT_NOTHROW
+{
+  size_t i;               // Index of the first allocated block.
+
+  // Blocks are aligned to density, larger alignment needs extra blocks to
+  // align the first one.
+  size_t extra = (alignment > _newChunkDensity) ? alignment / _newChunkDensity - 1 : 0;
+  size_t total = need + extra;
+
+  // Blocks freed without the lock can contain the run we need.
+  if (_freed != NULL) drainFreed();
+
+  MemNode* node;
+  MemRun* run = findRun(heap, total);
 
-  // If we are here, we failed to find existing memory block and we must
-  // allocate new.
+  if (run != NULL)
   {
+    node = run->node;
+    i = takeRun(run, total);
+
+    // Empty node is not retained anymore.
+    if (node->used == 0)
+      _retained -= node->size;
+  }
+  else
+  {
+    // If we are here, there is no free run large enough and we must allocate
+    // a new node.
     size_t chunkSize = _newChunkSize;
-    if (chunkSize < vsize) chunkSize = vsize;
+    if (chunkSize < total * _newChunkDensity) chunkSize = total * _newChunkDensity;
 
-    node = createNode(chunkSize, _newChunkDensity);
+    node = createNode(heap, chunkSize, _newChunkDensity);
     if (node == NULL) return NULL;
 
-    // Update binary tree.
-    insertNode(node);
-    ASMJIT_ASSERT(checkTree());
+    // Update page map.
+    if (!insertNode(node))
+    {
+      freeNodeMemory(node);
+      ASMJIT_FREE(node->baUsed);
+      ASMJIT_FREE(node);
+      return NULL;
+    }
 
-    // Alloc first node at start.
+    // Alloc first block at start, the remaining blocks form the first free
+    // run of the node.
     i = 0;
-    need = (vsize + node->density - 1) / node->density;
+
+    if (total < node->blocks)
+    {
+      run = newRun();
+      if (run == NULL)
+      {
+        removeNode(node);
+        freeNodeMemory(node);
+        ASMJIT_FREE(node->baUsed);
+        ASMJIT_FREE(node);
+        return NULL;
+      }
+
+      run->node = node;
+      run->start = total;
+      run->blocks = node->blocks - total;
+      linkRun(run);
+    }
 
     // Update statistics.
     _allocated += node->size;
   }
 
-_Found:
+  // Return the extra blocks before and after the aligned ones to the free
+  // runs (node memory is aligned to the page size).
+  if (extra != 0)
+  {
+    size_t density = node->density;
+    size_t aligned = IntUtil::roundUp<size_t>(i * density, alignment) / density;
+
+    if (aligned > i)
+      addFreeBlocks(node, i, aligned - i);
+    if (i + extra > aligned)
+      addFreeBlocks(node, aligned + need, i + extra - aligned);
+
+    i = aligned;
+  }
+
   // Update bits.
   _SetBits(node->baUsed, i, need);
   _SetBits(node->baCont, i, need - 1);
@@ -569,475 +1304,1570 @@ _Found:
   {
     size_t u = need * node->density;
     node->used += u;
-    node->largestBlock = 0;
-    _used += u;
+    _AtomicAdd(&_used, u);
   }
 
+  ASMJIT_ASSERT(checkNode(node));
+
   // And return pointer to allocated memory.
   uint8_t* result = node->mem + i * node->density;
-  ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - vsize);
+  ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - need * _newChunkDensity);
   return result;
 }
 
-bool MemoryManagerPrivate::free(void* address) ASMJIT_NOTHROW
+// ============================================================================
+// [AsmJit::MemoryManagerPrivate - Free Runs]
+// ============================================================================
+
+MemRun* MemoryManagerPrivate::newRun() ASMJIT_NOTHROW
 {
-  if (address == NULL) return true;
+  MemRun* run = _unusedRuns;
 
-  AutoLock locked(_lock);
+  if (run != NULL)
+  {
+    _unusedRuns = run->next;
+    return run;
+  }
 
-  MemNode* node = findPtr((uint8_t*)address);
-  if (node == NULL)
-    return false;
+  MemRunChunk* chunk = reinterpret_cast<MemRunChunk*>(ASMJIT_MALLOC(sizeof(MemRunChunk)));
+  if (chunk == NULL) return NULL;
 
-  size_t offset = (size_t)((uint8_t*)address - (uint8_t*)node->mem);
-  size_t bitpos = M_DIV(offset, node->density);
-  size_t i = (bitpos / BITS_PER_ENTITY);
+  chunk->prev = _runChunks;
+  _runChunks = chunk;
 
-  size_t* up = node->baUsed + i;  // Current ubits address.
-  size_t* cp = node->baCont + i;  // Current cbits address.
-  size_t ubits = *up;             // Current ubits[0] value.
-  size_t cbits = *cp;             // Current cbits[0] value.
-  size_t bit = (size_t)1 << (bitpos % BITS_PER_ENTITY);
+  // Use the first run, all others are unused.
+  for (size_t i = MemRunChunk::kRunsPerChunk - 1; i > 0; i--)
+    deleteRun(&chunk->runs[i]);
+  return &chunk->runs[0];
+}
 
-  size_t cont = 0;
-  bool stop;
+void MemoryManagerPrivate::linkRun(MemRun* run) ASMJIT_NOTHROW
+{
+  MemHeap* heap = run->node->heap;
+  size_t bin = _GetBin(run->blocks);
+  MemRun* next = heap->bins[bin];
 
-  for (;;)
-  {
-    stop = (cbits & bit) == 0;
-    ubits &= ~bit;
-    cbits &= ~bit;
+  run->prev = NULL;
+  run->next = next;
+  if (next) next->prev = run;
 
-    bit <<= 1;
-    cont++;
+  heap->bins[bin] = run;
+  heap->binMask[bin / 32] |= IntUtil::maskFromIndex((uint32_t)(bin % 32));
 
-    if (stop || bit == 0)
-    {
-      *up = ubits;
-      *cp = cbits;
-      if (stop) break;
+  // Update the free runs index of the node.
+  MemRun** runs = run->node->runs;
+  runs[run->start] = run;
+  runs[run->start + run->blocks - 1] = run;
+}
 
-      ubits = *++up;
-      cbits = *++cp;
-      bit = 1;
-    }
-  }
+void MemoryManagerPrivate::unlinkRun(MemRun* run) ASMJIT_NOTHROW
+{
+  MemRun* prev = run->prev;
+  MemRun* next = run->next;
 
-  // If the freed block is fully allocated node then it's needed to 
-  // update 'optimal' pointer in memory manager.
-  if (node->used == node->size)
+  if (next) next->prev = prev;
+  if (prev)
+  {
+    prev->next = next;
+  }
+  else
   {
-    MemNode* cur = _optimal;
+    MemHeap* heap = run->node->heap;
+    size_t bin = _GetBin(run->blocks);
+    ASMJIT_ASSERT(heap->bins[bin] == run);
 
-    do {
-      cur = cur->prev;
-      if (cur == node) { _optimal = node; break; }
-    } while (cur);
+    heap->bins[bin] = next;
+    if (next == NULL)
+      heap->binMask[bin / 32] &= ~IntUtil::maskFromIndex((uint32_t)(bin % 32));
   }
 
-  // Statistics.
-  cont *= node->density;
-  if (node->largestBlock < cont) node->largestBlock = cont;
-  node->used -= cont;
-  _used -= cont;
+  // Update the free runs index of the node.
+  MemRun** runs = run->node->runs;
+  runs[run->start] = NULL;
+  runs[run->start + run->blocks - 1] = NULL;
+}
 
-  // If page is empty, we can free it.
-  if (node->used == 0)
-  {
-    // Free memory associated with node (this memory is not accessed
-    // anymore so it's safe).
-    freeVirtualMemory(node->mem, node->size);
-    ASMJIT_FREE(node->baUsed);
+// Check whether the free runs index matches bit arrays of @a node.
+bool MemoryManagerPrivate::checkNode(MemNode* node) ASMJIT_NOTHROW
+{
+  size_t blocks = node->blocks;
+  size_t words = (blocks + BITS_PER_ENTITY - 1) / BITS_PER_ENTITY;
+  size_t used = 0;
+  size_t i;
+
+  for (i = 0; i < words; i++)
+    used += _BitCount(node->baUsed[i]);
+
+  // Blocks freed without the lock are cleared in the bit arrays before they
+  // are returned to the free runs (and subtracted from node->used), other
+  // threads can free them while the node is checked.
+  if (used * node->density > node->used)
+    return false;
 
-    node->baUsed = NULL;
-    node->baCont = NULL;
+  // Each free run must describe unused blocks only.
+  i = 0;
+  while (i < blocks)
+  {
+    MemRun* run = node->runs[i];
+    if (run == NULL) { i++; continue; }
 
-    // Statistics.
-    _allocated -= node->size;
+    size_t end = i + run->blocks;
+    if (run->node != node || run->start != i || end > blocks ||
+        node->runs[end - 1] != run || _FindBit(node->baUsed, i, end, true) != end)
+    {
+      return false;
+    }
 
-    // Remove node. This function can return different node than
-    // passed into, but data is copied into previous node if needed.
-    ASMJIT_FREE(removeNode(node));
-    ASMJIT_ASSERT(checkTree());
+    i = end;
   }
 
   return true;
 }
 
-bool MemoryManagerPrivate::shrink(void* address, size_t used) ASMJIT_NOTHROW
+MemHeap* MemoryManagerPrivate::getNearHeap(const void* hint) ASMJIT_NOTHROW
 {
-  if (address == NULL) return false;
-  if (used == 0) return free(address);
+  // Center of the region where hint is.
+  size_t region = ((size_t)hint >> kMemNearRegionShift) << kMemNearRegionShift;
+  uint8_t* near = (uint8_t*)(region + ((size_t)1 << (kMemNearRegionShift - 1)));
 
-  AutoLock locked(_lock);
+  MemHeap* heap;
+  for (heap = _nearHeaps; heap != NULL; heap = heap->next)
+  {
+    if (heap->near == near)
+      return heap;
+  }
 
-  MemNode* node = findPtr((uint8_t*)address);
-  if (node == NULL)
-    return false;
+  heap = reinterpret_cast<MemHeap*>(ASMJIT_MALLOC(sizeof(MemHeap)));
+  if (heap == NULL) return NULL;
 
-  size_t offset = (size_t)((uint8_t*)address - (uint8_t*)node->mem);
-  size_t bitpos = M_DIV(offset, node->density);
-  size_t i = (bitpos / BITS_PER_ENTITY);
+  memset(heap, 0, sizeof(MemHeap));
+  heap->near = near;
+  heap->numaNode = kMemNumaAny;
+  heap->next = _nearHeaps;
+  _nearHeaps = heap;
 
-  size_t* up = node->baUsed + i;  // Current ubits address.
-  size_t* cp = node->baCont + i;  // Current cbits address.
-  size_t ubits = *up;             // Current ubits[0] value.
-  size_t cbits = *cp;             // Current cbits[0] value.
-  size_t bit = (size_t)1 << (bitpos % BITS_PER_ENTITY);
+  return heap;
+}
 
-  size_t cont = 0;
-  size_t usedBlocks = (used + node->density - 1) / node->density;
+MemHeap* MemoryManagerPrivate::getNumaHeap(uint32_t numaNode) ASMJIT_NOTHROW
+{
+  MemHeap* heap;
+  for (heap = _numaHeaps; heap != NULL; heap = heap->next)
+  {
+    if (heap->numaNode == numaNode)
+      return heap;
+  }
 
-  bool stop;
+  heap = reinterpret_cast<MemHeap*>(ASMJIT_MALLOC(sizeof(MemHeap)));
+  if (heap == NULL) return NULL;
 
-  // Find the first block we can mark as free.
-  for (;;)
-  {
-    stop = (cbits & bit) == 0;
-    if (stop) return true;
+  memset(heap, 0, sizeof(MemHeap));
+  heap->numaNode = numaNode;
+  heap->next = _numaHeaps;
+  _numaHeaps = heap;
 
-    if (++cont == usedBlocks) break;
+  return heap;
+}
 
-    bit <<= 1;
-    if (bit == 0)
-    {
-      ubits = *++up;
-      cbits = *++cp;
-      bit = 1;
-    }
-  }
+MemRun* MemoryManagerPrivate::findRun(MemHeap* heap, size_t need) ASMJIT_NOTHROW
+{
+  size_t bin = _GetBin(need);
+  MemRun* run;
 
-  // Free the tail blocks.
-  cont = ~(size_t)0;
-  goto _EnterFreeLoop;
+  // Exact bins contain only runs which fit.
+  if (bin < kMemBinExact && (run = heap->bins[bin]) != NULL)
+    return run;
+
+  // Every run in any of the following bins is large enough, take the first
+  // non-empty bin (the smallest runs).
+  size_t w = (bin + 1) / 32;
+  uint32_t mask = heap->binMask[w] & ~IntUtil::maskUpToIndex((uint32_t)((bin + 1) % 32));
 
   for (;;)
   {
-    stop = (cbits & bit) == 0;
-    ubits &= ~bit;
-_EnterFreeLoop:
-    cbits &= ~bit;
+    if (mask != 0)
+      return heap->bins[w * 32 + IntUtil::findFirstBit(mask)];
 
-    bit <<= 1;
-    cont++;
+    if (++w >= kMemBinMaskCount) break;
+    mask = heap->binMask[w];
+  }
 
-    if (stop || bit == 0)
+  // Power-of-2 bin can contain runs that are smaller than the request.
+  if (bin >= kMemBinExact)
+  {
+    for (run = heap->bins[bin]; run != NULL; run = run->next)
     {
-      *up = ubits;
-      *cp = cbits;
-      if (stop) break;
-
-      ubits = *++up;
-      cbits = *++cp;
-      bit = 1;
+      if (run->blocks >= need)
+        return run;
     }
   }
 
-  // Statistics.
-  cont *= node->density;
-  if (node->largestBlock < cont) node->largestBlock = cont;
-  node->used -= cont;
-  _used -= cont;
-
-  return true;
+  return NULL;
 }
 
-void MemoryManagerPrivate::freeAll(bool keepVirtualMemory) ASMJIT_NOTHROW
+size_t MemoryManagerPrivate::takeRun(MemRun* run, size_t need) ASMJIT_NOTHROW
 {
-  MemNode* node = _first;
+  size_t start = run->start;
+  ASMJIT_ASSERT(run->blocks >= need);
 
-  while (node)
+  unlinkRun(run);
+
+  if (run->blocks == need)
   {
-    MemNode* next = node->next;
-  
-    if (!keepVirtualMemory)
-      freeVirtualMemory(node->mem, node->size);
+    deleteRun(run);
+  }
+  else
+  {
+    // Put the rest of the run back.
+    run->start += need;
+    run->blocks -= need;
+    linkRun(run);
+  }
 
-    ASMJIT_FREE(node->baUsed);
-    ASMJIT_FREE(node);
+  return start;
+}
 
-    node = next;
-  }
+// Return blocks to the free runs, coalescing them with the neighbor runs.
+// Returns the run containing the blocks or NULL if out of memory.
+MemRun* MemoryManagerPrivate::addFreeBlocks(MemNode* node, size_t index, size_t count) ASMJIT_NOTHROW
+{
+  MemRun** runs = node->runs;
+  size_t end = index + count;
 
-  _allocated = 0;
-  _used = 0;
+  // Only the last block of a free run points to it, so if the previous block
+  // is in the index, it's a free run that ends just before the freed blocks.
+  // The same applies to the following block and a start of the free run.
+  MemRun* left = (index > 0) ? runs[index - 1] : NULL;
+  MemRun* right = (end < node->blocks) ? runs[end] : NULL;
 
-  _root = NULL;
-  _first = NULL;
-  _last = NULL;
-  _optimal = NULL;
+  if (left != NULL)
+  {
+    unlinkRun(left);
+    left->blocks += count;
+
+    if (right != NULL)
+    {
+      unlinkRun(right);
+      left->blocks += right->blocks;
+      deleteRun(right);
+    }
+
+    linkRun(left);
+    return left;
+  }
+  else if (right != NULL)
+  {
+    unlinkRun(right);
+    right->start = index;
+    right->blocks += count;
+    linkRun(right);
+    return right;
+  }
+  else
+  {
+    MemRun* run = newRun();
+    if (run == NULL) return NULL;
+
+    run->node = node;
+    run->start = index;
+    run->blocks = count;
+    linkRun(run);
+    return run;
+  }
 }
 
 // ============================================================================
-// [AsmJit::MemoryManagerPrivate - NodeList RB-Tree]
+// [AsmJit::MemoryManagerPrivate - Free]
 // ============================================================================
 
-static int rbAssert(MemNode* root)
+bool MemoryManagerPrivate::free(void* address) ASMJIT_NOTHROW
 {
-  if (root == NULL) return 1;
-
-  MemNode* ln = root->node[0];
-  MemNode* rn = root->node[1];
+  if (address == NULL) return true;
 
-  // Red violation.
-  ASMJIT_ASSERT( !(isRed(root) && (isRed(ln) || isRed(rn))) );
+  if (_useThreadCache)
+  {
+    MemThreadCache* cache = getThreadCache();
 
-  int lh = rbAssert(ln);
-  int rh = rbAssert(rn);
+    // The address is verified when the pending blocks are returned to the
+    // memory manager, so the invalid address can't be reported here. Only
+    // double free of the block cached by the thread is caught (debug).
+    if (cache != NULL)
+    {
+      ASMJIT_ASSERT(!_IsCached(cache, address));
+      cache->pending[cache->pendingCount++] = address;
 
-  // Invalid btree.
-  ASMJIT_ASSERT(ln == NULL || ln->mem < root->mem);
-  ASMJIT_ASSERT(rn == NULL || rn->mem > root->mem);
+      if (cache->pendingCount == kMemCacheCapacity)
+      {
+        AutoLock locked(_lock);
+        flushCache(cache);
+      }
+      return true;
+    }
+  }
 
-  // Black violation.
-  ASMJIT_ASSERT( !(lh != 0 && rh != 0 && lh != rh) );
+  // The link of freed blocks can't be stored into memory of other process
+  // and nodes above the page map are found only by traversing the list of
+  // nodes, which needs the lock.
+#if defined(ASMJIT_WINDOWS)
+  if (_hProcess == GetCurrentProcess() && !_IsAboveMap(address))
+#else
+  if (!_IsAboveMap(address))
+#endif // ASMJIT_WINDOWS
+    return freeLockFree(address);
 
-  // Only count black links.
-  if (lh != 0 && rh != 0)
-    return isRed(root) ? lh : lh + 1;
-  else
-    return 0;
+  AutoLock locked(_lock);
+  return _free(address);
 }
 
-static inline MemNode* rbRotateSingle(MemNode* root, int dir)
+bool MemoryManagerPrivate::_free(void* address) ASMJIT_NOTHROW
 {
-  MemNode* save = root->node[!dir];
-
-  root->node[!dir] = save->node[dir];
-  save->node[dir] = root;
+  MemNode* node;
+  size_t bitpos;
+  size_t cont = findBlocks(address, &node, &bitpos);
 
-  root->red = 1;
-  save->red = 0;
+  // Double free or not allocated address.
+  if (cont == 0)
+    return false;
 
-  return save;
+  freeBlocks(node, bitpos, cont);
+  return true;
 }
 
-static inline MemNode* rbRotateDouble(MemNode* root, int dir)
+bool MemoryManagerPrivate::freeLockFree(void* address) ASMJIT_NOTHROW
 {
-  root->node[!dir] = rbRotateSingle(root->node[!dir], !dir);
-  return rbRotateSingle(root, dir);
-}
+  // The node of allocated block can't be released (its used bytes include
+  // the block until it's drained), only the invalid address can point to
+  // a node released meanwhile. Nodes above the page map are found by walking
+  // the list of nodes, which is only possible with the lock held.
+  ASMJIT_ASSERT(!_IsAboveMap((uint8_t*)address));
 
-bool MemoryManagerPrivate::checkTree() ASMJIT_NOTHROW
-{
-  return rbAssert(_root) > 0;
+  MemNode* node = findPtr((uint8_t*)address);
+  if (node == NULL)
+    return false;
+
+  size_t offset = (size_t)((uint8_t*)address - (uint8_t*)node->mem);
+  size_t bitpos = M_DIV(offset, node->density);
+  size_t mask = (size_t)1 << (bitpos % BITS_PER_ENTITY);
+
+  // Only one thread can clear the used bit of the first block, the others
+  // found double free or not allocated address.
+  if ((_AtomicAnd(&node->baUsed[bitpos / BITS_PER_ENTITY], ~mask) & mask) == 0)
+    return false;
+
+  // Continue bits of the allocation can't be changed by other threads.
+  size_t cont = _FindBit(node->baCont, bitpos, node->blocks, false) - bitpos + 1;
+
+  _ClearBits(node->baUsed, bitpos + 1, cont - 1);
+  _ClearBits(node->baCont, bitpos, cont - 1);
+  _AtomicSub(&_used, cont * node->density);
+
+  // Push the blocks to the list of freed blocks. The list is only taken as a
+  // whole by drainFreed(), so the head can't be reused while pushing.
+  uint8_t* block = node->mem + bitpos * node->density;
+  MemFreed* freed = reinterpret_cast<MemFreed*>(node->rw + bitpos * node->density);
+  uint8_t* head;
+
+  freed->blocks = cont;
+  do {
+    head = (uint8_t*)_AtomicLoad((volatile size_t*)&_freed);
+    freed->next = head;
+  } while (_AtomicCompareExchange((volatile size_t*)&_freed, (size_t)head, (size_t)block) != (size_t)head);
+
+  if (_AtomicAdd(&_freedCount, 1) + 1 == kMemFreedThreshold)
+  {
+    AutoLock locked(_lock);
+    drainFreed();
+  }
+
+  return true;
 }
 
-void MemoryManagerPrivate::insertNode(MemNode* node) ASMJIT_NOTHROW
+// Return blocks freed without the lock to the free runs.
+void MemoryManagerPrivate::drainFreed() ASMJIT_NOTHROW
 {
-  if (_root == NULL)
+  uint8_t* block = (uint8_t*)_AtomicExchange((volatile size_t*)&_freed, 0);
+  size_t count = 0;
+
+  while (block != NULL)
   {
-    // Empty tree case.
-    _root = node;
+    MemNode* node = findPtr(block);
+    size_t offset = (size_t)(block - node->mem);
+
+    // The node can be released by returnBlocks().
+    MemFreed* freed = reinterpret_cast<MemFreed*>(node->rw + offset);
+    uint8_t* next = freed->next;
+
+    returnBlocks(node, M_DIV(offset, node->density), freed->blocks);
+
+    block = next;
+    count++;
   }
-  else
-  {
-    // False tree root.
-    RbNode<MemNode> head = {0};
 
-    // Grandparent & parent.
-    MemNode* g = NULL;
-    MemNode* t = reinterpret_cast<MemNode*>(&head);
+  if (count != 0)
+    _AtomicSub(&_freedCount, count);
+}
+
+// Get count of blocks of allocation at @a address and its node and index of
+// the first block. Returns zero if @a address wasn't allocated.
+size_t MemoryManagerPrivate::findBlocks(void* address, MemNode** pNode, size_t* pIndex) ASMJIT_NOTHROW
+{
+  MemNode* node = findPtr((uint8_t*)address);
+  if (node == NULL)
+    return 0;
 
-    // Iterator & parent.
-    MemNode* p = NULL;
-    MemNode* q = t->node[1] = _root;
+  size_t offset = (size_t)((uint8_t*)address - (uint8_t*)node->mem);
+  size_t bitpos = M_DIV(offset, node->density);
 
-    int dir = 0, last;
+  if ((node->baUsed[bitpos / BITS_PER_ENTITY] & ((size_t)1 << (bitpos % BITS_PER_ENTITY))) == 0)
+    return 0;
 
-    // Search down the tree.
-    for (;;)
-    {
-      if (q == NULL)
-      {
-        // Insert new node at the bottom.
-        q = node;
-        p->node[dir] = node;
-      }
-      else if (isRed(q->node[0]) && isRed(q->node[1]))
-      {
-        // Color flip.
-        q->red = 1;
-        q->node[0]->red = 0;
-        q->node[1]->red = 0;
-      }
+  *pNode = node;
+  *pIndex = bitpos;
 
-      // Fix red violation.
-      if (isRed(q) && isRed(p))
-      {
-        int dir2 = t->node[1] == g;
-        t->node[dir2] = (q == p->node[last]) ? rbRotateSingle(g, !last) : rbRotateDouble(g, !last);
-      }
+  // The last block of the allocation is the first one without continue bit.
+  return _FindBit(node->baCont, bitpos, node->blocks, false) - bitpos + 1;
+}
 
-      // Stop if found.
-      if (q == node) break;
+void MemoryManagerPrivate::freeBlocks(MemNode* node, size_t bitpos, size_t cont) ASMJIT_NOTHROW
+{
+  _ClearBits(node->baUsed, bitpos, cont);
+  _ClearBits(node->baCont, bitpos, cont);
+  _AtomicSub(&_used, cont * node->density);
 
-      last = dir;
-      dir = q->mem < node->mem;
+  returnBlocks(node, bitpos, cont);
+}
 
-      // Update helpers.
-      if (g != NULL) t = g;
-      g = p;
-      p = q;
-      q = q->node[dir];
-    }
+// Return blocks already cleared in the bit arrays to the free runs and
+// release the node if it's empty.
+void MemoryManagerPrivate::returnBlocks(MemNode* node, size_t bitpos, size_t cont) ASMJIT_NOTHROW
+{
+  // If there is no memory for the new run, the blocks are lost until the
+  // whole node is released.
+  MemRun* run = addFreeBlocks(node, bitpos, cont);
 
-    // Update root.
-    _root = head.node[1];
-  }
+  // Statistics.
+  node->used -= cont * node->density;
 
-  // Make root black.
-  _root->red = 0;
+  ASMJIT_ASSERT(checkNode(node));
 
-  // Link with others.
-  node->prev = _last;
+  // If only shared trampolines remain, nothing can call them anymore.
+  if (node->used == node->trampolinesUsed && node->trampolines != NULL)
+    freeTrampolines(node);
 
-  if (_first == NULL)
+  if (node->used != 0)
   {
-    _first = node;
-    _last = node;
-    _optimal = node;
+    if (run != NULL) discardBlocks(node, run, bitpos, cont);
+    return;
   }
+
+  // If page is empty, we can free it, unless it fits into the memory kept
+  // for the next allocations.
+  if (_retained + node->size <= _retainThreshold)
+    _retained += node->size;
   else
-  {
-    node->prev = _last;
-    _last->next = node;
-    _last = node;
-  }
+    releaseNode(node);
 }
 
-MemNode* MemoryManagerPrivate::removeNode(MemNode* node) ASMJIT_NOTHROW
+// Free all shared trampolines of @a node.
+void MemoryManagerPrivate::freeTrampolines(MemNode* node) ASMJIT_NOTHROW
 {
-  // False tree root.
-  RbNode<MemNode> head = {0}; 
-
-  // Helpers.
-  MemNode* q = reinterpret_cast<MemNode*>(&head);
-  MemNode* p = NULL;
-  MemNode* g = NULL;
-  // Found item.
-  MemNode* f = NULL;
-  int dir = 1;
-
-  // Set up.
-  q->node[1] = _root;
+  MemTrampolines* block = node->trampolines;
 
-  // Search and push a red down.
-  while (q->node[dir] != NULL)
+  while (block)
   {
-    int last = dir;
+    MemTrampolines* next = block->next;
+    size_t index = (size_t)(block->mem - node->mem) / node->density;
 
-    // Update helpers.
-    g = p;
-    p = q;
-    q = q->node[dir];
-    dir = q->mem < node->mem;
+    _ClearBits(node->baUsed, index, block->blocks);
+    _ClearBits(node->baCont, index, block->blocks);
+    addFreeBlocks(node, index, block->blocks);
 
-    // Save found node.
-    if (q == node) f = q;
+    node->used -= block->blocks * node->density;
+    _AtomicSub(&_used, block->blocks * node->density);
 
-    // Push the red node down.
-    if (!isRed(q) && !isRed(q->node[dir]))
-    {
-      if (isRed(q->node[!dir]))
-      {
-        p = p->node[last] = rbRotateSingle(q, dir);
-      }
-      else if (!isRed(q->node[!dir]))
-      {
-        MemNode* s = p->node[!last];
-
-        if (s != NULL)
-        {
-          if (!isRed(s->node[!last]) && !isRed(s->node[last]))
-          {
-            // Color flip.
-            p->red = 0;
-            s->red = 1;
-            q->red = 1;
-          }
-          else
-          {
-            int dir2 = g->node[1] == p;
-
-            if (isRed(s->node[last]))
-              g->node[dir2] = rbRotateDouble(p, last);
-            else if (isRed(s->node[!last]))
-              g->node[dir2] = rbRotateSingle(p, last);
-
-            // Ensure correct coloring.
-            q->red = g->node[dir2]->red = 1;
-            g->node[dir2]->node[0]->red = 0;
-            g->node[dir2]->node[1]->red = 0;
-          }
-        }
-      }
-    }
+    ASMJIT_FREE(block);
+    block = next;
   }
 
-  // Replace and remove.
-  ASMJIT_ASSERT(f != NULL);
-  ASMJIT_ASSERT(f != reinterpret_cast<MemNode*>(&head));
-  ASMJIT_ASSERT(q != reinterpret_cast<MemNode*>(&head));
+  node->trampolines = NULL;
+  node->trampolinesUsed = 0;
 
-  if (f != q) f->fillData(q);
-  p->node[p->node[1] == q] = q->node[q->node[0] == NULL];
+  ASMJIT_ASSERT(checkNode(node));
+}
 
-  // Update root and make it black.
-  if ((_root = head.node[1]) != NULL) _root->red = 0;
+// Free empty @a node and its virtual memory.
+void MemoryManagerPrivate::releaseNode(MemNode* node) ASMJIT_NOTHROW
+{
+  // Remove all free runs of the node, there is only one unless we were out
+  // of memory when freeing some of its blocks.
+  MemRun** runs = node->runs;
+  for (size_t i = 0; i < node->blocks; )
+  {
+    MemRun* run = runs[i];
+    if (run == NULL) { i++; continue; }
 
-  // Unlink.
-  MemNode* next = q->next;
-  MemNode* prev = q->prev;
+    i += run->blocks;
+    unlinkRun(run);
+    deleteRun(run);
+  }
 
-  if (prev) { prev->next = next; } else { _first = next; }
+  // Free memory associated with node (this memory is not accessed
+  // anymore so it's safe).
+  if (node->arena == NULL)
+    _released += node->size;
+  freeNodeMemory(node);
+  ASMJIT_FREE(node->baUsed);
+
+  node->baUsed = NULL;
+  node->baCont = NULL;
+
+  // Statistics.
+  _allocated -= node->size;
+
+  // Remove node.
+  removeNode(node);
+  ASMJIT_FREE(node);
+}
+
+// Free retained empty nodes until they fit into @a threshold.
+void MemoryManagerPrivate::releaseRetained(size_t threshold) ASMJIT_NOTHROW
+{
+  MemNode* node = _first;
+
+  while (node != NULL && _retained > threshold)
+  {
+    MemNode* next = node->next;
+
+    if (node->used == 0)
+    {
+      _retained -= node->size;
+      releaseNode(node);
+    }
+
+    node = next;
+  }
+}
+
+// Discard pages of large @a node which became unused by freeing blocks
+// [index, index + count) now contained in @a run. Pages shared with used
+// blocks are kept and pages discarded before are not discarded again.
+void MemoryManagerPrivate::discardBlocks(MemNode* node, MemRun* run, size_t index, size_t count) ASMJIT_NOTHROW
+{
+  // Default nodes are released as a whole, discarding part of large page
+  // would split it.
+  if (node->size <= _newChunkSize || (node->arena != NULL && node->arena->largePages)) return;
+
+  size_t pageSize = VirtualMemory::getPageSize();
+  size_t density = node->density;
+
+  // Pages completely inside of the free run.
+  size_t runStart = IntUtil::roundUp<size_t>(run->start * density, pageSize);
+  size_t runEnd = ((run->start + run->blocks) * density) & ~(pageSize - 1);
+
+  // And touching the freed blocks.
+  size_t start = (index * density) & ~(pageSize - 1);
+  size_t end = IntUtil::roundUp<size_t>((index + count) * density, pageSize);
+
+  if (start < runStart) start = runStart;
+  if (end > runEnd) end = runEnd;
+  if (start >= end) return;
+
+  if (discardVirtualMemory(node->mem + start, node->rw + start, end - start))
+    _released += end - start;
+}
+
+bool MemoryManagerPrivate::shrink(void* address, size_t used) ASMJIT_NOTHROW
+{
+  if (address == NULL) return false;
+  if (used == 0) return free(address);
+
+  AutoLock locked(_lock);
+
+  MemNode* node;
+  size_t bitpos;
+  size_t blocks = findBlocks(address, &node, &bitpos);
+
+  // Not allocated address.
+  if (blocks == 0)
+    return false;
+
+  size_t usedBlocks = (used + node->density - 1) / node->density;
+
+  // Nothing to free.
+  if (usedBlocks >= blocks) return true;
+
+  // Free the tail blocks.
+  size_t cont = blocks - usedBlocks;
+
+  _ClearBit(node->baCont, bitpos + usedBlocks - 1);
+  _ClearBits(node->baUsed, bitpos + usedBlocks, cont);
+  _ClearBits(node->baCont, bitpos + usedBlocks, cont);
+
+  // Return tail blocks to the free runs.
+  MemRun* run = addFreeBlocks(node, bitpos + usedBlocks, cont);
+  if (run != NULL) discardBlocks(node, run, bitpos + usedBlocks, cont);
+
+  // Statistics.
+  node->used -= cont * node->density;
+  _AtomicSub(&_used, cont * node->density);
+
+  ASMJIT_ASSERT(checkNode(node));
+  return true;
+}
+
+bool MemoryManagerPrivate::grow(void* address, size_t size) ASMJIT_NOTHROW
+{
+  if (address == NULL) return false;
+
+  AutoLock locked(_lock);
+
+  // Blocks freed without the lock can follow the allocation.
+  if (_freed != NULL) drainFreed();
+
+  MemNode* node;
+  size_t bitpos;
+  size_t blocks = findBlocks(address, &node, &bitpos);
+
+  // Not allocated address.
+  if (blocks == 0)
+    return false;
+
+  size_t usedBlocks = (size + node->density - 1) / node->density;
+
+  // Nothing to allocate.
+  if (usedBlocks <= blocks) return true;
+
+  // The blocks following the allocation must start a free run which is large
+  // enough, the run is then shortened from its start.
+  size_t end = bitpos + blocks;
+  size_t cont = usedBlocks - blocks;
+
+  MemRun* run = (end < node->blocks) ? node->runs[end] : NULL;
+  if (run == NULL || run->start != end || run->blocks < cont)
+    return false;
+
+  takeRun(run, cont);
+
+  _SetBit(node->baCont, end - 1);
+  _SetBits(node->baUsed, end, cont);
+  _SetBits(node->baCont, end, cont - 1);
+
+  // Statistics.
+  node->used += cont * node->density;
+  _AtomicAdd(&_used, cont * node->density);
+
+  ASMJIT_ASSERT(checkNode(node));
+  return true;
+}
+
+void MemoryManagerPrivate::freeAll(bool keepVirtualMemory) ASMJIT_NOTHROW
+{
+  MemNode* node = _first;
+
+  while (node)
+  {
+    MemNode* next = node->next;
+  
+    // Arenas are freed as a whole.
+    if (!keepVirtualMemory && node->arena == NULL)
+      freeVirtualMemory(node->mem, node->rw, node->size);
+
+    MemTrampolines* block = node->trampolines;
+    while (block)
+    {
+      MemTrampolines* nextBlock = block->next;
+      ASMJIT_FREE(block);
+      block = nextBlock;
+    }
+
+    ASMJIT_FREE(node->baUsed);
+    ASMJIT_FREE(node);
+
+    node = next;
+  }
+
+  // All free runs are gone together with their nodes.
+  MemRunChunk* chunk = _runChunks;
+  while (chunk)
+  {
+    MemRunChunk* prev = chunk->prev;
+    ASMJIT_FREE(chunk);
+    chunk = prev;
+  }
+
+  memset(&_heap, 0, sizeof(MemHeap));
+  _heap.numaNode = kMemNumaAny;
+  _unusedRuns = NULL;
+
+  // Freed blocks are gone together with their nodes.
+  _freed = NULL;
+  _freedCount = 0;
+
+  MemHeap* heap = _nearHeaps;
+  while (heap)
+  {
+    MemHeap* next = heap->next;
+    ASMJIT_FREE(heap);
+    heap = next;
+  }
+  _nearHeaps = NULL;
+
+  heap = _numaHeaps;
+  while (heap)
+  {
+    MemHeap* next = heap->next;
+    ASMJIT_FREE(heap);
+    heap = next;
+  }
+  _numaHeaps = NULL;
+  _runChunks = NULL;
+
+  MemArena* arena = _arenas;
+  while (arena)
+  {
+    MemArena* next = arena->next;
+    freeArena(arena, keepVirtualMemory);
+    arena = next;
+  }
+  _arenas = NULL;
+  _region = NULL;
+
+  // Retired and cached blocks are gone too.
+  _retiredCount = 0;
+  _retiredBytes = 0;
+
+  MemThreadCache* cache;
+  for (cache = _caches; cache != NULL; cache = cache->next)
+  {
+    memset(cache->count, 0, sizeof(cache->count));
+    cache->pendingCount = 0;
+  }
+
+  _allocated = 0;
+  _used = 0;
+  _retained = 0;
+
+  freeMap();
+  _first = NULL;
+  _last = NULL;
+}
+
+void* MemoryManagerPrivate::getWritableAddress(void* address) ASMJIT_NOTHROW
+{
+  if (!_dualMapping) return address;
+
+  AutoLock locked(_lock);
+  uint8_t* p = reinterpret_cast<uint8_t*>(address);
+
+  MemNode* node = findPtr(p);
+  if (node != NULL)
+    return node->rw + (size_t)(p - node->mem);
+
+  PermanentNode* permanent;
+  for (permanent = _permanent; permanent != NULL; permanent = permanent->prev)
+  {
+    if (p >= permanent->mem && p < permanent->mem + permanent->size)
+      return permanent->rw + (size_t)(p - permanent->mem);
+  }
+
+  return NULL;
+}
+
+void* MemoryManagerPrivate::getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW
+{
+  if (size > kMemTrampolineSize) return NULL;
+
+  AutoLock locked(_lock);
+
+  MemNode* node = findPtr(reinterpret_cast<uint8_t*>(address));
+  if (node == NULL) return NULL;
+
+  // Trampoline to the same target already exists.
+  MemTrampolines* block;
+  size_t i;
+
+  for (block = node->trampolines; block != NULL; block = block->next)
+  {
+    for (i = 0; i < block->count; i++)
+    {
+      if (block->targets[i] == target)
+        return block->mem + i * kMemTrampolineSize;
+    }
+  }
+
+  // New trampolines are added to the first block, the next block is allocated
+  // from the node when it's full.
+  block = node->trampolines;
+
+  if (block == NULL || block->count == kMemTrampolinesPerBlock)
+  {
+    size_t need = (kMemTrampolineSize * kMemTrampolinesPerBlock + node->density - 1) / node->density;
+    MemRun* run = NULL;
+
+    if (_freed != NULL) drainFreed();
+
+    // Find the first free run of the node large enough.
+    i = 0;
+    while ((i = _FindBit(node->baUsed, i, node->blocks, false)) < node->blocks)
+    {
+      run = node->runs[i];
+      if (run != NULL && run->blocks >= need) break;
+
+      run = NULL;
+      i = _FindBit(node->baUsed, i, node->blocks, true);
+    }
+
+    // Node is full.
+    if (run == NULL) return NULL;
+
+    block = reinterpret_cast<MemTrampolines*>(ASMJIT_MALLOC(sizeof(MemTrampolines)));
+    if (block == NULL) return NULL;
+
+    i = takeRun(run, need);
+
+    _SetBits(node->baUsed, i, need);
+    _SetBits(node->baCont, i, need - 1);
+
+    // Update statistics.
+    {
+      size_t u = need * node->density;
+      node->used += u;
+      node->trampolinesUsed += u;
+      _AtomicAdd(&_used, u);
+    }
+
+    block->mem = node->mem + i * node->density;
+    block->blocks = need;
+    block->count = 0;
+    block->next = node->trampolines;
+    node->trampolines = block;
+
+    ASMJIT_ASSERT(checkNode(node));
+  }
+
+  uint8_t* p = block->mem + block->count * kMemTrampolineSize;
+  memcpy(node->rw + (size_t)(p - node->mem), code, size);
+
+  block->targets[block->count++] = target;
+  return p;
+}
+
+// ============================================================================
+// [AsmJit::MemoryManagerPrivate - Arenas]
+// ============================================================================
+
+// Find the first gap of @a need unused slots in @a arena, returns count of
+// slots if there is no gap large enough.
+static size_t _FindSlots(MemArena* arena, size_t need) ASMJIT_NOTHROW
+{
+  size_t slots = arena->slots;
+  size_t i = 0;
+
+  while ((i = _FindBit(arena->baUsed, i, slots, false)) < slots)
+  {
+    size_t end = _FindBit(arena->baUsed, i, slots, true);
+    if (end - i >= need) break;
+    i = end;
+  }
+
+  return i < slots ? i : slots;
+}
+
+// Allocate memory for node of @a size bytes in arena.
+//
+// Returns pointer to allocated memory and arena where it's placed on success,
+// otherwise NULL.
+uint8_t* MemoryManagerPrivate::allocArenaSlots(MemHeap* heap, size_t size, size_t* vsize, uint8_t** rw, MemArena** pArena) ASMJIT_NOTHROW
+{
+  size_t slotSize = IntUtil::roundUp<size_t>(_newChunkSize, VirtualMemory::getPageSize());
+  size_t need = (size + slotSize - 1) / slotSize;
+  size_t i = 0;
+
+  MemArena* arena;
+  for (arena = _arenas; arena != NULL; arena = arena->next)
+  {
+    if (arena->heap != heap || arena->reserved || arena->slotSize != slotSize || arena->slots - arena->used < need)
+      continue;
+
+    i = _FindSlots(arena, need);
+    if (i < arena->slots) break;
+  }
+
+  if (arena == NULL)
+  {
+    // Arena is larger than default only if the node doesn't fit into it.
+    size_t arenaSize = VirtualMemory::getLargePageSize();
+    if (arenaSize < need * slotSize) arenaSize = need * slotSize;
+
+    arena = createArena(heap, slotSize, arenaSize, false);
+    if (arena == NULL || arena->slots < need) return NULL;
+    i = 0;
+  }
+
+  _SetBits(arena->baUsed, i, need);
+  arena->used += need;
+
+  *vsize = need * slotSize;
+  *rw = arena->rw + i * slotSize;
+  *pArena = arena;
+  return arena->mem + i * slotSize;
+}
+
+uint8_t* MemoryManagerPrivate::allocRegionSlots(size_t size, size_t* vsize, uint8_t** rw, MemArena** pArena) ASMJIT_NOTHROW
+{
+  size_t slotSize = IntUtil::roundUp<size_t>(_newChunkSize, VirtualMemory::getPageSize());
+  size_t need = (size + slotSize - 1) / slotSize;
+
+  // Region is reserved again after freeAll().
+  MemArena* arena = _region;
+  if (arena == NULL)
+  {
+    arena = createArena(&_heap, slotSize, _regionSize, true);
+    if (arena == NULL) return NULL;
+    _region = arena;
+  }
+
+  // Region is full.
+  if (arena->slots - arena->used < need) return NULL;
+
+  size_t i = _FindSlots(arena, need);
+  if (i == arena->slots) return NULL;
+
+  uint8_t* vmem = arena->mem + i * slotSize;
+  if (!VirtualMemory::commit(vmem, need * slotSize, true)) return NULL;
+
+  _SetBits(arena->baUsed, i, need);
+  arena->used += need;
+
+  *vsize = need * slotSize;
+  *rw = vmem;
+  *pArena = arena;
+  return vmem;
+}
+
+// Get whether the whole reserved region is near @a hint.
+bool MemoryManagerPrivate::isRegionNear(const void* hint) ASMJIT_NOTHROW
+{
+  MemArena* arena = _region;
+  if (arena == NULL) return false;
+
+  size_t h = (size_t)hint;
+  size_t start = (size_t)arena->mem;
+  size_t end = start + arena->size;
+
+  size_t distance = (h > start) ? h - start : start - h;
+  if (h < end && end - h > distance) distance = end - h;
+
+  return distance <= (size_t)kMemNearDistance;
+}
+
+void MemoryManagerPrivate::freeArenaSlots(MemArena* arena, uint8_t* vmem, size_t vsize) ASMJIT_NOTHROW
+{
+  size_t i = (size_t)(vmem - arena->mem) / arena->slotSize;
+  size_t count = vsize / arena->slotSize;
+
+  _ClearBits(arena->baUsed, i, count);
+  arena->used -= count;
+
+  // Reserved region is never freed, only its slots are decommitted.
+  if (arena->reserved)
+  {
+    if (VirtualMemory::decommit(vmem, vsize))
+      _released += vsize;
+    return;
+  }
+
+  // Slots of arena backed by large pages are not discarded, it would split
+  // the large page.
+  if (arena->used != 0)
+  {
+    if (!arena->largePages && discardVirtualMemory(vmem, arena->rw + (vmem - arena->mem), vsize))
+      _released += vsize;
+    return;
+  }
+
+  // Keep the last arena of the heap even if it's empty, creating it is
+  // expensive.
+  MemArena* other;
+  for (other = _arenas; other != NULL; other = other->next)
+  {
+    if (other != arena && other->heap == arena->heap)
+      break;
+  }
+
+  if (other != NULL)
+  {
+    MemArena** pPrev = &_arenas;
+    while (*pPrev != arena) pPrev = &(*pPrev)->next;
+    *pPrev = arena->next;
+
+    // Other slots were discarded when freed.
+    _released += arena->largePages ? arena->size : vsize;
+    freeArena(arena, false);
+  }
+}
+
+MemArena* MemoryManagerPrivate::createArena(MemHeap* heap, size_t slotSize, size_t size, bool reserve) ASMJIT_NOTHROW
+{
+  const void* near = heap->near;
+  size_t range = near != NULL ? (size_t)kMemNearRange : 0;
+
+  size_t vsize;
+  void* rw;
+  void* vmem;
+
+  if (reserve)
+  {
+    vmem = VirtualMemory::reserve(size, &vsize);
+    rw = vmem;
+  }
+  else if (_dualMapping)
+  {
+    vmem = VirtualMemory::allocDualMapping(size, &vsize, &rw, _useLargePages, near, range);
+  }
+  else
+  {
+    if (_useLargePages)
+      vmem = VirtualMemory::allocLargePages(size, &vsize, true, near, range);
+    else
+      vmem = VirtualMemory::allocNear(size, &vsize, true, near, range);
+    rw = vmem;
+  }
+
+  // Out of memory.
+  if (vmem == NULL) return NULL;
+
+  // Pages are not touched yet.
+  if (heap->numaNode != kMemNumaAny)
+    VirtualMemory::bindNumaNode(rw, vsize, heap->numaNode);
+
+  size_t slots = vsize / slotSize;
+  size_t bsize = (slots + BITS_PER_ENTITY - 1) / BITS_PER_ENTITY * sizeof(size_t);
+
+  MemArena* arena = reinterpret_cast<MemArena*>(ASMJIT_MALLOC(sizeof(MemArena) + bsize));
+  if (arena == NULL)
+  {
+    if (vmem != rw)
+      VirtualMemory::freeDualMapping(vmem, rw, vsize);
+    else
+      VirtualMemory::free(vmem, vsize);
+    return NULL;
+  }
+
+  arena->mem = reinterpret_cast<uint8_t*>(vmem);
+  arena->rw = reinterpret_cast<uint8_t*>(rw);
+  arena->size = vsize;
+
+  arena->slotSize = slotSize;
+  arena->slots = slots;
+  arena->used = 0;
+  arena->baUsed = reinterpret_cast<size_t*>(arena + 1);
+  memset(arena->baUsed, 0, bsize);
+  arena->largePages = !reserve && _useLargePages;
+  arena->reserved = reserve;
+
+  arena->heap = heap;
+  arena->next = _arenas;
+  _arenas = arena;
+
+  return arena;
+}
+
+void MemoryManagerPrivate::freeArena(MemArena* arena, bool keepVirtualMemory) ASMJIT_NOTHROW
+{
+  if (!keepVirtualMemory)
+  {
+    if (arena->mem != arena->rw)
+      VirtualMemory::freeDualMapping(arena->mem, arena->rw, arena->size);
+    else
+      VirtualMemory::free(arena->mem, arena->size);
+  }
+
+  ASMJIT_FREE(arena);
+}
+
+// ============================================================================
+// [AsmJit::MemoryManagerPrivate - Thread Cache]
+// ============================================================================
+
+// Allocate the thread local key of thread caches (@c _lock must be locked).
+//
+// The key is allocated only when thread caches are used, the count of keys
+// is limited by the system and there can be many memory managers. Returns
+// false if the key can't be allocated, the locked path is used then.
+bool MemoryManagerPrivate::initThreadCache() ASMJIT_NOTHROW
+{
+  return _threadCache.create(onThreadExit);
+}
+
+MemThreadCache* MemoryManagerPrivate::getThreadCache() ASMJIT_NOTHROW
+{
+  if (!_threadCache.isValid()) return NULL;
+
+  MemThreadCache* cache = reinterpret_cast<MemThreadCache*>(_threadCache.get());
+  if (cache != NULL) return cache;
+
+  cache = reinterpret_cast<MemThreadCache*>(ASMJIT_MALLOC(sizeof(MemThreadCache)));
+  if (cache == NULL) return NULL;
+
+  memset(cache, 0, sizeof(MemThreadCache));
+  cache->owner = this;
+
+  if (!_threadCache.set(cache))
+  {
+    ASMJIT_FREE(cache);
+    return NULL;
+  }
+
+  AutoLock locked(_lock);
+
+  cache->next = _caches;
+  if (_caches) _caches->prev = cache;
+  _caches = cache;
+
+  return cache;
+}
+
+// Allocate @a need blocks and put some more to the empty magazine.
+void* MemoryManagerPrivate::refillCache(MemThreadCache* cache, size_t need) ASMJIT_NOTHROW
+{
+  size_t& count = cache->count[need - 1];
+  void** magazine = cache->magazines[need - 1];
+
+  // Pending blocks can contain the blocks we need.
+  flushCache(cache);
+  if (count != 0)
+    return magazine[--count];
+
+  void* result = _allocFreeable(&_heap, need, 0);
+  if (result == NULL) return NULL;
+
+  while (count < kMemCacheBatch - 1)
+  {
+    void* p = _allocFreeable(&_heap, need, 0);
+    if (p == NULL) break;
+
+    magazine[count++] = p;
+  }
+
+  return result;
+}
+
+// Return pending blocks of @a cache to its magazines or to the memory manager.
+void MemoryManagerPrivate::flushCache(MemThreadCache* cache) ASMJIT_NOTHROW
+{
+  for (size_t i = 0; i < cache->pendingCount; i++)
+  {
+    void* p = cache->pending[i];
+
+    MemNode* node;
+    size_t bitpos;
+    size_t cont = findBlocks(p, &node, &bitpos);
+
+    // Not allocated address, there is nobody to report it to.
+    if (cont == 0)
+      continue;
+
+    // Only blocks of the default heap are allocated from magazines.
+    if (node->heap == &_heap && cont <= kMemCacheClasses && cache->count[cont - 1] < kMemCacheCapacity)
+      cache->magazines[cont - 1][cache->count[cont - 1]++] = p;
+    else
+      freeBlocks(node, bitpos, cont);
+  }
+
+  cache->pendingCount = 0;
+}
+
+// Return all blocks of @a cache to the memory manager.
+void MemoryManagerPrivate::drainCache(MemThreadCache* cache) ASMJIT_NOTHROW
+{
+  size_t i, j;
+
+  for (i = 0; i < cache->pendingCount; i++)
+    _free(cache->pending[i]);
+  cache->pendingCount = 0;
+
+  for (i = 0; i < kMemCacheClasses; i++)
+  {
+    for (j = 0; j < cache->count[i]; j++)
+      _free(cache->magazines[i][j]);
+    cache->count[i] = 0;
+  }
+}
+
+// Return all blocks of @a cache and free it.
+void MemoryManagerPrivate::releaseCache(MemThreadCache* cache) ASMJIT_NOTHROW
+{
+  drainCache(cache);
+
+  // Tail of the permanent node can be used by other threads.
+  if (cache->permanent != NULL)
+    cache->permanent->owner = NULL;
+
+  MemThreadCache* prev = cache->prev;
+  MemThreadCache* next = cache->next;
+
+  if (prev) { prev->next = next; } else { _caches = next; }
+  if (next) { next->prev = prev; }
+
+  ASMJIT_FREE(cache);
+}
+
+void ASMJIT_THREAD_LOCAL_CALL MemoryManagerPrivate::onThreadExit(void* cache) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemThreadCache*>(cache)->owner;
+
+  AutoLock locked(d->_lock);
+  d->releaseCache(reinterpret_cast<MemThreadCache*>(cache));
+}
+
+// ============================================================================
+// [AsmJit::MemoryManagerPrivate - Deferred Free]
+// ============================================================================
+
+bool MemoryManagerPrivate::registerThread() ASMJIT_NOTHROW
+{
+  {
+    AutoLock locked(_lock);
+    if (!initThreadCache()) return false;
+  }
+
+  MemThreadCache* cache = getThreadCache();
+  if (cache == NULL) return false;
+
+  AutoLock locked(_lock);
+
+  // The thread may already execute some code retired before (it could get
+  // the pointer before it registered), so all blocks retired so far stay
+  // until the thread calls quiescent().
+  cache->epoch = (_retiredCount != 0) ? _retired[0].epoch : _epoch;
+  cache->registered = true;
+  return true;
+}
+
+void MemoryManagerPrivate::unregisterThread() ASMJIT_NOTHROW
+{
+  MemThreadCache* cache = reinterpret_cast<MemThreadCache*>(_threadCache.get());
+  if (cache == NULL) return;
+
+  AutoLock locked(_lock);
+  cache->registered = false;
+}
+
+void MemoryManagerPrivate::quiescent() ASMJIT_NOTHROW
+{
+  MemThreadCache* cache = reinterpret_cast<MemThreadCache*>(_threadCache.get());
+  if (cache == NULL) return;
+
+  // The code executed before must not be reordered after the store and the
+  // code executed after must not be reordered before it.
+  _MemoryBarrier();
+  cache->epoch = _epoch;
+  _MemoryBarrier();
+}
+
+bool MemoryManagerPrivate::retire(void* address) ASMJIT_NOTHROW
+{
+  AutoLock locked(_lock);
+
+  MemNode* node;
+  size_t bitpos;
+  size_t cont = findBlocks(address, &node, &bitpos);
+
+  // Not allocated address.
+  if (cont == 0)
+    return false;
+
+  if (_retiredCount == _retiredCapacity)
+  {
+    size_t capacity = _retiredCapacity ? _retiredCapacity * 2 : (size_t)kMemRetireThreshold;
+    MemRetired* retired = reinterpret_cast<MemRetired*>(
+      ASMJIT_REALLOC(_retired, capacity * sizeof(MemRetired)));
+    if (retired == NULL) return false;
+
+    _retired = retired;
+    _retiredCapacity = capacity;
+  }
+
+  MemRetired& r = _retired[_retiredCount++];
+  r.address = address;
+  r.size = cont * node->density;
+  r.epoch = _epoch++;
+
+  _retiredBytes += r.size;
+
+  if (_retiredCount >= kMemRetireThreshold)
+    _reclaim();
+  return true;
+}
+
+// Free retired blocks older than epoch of all registered threads.
+size_t MemoryManagerPrivate::_reclaim() ASMJIT_NOTHROW
+{
+  size_t epoch = _epoch;
+
+  MemThreadCache* cache;
+  for (cache = _caches; cache != NULL; cache = cache->next)
+  {
+    size_t e = cache->epoch;
+    if (cache->registered && e < epoch) epoch = e;
+  }
+
+  size_t i;
+  size_t freed = 0;
+
+  for (i = 0; i < _retiredCount && _retired[i].epoch < epoch; i++)
+  {
+    _free(_retired[i].address);
+    freed += _retired[i].size;
+  }
+
+  if (i != 0)
+  {
+    _retiredCount -= i;
+    memmove(_retired, _retired + i, _retiredCount * sizeof(MemRetired));
+  }
+
+  _retiredBytes -= freed;
+  return freed;
+}
+
+// ============================================================================
+// [AsmJit::MemoryManagerPrivate - NodeList Page Map]
+// ============================================================================
+
+bool MemoryManagerPrivate::insertNode(MemNode* node) ASMJIT_NOTHROW
+{
+  if (!mapNode(node, node))
+  {
+    mapNode(node, NULL);
+    return false;
+  }
+
+  // Link with others.
+  node->prev = _last;
+
+  if (_first == NULL)
+  {
+    _first = node;
+    _last = node;
+  }
+  else
+  {
+    node->prev = _last;
+    _last->next = node;
+    _last = node;
+  }
+
+  ASMJIT_ASSERT(findPtr(node->mem) == node);
+  ASMJIT_ASSERT(findPtr(node->mem + node->size - 1) == node);
+  return true;
+}
+
+void MemoryManagerPrivate::removeNode(MemNode* node) ASMJIT_NOTHROW
+{
+  mapNode(node, NULL);
+
+  // Unlink.
+  MemNode* next = node->next;
+  MemNode* prev = node->prev;
+
+  if (prev) { prev->next = next; } else { _first = next; }
   if (next) { next->prev = prev; } else { _last  = prev; }
-  if (_optimal == q) { _optimal = prev ? prev : next; }
+}
+
+MemNode* MemoryManagerPrivate::findPtr(uint8_t* mem) ASMJIT_NOTHROW
+{
+  if (_IsAboveMap(mem))
+  {
+    // Nodes which are not in the page map, the list can be walked only with
+    // the lock held.
+    MemNode* node;
+    for (node = _first; node != NULL; node = node->next)
+    {
+      if (mem >= node->mem && mem < node->mem + node->size)
+        return node;
+    }
+    return NULL;
+  }
+
+  size_t page = (size_t)mem >> kMemMapPageShift;
+
+  // The map is read without the lock by freeLockFree(), tables are stored
+  // by mapNode() after they are zeroed.
+  MemNode*** level2 = (MemNode***)_AtomicLoad(
+    (volatile size_t*)&_map[page >> (kMemMapLevelBits * 2)]);
+  if (level2 == NULL) return NULL;
+
+  MemNode** level3 = (MemNode**)_AtomicLoad(
+    (volatile size_t*)&level2[(page >> kMemMapLevelBits) & (kMemMapLevelSize - 1)]);
+  if (level3 == NULL) return NULL;
+
+  // Nodes are page aligned and contain whole pages, so the node of the page
+  // always contains the address.
+  return (MemNode*)_AtomicLoad((volatile size_t*)&level3[page & (kMemMapLevelSize - 1)]);
+}
+
+// Set all pages of @a node in the page map to @a value, the tables are
+// allocated when needed (unless @a value is NULL).
+//
+// Returns false if out of memory.
+bool MemoryManagerPrivate::mapNode(MemNode* node, MemNode* value) ASMJIT_NOTHROW
+{
+  if (_IsAboveMap(node->mem))
+    return true;
+
+  size_t page = (size_t)node->mem >> kMemMapPageShift;
+  size_t end = page + (node->size >> kMemMapPageShift);
+
+  ASMJIT_ASSERT(((size_t)node->mem & ((1 << kMemMapPageShift) - 1)) == 0);
+  ASMJIT_ASSERT((node->size & ((1 << kMemMapPageShift) - 1)) == 0);
+
+  while (page < end)
+  {
+    MemNode*** level2 = _map[page >> (kMemMapLevelBits * 2)];
+    if (level2 == NULL)
+    {
+      if (value == NULL) return true;
+
+      level2 = reinterpret_cast<MemNode***>(ASMJIT_MALLOC(kMemMapLevelSize * sizeof(MemNode**)));
+      if (level2 == NULL) return false;
+
+      // Publish the table after it's zeroed, findPtr() reads it without
+      // the lock.
+      memset(level2, 0, kMemMapLevelSize * sizeof(MemNode**));
+      _MemoryBarrier();
+      _map[page >> (kMemMapLevelBits * 2)] = level2;
+    }
+
+    size_t index2 = (page >> kMemMapLevelBits) & (kMemMapLevelSize - 1);
+    MemNode** level3 = level2[index2];
+    if (level3 == NULL)
+    {
+      if (value == NULL) return true;
+
+      level3 = reinterpret_cast<MemNode**>(ASMJIT_MALLOC(kMemMapLevelSize * sizeof(MemNode*)));
+      if (level3 == NULL) return false;
+
+      memset(level3, 0, kMemMapLevelSize * sizeof(MemNode*));
+      _MemoryBarrier();
+      level2[index2] = level3;
+    }
+
+    // Pages up to the end of the third level table.
+    size_t i = page & (kMemMapLevelSize - 1);
+    size_t iEnd = i + (end - page);
+    if (iEnd > kMemMapLevelSize) iEnd = kMemMapLevelSize;
+
+    page += iEnd - i;
+    while (i < iEnd) level3[i++] = value;
+  }
+
+  return true;
+}
+
+// Free all tables of the page map. The tables are kept when nodes are removed
+// (there is one table per 16MB of address space), so they are freed only
+// together with all nodes.
+void MemoryManagerPrivate::freeMap() ASMJIT_NOTHROW
+{
+  for (size_t i = 0; i < kMemMapRootSize; i++)
+  {
+    MemNode*** level2 = _map[i];
+    if (level2 == NULL) continue;
+
+    for (size_t j = 0; j < kMemMapLevelSize; j++)
+    {
+      if (level2[j]) ASMJIT_FREE(level2[j]);
+    }
+
+    ASMJIT_FREE(level2);
+    _map[i] = NULL;
+  }
+}
+
+// ============================================================================
+// [AsmJit::MemoryManager]
+// ============================================================================
+
+MemoryManager::MemoryManager() ASMJIT_NOTHROW
+{
+}
+
+MemoryManager::~MemoryManager() ASMJIT_NOTHROW
+{
+}
+
+void* MemoryManager::alloc(size_t size, uint32_t type, size_t alignment) ASMJIT_NOTHROW
+{
+  void* p = alloc(size, type);
+
+  if (p != NULL && alignment != 0 && ((size_t)p & (alignment - 1)) != 0)
+  {
+    free(p);
+    return NULL;
+  }
+
+  return p;
+}
+
+void* MemoryManager::allocNear(size_t size, const void* hint, uint32_t type, size_t alignment) ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(hint);
+  return alloc(size, type, alignment);
+}
+
+void* MemoryManager::allocOnNumaNode(size_t size, uint32_t numaNode, uint32_t type, size_t alignment) ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(numaNode);
+  return alloc(size, type, alignment);
+}
+
+bool MemoryManager::grow(void* address, size_t size) ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(address);
+  ASMJIT_UNUSED(size);
 
-  return q;
+  return false;
 }
 
-MemNode* MemoryManagerPrivate::findPtr(uint8_t* mem) ASMJIT_NOTHROW
+void* MemoryManager::getWritableAddress(void* address) ASMJIT_NOTHROW
 {
-  MemNode* cur = _root;
-  while (cur)
-  {
-    uint8_t* curMem = cur->mem;
-    if (mem < curMem)
-    {
-      // Go left.
-      cur = cur->node[0];
-      continue;
-    }
-    else
-    {
-      uint8_t* curEnd = curMem + cur->size;
-      if (mem >= curEnd)
-      {
-        // Go right.
-        cur = cur->node[1];
-        continue;
-      }
-      else
-      {
-        // Match.
-        break;
-      }
-    }
-  }
-  return cur;
+  return address;
 }
 
-// ============================================================================
-// [AsmJit::MemoryManager]
-// ============================================================================
+void* MemoryManager::getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(address);
+  ASMJIT_UNUSED(target);
+  ASMJIT_UNUSED(code);
+  ASMJIT_UNUSED(size);
 
-MemoryManager::MemoryManager() ASMJIT_NOTHROW
+  return NULL;
+}
+
+bool MemoryManager::registerThread() ASMJIT_NOTHROW
 {
+  return false;
 }
 
-MemoryManager::~MemoryManager() ASMJIT_NOTHROW
+void MemoryManager::unregisterThread() ASMJIT_NOTHROW
+{
+}
+
+void MemoryManager::quiescent() ASMJIT_NOTHROW
+{
+}
+
+bool MemoryManager::retire(void* address) ASMJIT_NOTHROW
+{
+  ASMJIT_UNUSED(address);
+  return false;
+}
+
+size_t MemoryManager::reclaim() ASMJIT_NOTHROW
 {
+  return 0;
 }
 
 MemoryManager* MemoryManager::getGlobal() ASMJIT_NOTHROW
@@ -1076,14 +2906,75 @@ VirtualMemoryManager::~VirtualMemoryManager() ASMJIT_NOTHROW
   delete d;
 }
 
+// Alignment must be power of 2 (or zero - default), node memory is aligned
+// only to the page size.
+static inline bool _IsValidAlignment(size_t alignment) ASMJIT_NOTHROW
+{
+  return (alignment & (alignment - 1)) == 0 && alignment <= VirtualMemory::getPageSize();
+}
+
 void* VirtualMemoryManager::alloc(size_t size, uint32_t type) ASMJIT_NOTHROW
+{
+  return alloc(size, type, 0);
+}
+
+void* VirtualMemoryManager::alloc(size_t size, uint32_t type, size_t alignment) ASMJIT_NOTHROW
 {
   MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
 
+  if (!_IsValidAlignment(alignment)) return NULL;
+
   if (type == kMemAllocPermanent) 
-    return d->allocPermanent(size);
+    return d->allocPermanent(size, alignment);
   else
-    return d->allocFreeable(size);
+    return d->allocFreeable(size, alignment);
+}
+
+void* VirtualMemoryManager::allocNear(size_t size, const void* hint, uint32_t type, size_t alignment) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+
+  // Permanent memory is not placed near anything, 32-bit code can reach
+  // whole address space.
+#if defined(ASMJIT_X64)
+  if (type == kMemAllocPermanent || hint == NULL)
+    return alloc(size, type, alignment);
+
+# if defined(ASMJIT_WINDOWS)
+  // Memory of other process is never placed near our addresses.
+  if (d->_hProcess != GetCurrentProcess())
+    return alloc(size, type, alignment);
+# endif // ASMJIT_WINDOWS
+
+  if (!_IsValidAlignment(alignment)) return NULL;
+
+  void* p = d->allocNear(size, hint, alignment);
+  if (p != NULL) return p;
+
+  // There is no free space near hint, trampolines will be used.
+  return alloc(size, type, alignment);
+#else
+  ASMJIT_UNUSED(d);
+  ASMJIT_UNUSED(hint);
+  return alloc(size, type, alignment);
+#endif // ASMJIT_X64
+}
+
+void* VirtualMemoryManager::allocOnNumaNode(size_t size, uint32_t numaNode, uint32_t type, size_t alignment) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+
+  if (type == kMemAllocPermanent || numaNode >= VirtualMemory::getNumaNodeCount())
+    return alloc(size, type, alignment);
+
+#if defined(ASMJIT_WINDOWS)
+  // Memory of other process is not touched by our threads.
+  if (d->_hProcess != GetCurrentProcess())
+    return alloc(size, type, alignment);
+#endif // ASMJIT_WINDOWS
+
+  if (!_IsValidAlignment(alignment)) return NULL;
+  return d->allocOnNumaNode(size, numaNode, alignment);
 }
 
 bool VirtualMemoryManager::free(void* address) ASMJIT_NOTHROW
@@ -1098,6 +2989,12 @@ bool VirtualMemoryManager::shrink(void* address, size_t used) ASMJIT_NOTHROW
   return d->shrink(address, used);
 }
 
+bool VirtualMemoryManager::grow(void* address, size_t size) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->grow(address, size);
+}
+
 void VirtualMemoryManager::freeAll() ASMJIT_NOTHROW
 {
   MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
@@ -1115,9 +3012,75 @@ size_t VirtualMemoryManager::getUsedBytes() ASMJIT_NOTHROW
 size_t VirtualMemoryManager::getAllocatedBytes() ASMJIT_NOTHROW
 {
   MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  d->flushFreed();
   return d->_allocated;
 }
 
+void* VirtualMemoryManager::getWritableAddress(void* address) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->getWritableAddress(address);
+}
+
+void* VirtualMemoryManager::getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->getTrampoline(address, target, code, size);
+}
+
+bool VirtualMemoryManager::registerThread() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->registerThread();
+}
+
+void VirtualMemoryManager::unregisterThread() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  d->unregisterThread();
+}
+
+void VirtualMemoryManager::quiescent() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  d->quiescent();
+}
+
+bool VirtualMemoryManager::retire(void* address) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->retire(address);
+}
+
+size_t VirtualMemoryManager::reclaim() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  d->drainFreed();
+  return d->_reclaim();
+}
+
+size_t VirtualMemoryManager::getRetiredBytes() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_retiredBytes;
+}
+
+size_t VirtualMemoryManager::getRetainedBytes() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  d->flushFreed();
+  return d->_retained;
+}
+
+size_t VirtualMemoryManager::getReleasedBytes() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  d->flushFreed();
+  return d->_released;
+}
+
 bool VirtualMemoryManager::getKeepVirtualMemory() const ASMJIT_NOTHROW
 {
   MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
@@ -1130,6 +3093,298 @@ void VirtualMemoryManager::setKeepVirtualMemory(bool keepVirtualMemory) ASMJIT_N
   d->_keepVirtualMemory = keepVirtualMemory;
 }
 
+size_t VirtualMemoryManager::getRetainThreshold() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_retainThreshold;
+}
+
+void VirtualMemoryManager::setRetainThreshold(size_t threshold) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  d->drainFreed();
+  d->_retainThreshold = threshold;
+  d->releaseRetained(threshold);
+}
+
+bool VirtualMemoryManager::getUseThreadCache() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_useThreadCache;
+}
+
+void VirtualMemoryManager::setUseThreadCache(bool useThreadCache) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  if (!useThreadCache)
+  {
+    MemThreadCache* cache;
+    for (cache = d->_caches; cache != NULL; cache = cache->next)
+    {
+      d->drainCache(cache);
+
+      // Tail of the permanent node can be used by other threads.
+      if (cache->permanent != NULL)
+      {
+        cache->permanent->owner = NULL;
+        cache->permanent = NULL;
+      }
+    }
+  }
+
+  // Without the thread local key the memory manager stays locked.
+  if (useThreadCache && !d->initThreadCache())
+    useThreadCache = false;
+
+  d->_useThreadCache = useThreadCache;
+}
+
+bool VirtualMemoryManager::getUseLargePages() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_useLargePages;
+}
+
+void VirtualMemoryManager::setUseLargePages(bool useLargePages) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+#if defined(ASMJIT_WINDOWS)
+  // Large pages can be allocated only in the current process.
+  if (d->_hProcess != GetCurrentProcess())
+    return;
+#endif // ASMJIT_WINDOWS
+
+  d->_useLargePages = useLargePages;
+}
+
+bool VirtualMemoryManager::getDualMapping() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_dualMapping;
+}
+
+bool VirtualMemoryManager::setDualMapping(bool dualMapping) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  if (d->_dualMapping == dualMapping)
+    return true;
+
+  // Memory can't be remapped.
+  if (d->_first != NULL || d->_permanent != NULL)
+    return false;
+
+  // Reserved region is not mapped twice.
+  if (dualMapping && d->_regionSize != 0)
+    return false;
+
+#if defined(ASMJIT_WINDOWS)
+  // Views can be mapped only to the current process.
+  if (dualMapping && d->_hProcess != GetCurrentProcess())
+    return false;
+#endif // ASMJIT_WINDOWS
+
+  if (dualMapping)
+  {
+    // Check whether it's supported by the system.
+    size_t vsize;
+    void* rw;
+    void* vmem = VirtualMemory::allocDualMapping(1, &vsize, &rw);
+
+    if (vmem == NULL)
+      return false;
+    VirtualMemory::freeDualMapping(vmem, rw, vsize);
+  }
+
+  d->_dualMapping = dualMapping;
+  return true;
+}
+
+size_t VirtualMemoryManager::getDensity() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_newChunkDensity;
+}
+
+bool VirtualMemoryManager::setDensity(size_t density) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  // Trampolines need at least 16 bytes alignment.
+  if ((density & (density - 1)) != 0 || density < 16 || density > VirtualMemory::getPageSize())
+    return false;
+
+  // Free runs of all nodes are counted in blocks of the same size.
+  if (d->_first != NULL)
+    return false;
+
+  d->_newChunkDensity = density;
+  return true;
+}
+
+size_t VirtualMemoryManager::getRegionSize() const ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  return d->_regionSize;
+}
+
+void* VirtualMemoryManager::getRegionAddress() ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  return d->_region != NULL ? d->_region->mem : NULL;
+}
+
+bool VirtualMemoryManager::setRegionSize(size_t size) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  // Nodes can't be moved.
+  if (d->_first != NULL)
+    return false;
+
+  // Reserved region is not mapped twice.
+  if (size != 0 && d->_dualMapping)
+    return false;
+
+#if defined(ASMJIT_WINDOWS)
+  // Memory can be reserved only in the current process.
+  if (size != 0 && d->_hProcess != GetCurrentProcess())
+    return false;
+#endif // ASMJIT_WINDOWS
+
+  // Release the region reserved before.
+  MemArena* region = d->_region;
+  if (region != NULL)
+  {
+    MemArena** pPrev = &d->_arenas;
+    while (*pPrev != region) pPrev = &(*pPrev)->next;
+    *pPrev = region->next;
+
+    d->freeArena(region, false);
+    d->_region = NULL;
+  }
+
+  d->_regionSize = 0;
+  if (size == 0) return true;
+
+  // Reserve the region now, so it fails early.
+  size_t slotSize = IntUtil::roundUp<size_t>(d->_newChunkSize, VirtualMemory::getPageSize());
+  region = d->createArena(&d->_heap, slotSize, size, true);
+  if (region == NULL) return false;
+
+  d->_region = region;
+  d->_regionSize = size;
+  return true;
+}
+
+// ============================================================================
+// [AsmJit::VirtualMemoryManager - Statistics]
+// ============================================================================
+
+MemorySnapshot::MemorySnapshot() ASMJIT_NOTHROW :
+  nodes(NULL)
+{
+  reset();
+}
+
+MemorySnapshot::~MemorySnapshot() ASMJIT_NOTHROW
+{
+  if (nodes) ASMJIT_FREE(nodes);
+}
+
+void MemorySnapshot::reset() ASMJIT_NOTHROW
+{
+  if (nodes) ASMJIT_FREE(nodes);
+
+  allocated = 0;
+  used = 0;
+  retained = 0;
+  retired = 0;
+  permanent = 0;
+
+  nodes = NULL;
+  nodeCount = 0;
+
+  memset(histogram, 0, sizeof(histogram));
+}
+
+bool VirtualMemoryManager::getSnapshot(MemorySnapshot* snapshot) ASMJIT_NOTHROW
+{
+  MemoryManagerPrivate* d = reinterpret_cast<MemoryManagerPrivate*>(_d);
+  AutoLock locked(d->_lock);
+
+  d->drainFreed();
+  snapshot->reset();
+
+  MemNode* node;
+  size_t count = 0;
+
+  for (node = d->_first; node != NULL; node = node->next)
+    count++;
+
+  if (count != 0)
+  {
+    snapshot->nodes = reinterpret_cast<MemorySnapshot::Node*>(
+      ASMJIT_MALLOC(count * sizeof(MemorySnapshot::Node)));
+    if (snapshot->nodes == NULL) return false;
+  }
+
+  MemorySnapshot::Node* info = snapshot->nodes;
+  for (node = d->_first; node != NULL; node = node->next, info++)
+  {
+    size_t largest = 0;
+    size_t index = 0;
+
+    info->address = node->mem;
+    info->size = node->size;
+    info->used = node->used;
+    info->density = node->density;
+    info->freeRuns = 0;
+
+    while (index < node->blocks)
+    {
+      // Run of unused blocks.
+      size_t end = _FindBit(node->baUsed, index, node->blocks, true);
+      if (end != index)
+      {
+        if (end - index > largest) largest = end - index;
+        info->freeRuns++;
+        index = end;
+        continue;
+      }
+
+      // Allocated block, the last one has no continue bit.
+      end = _FindBit(node->baCont, index, node->blocks, false) + 1;
+      snapshot->histogram[MemorySnapshot::getHistogramBucket((end - index) * node->density)]++;
+      index = end;
+    }
+
+    info->largestFreeRun = largest * node->density;
+  }
+  snapshot->nodeCount = count;
+
+  PermanentNode* permanent;
+  for (permanent = d->_permanent; permanent != NULL; permanent = permanent->prev)
+    snapshot->permanent += permanent->size;
+
+  snapshot->allocated = d->_allocated;
+  snapshot->used = d->_used;
+  snapshot->retained = d->_retained;
+  snapshot->retired = d->_retiredBytes;
+  return true;
+}
+
 // ============================================================================
 // [AsmJit::VirtualMemoryManager - Debug]
 // ============================================================================
@@ -1145,7 +3400,7 @@ struct GraphVizContext
   void closeFile();
 
   void dumpNode(MemNode* node);
-  void connect(MemNode* node, MemNode* other, const char* dst);
+  void connect(MemNode* node, MemNode* other);
 
   FILE* file;
 };
@@ -1173,22 +3428,15 @@ void GraphVizContext::closeFile()
 
 void GraphVizContext::dumpNode(MemNode* node)
 {
-  fprintf(file, "  NODE_%p [shape=record, style=filled, color=%s, label=\"<L>|<C>Mem: %p, Used: %d/%d|<R>\"];\n",
+  fprintf(file, "  NODE_%p [shape=record, style=filled, color=%s, label=\"Mem: %p, Used: %d/%d\"];\n",
     node,
-    node->red ? "red" : "gray",
-    node->mem, node->used, node->size);
-
-  if (node->node[0]) connect(node, node->node[0], "L");
-  if (node->node[1]) connect(node, node->node[1], "R");
+    node->arena ? "lightblue" : "gray",
+    node->mem, (int)node->used, (int)node->size);
 }
 
-void GraphVizContext::connect(MemNode* node, MemNode* other, const char* dst)
+void GraphVizContext::connect(MemNode* node, MemNode* other)
 {
-  dumpNode(other);
-
-  fprintf(file, "  NODE_%p:%s -> NODE_%p:C", node, dst, other);
-  if (other->red) fprintf(file, " [style=bold, color=red]");
-  fprintf(file, ";\n");
+  fprintf(file, "  NODE_%p -> NODE_%p;\n", node, other);
 }
 
 void VirtualMemoryManager::dump(const char* fileName)
@@ -1200,7 +3448,14 @@ void VirtualMemoryManager::dump(const char* fileName)
     return;
 
   fprintf(ctx.file, "digraph {\n");
-  if (d->_root) ctx.dumpNode(d->_root);
+
+  MemNode* node;
+  for (node = d->_first; node != NULL; node = node->next)
+  {
+    ctx.dumpNode(node);
+    if (node->next) ctx.connect(node, node->next);
+  }
+
   fprintf(ctx.file, "}\n");
 }
 #endif // ASMJIT_MEMORY_MANAGER_DUMP
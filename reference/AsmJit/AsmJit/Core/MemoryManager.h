@@ -54,10 +54,39 @@ struct MemoryManager
   //! can quitly ignore type of allocation. This is mainly for AsmJit to memory
   //! manager that allocated memory will be never freed.
   virtual void* alloc(size_t size, uint32_t type = kMemAllocFreeable) ASMJIT_NOTHROW = 0;
+  //! @brief Allocate a @a size bytes of virtual memory aligned to
+  //! @a alignment.
+  //!
+  //! The @a alignment must be power of 2, zero means the default alignment
+  //! of the memory manager. Returns NULL if the memory can't be aligned.
+  //! Default implementation calls @c alloc() and fails if the returned
+  //! memory is not aligned.
+  ASMJIT_API virtual void* alloc(size_t size, uint32_t type, size_t alignment) ASMJIT_NOTHROW;
+  //! @brief Allocate a @a size bytes of virtual memory near @a hint.
+  //!
+  //! Memory manager should try to allocate the memory within 32-bit
+  //! displacement (+-2GB) from @a hint, so the code placed there can call
+  //! functions near @a hint directly (without trampolines). Default
+  //! implementation ignores @a hint and calls @c alloc().
+  ASMJIT_API virtual void* allocNear(size_t size, const void* hint, uint32_t type = kMemAllocFreeable, size_t alignment = 0) ASMJIT_NOTHROW;
+  //! @brief Allocate a @a size bytes of virtual memory placed on NUMA node
+  //! @a numaNode.
+  //!
+  //! Memory manager should place the memory on the given node, so threads
+  //! running on that node don't fetch the code from remote memory (see
+  //! @c VirtualMemory::getCurrentNumaNode()). Default implementation ignores
+  //! @a numaNode and calls @c alloc().
+  ASMJIT_API virtual void* allocOnNumaNode(size_t size, uint32_t numaNode, uint32_t type = kMemAllocFreeable, size_t alignment = 0) ASMJIT_NOTHROW;
   //! @brief Free previously allocated memory at a given @a address.
   virtual bool free(void* address) ASMJIT_NOTHROW = 0;
   //! @brief Free some tail memory.
   virtual bool shrink(void* address, size_t used) ASMJIT_NOTHROW = 0;
+  //! @brief Grow memory at @a address to @a size bytes in place.
+  //!
+  //! Returns false if the memory following the allocation is not free, the
+  //! allocation is then not changed. Default implementation always returns
+  //! false.
+  ASMJIT_API virtual bool grow(void* address, size_t size) ASMJIT_NOTHROW;
   //! @brief Free all allocated memory.
   virtual void freeAll() ASMJIT_NOTHROW = 0;
 
@@ -66,6 +95,67 @@ struct MemoryManager
   //! @brief Get how many bytes are currently allocated.
   virtual size_t getAllocatedBytes() ASMJIT_NOTHROW = 0;
 
+  //! @brief Get address where memory allocated at @a address can be written.
+  //!
+  //! Memory manager can map executable memory twice, in such case the memory
+  //! returned by @c alloc() is not writeable and the code must be written to
+  //! the address returned by this method. Default implementation returns
+  //! @a address.
+  ASMJIT_API virtual void* getWritableAddress(void* address) ASMJIT_NOTHROW;
+
+  //! @brief Get trampoline jumping to @a target reachable from @a address.
+  //!
+  //! Trampoline is shared by all code calling @a target that is placed near
+  //! @a address, so it's created only once by copying @a size bytes of
+  //! @a code (which must be position independent). The returned trampoline
+  //! is valid until the memory at @a address is freed. Returns NULL if the
+  //! memory manager doesn't share trampolines (default implementation), the
+  //! caller must then write its own trampoline.
+  ASMJIT_API virtual void* getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Deferred Free]
+  // --------------------------------------------------------------------------
+
+  //! @brief Register the calling thread as thread that can execute the code
+  //! allocated by the memory manager.
+  //!
+  //! Memory passed to @c retire() is not freed until all registered threads
+  //! called @c quiescent(). Memory retired before the thread registered is
+  //! not freed until it calls @c quiescent() either. Returns @c false if
+  //! deferred free is not supported (default implementation) or if thread
+  //! local storage can't be allocated.
+  //!
+  //! @note Thread which exits should call @c unregisterThread(), it's done
+  //! automatically by @c VirtualMemoryManager only on Posix.
+  ASMJIT_API virtual bool registerThread() ASMJIT_NOTHROW;
+  //! @brief Unregister the calling thread, it must not execute any code
+  //! allocated by the memory manager after the call.
+  ASMJIT_API virtual void unregisterThread() ASMJIT_NOTHROW;
+
+  //! @brief Announce that the calling thread doesn't execute (and doesn't
+  //! keep pointer to) any code retired so far.
+  //!
+  //! Registered threads should call it periodically, for example between
+  //! requests, otherwise the retired memory is never freed.
+  ASMJIT_API virtual void quiescent() ASMJIT_NOTHROW;
+
+  //! @brief Free memory at @a address when no thread can execute it.
+  //!
+  //! The code must be unreachable for new calls (removed from all tables, etc)
+  //! before it's retired, threads already executing it can continue. Memory
+  //! is freed after all registered threads called @c quiescent(). Returns
+  //! @c false if @a address is not allocated or if deferred free is not
+  //! supported (default implementation), the memory is not freed then.
+  //! Don't pass the retired @a address to @c free().
+  ASMJIT_API virtual bool retire(void* address) ASMJIT_NOTHROW;
+
+  //! @brief Free retired memory which can't be executed anymore.
+  //!
+  //! Retired memory is also reclaimed by @c retire() when there is enough of
+  //! it. Returns count of bytes freed.
+  ASMJIT_API virtual size_t reclaim() ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Statics]
   // --------------------------------------------------------------------------
@@ -78,6 +168,107 @@ struct MemoryManager
   ASMJIT_API static MemoryManager* getGlobal() ASMJIT_NOTHROW;
 };
 
+// ============================================================================
+// [AsmJit::MemorySnapshot]
+// ============================================================================
+
+//! @brief Snapshot of @c VirtualMemoryManager state, used to watch its
+//! occupancy and fragmentation.
+//!
+//! @sa @c VirtualMemoryManager::getSnapshot().
+struct MemorySnapshot
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create an empty @c MemorySnapshot instance.
+  ASMJIT_API MemorySnapshot() ASMJIT_NOTHROW;
+  //! @brief Destroy the @c MemorySnapshot instance.
+  ASMJIT_API ~MemorySnapshot() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Methods]
+  // --------------------------------------------------------------------------
+
+  //! @brief Free the node array and zero all statistics.
+  ASMJIT_API void reset() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Node]
+  // --------------------------------------------------------------------------
+
+  //! @brief State of one chunk of virtual memory (node).
+  struct Node
+  {
+    //! @brief Address of the chunk.
+    void* address;
+    //! @brief Size of the chunk in bytes.
+    size_t size;
+    //! @brief Count of bytes used.
+    size_t used;
+    //! @brief Size of the smallest block of the chunk.
+    size_t density;
+    //! @brief Count of runs of unused blocks.
+    size_t freeRuns;
+    //! @brief Size of the largest run of unused blocks in bytes (the largest
+    //! allocation the chunk can take).
+    size_t largestFreeRun;
+  };
+
+  // --------------------------------------------------------------------------
+  // [Histogram]
+  // --------------------------------------------------------------------------
+
+  enum
+  {
+    //! @brief Count of histogram buckets.
+    kHistogramSize = 16
+  };
+
+  //! @brief Get histogram bucket of allocation of @a size bytes.
+  //!
+  //! Bucket 0 contains allocations up to 31 bytes, bucket @c i allocations
+  //! from 2^(i + 4) to 2^(i + 5) - 1 bytes and the last bucket all larger.
+  static inline size_t getHistogramBucket(size_t size) ASMJIT_NOTHROW
+  {
+    size_t bucket = 0;
+    size >>= 5;
+
+    while (size != 0 && bucket < kHistogramSize - 1)
+    {
+      size >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Count of bytes allocated (see @c MemoryManager::getAllocatedBytes()).
+  size_t allocated;
+  //! @brief Count of bytes used (see @c MemoryManager::getUsedBytes()).
+  size_t used;
+  //! @brief Count of bytes in empty chunks kept.
+  size_t retained;
+  //! @brief Count of bytes retired, but not freed yet.
+  size_t retired;
+  //! @brief Count of bytes allocated as permanent (not in any node).
+  size_t permanent;
+
+  //! @brief Array of nodes (ordered by creation).
+  Node* nodes;
+  //! @brief Count of nodes.
+  size_t nodeCount;
+
+  //! @brief Count of allocated blocks by size, see @c getHistogramBucket().
+  size_t histogram[kHistogramSize];
+
+  ASMJIT_NO_COPY(MemorySnapshot)
+};
+
 // ============================================================================
 // [AsmJit::VirtualMemoryManager]
 // ============================================================================
@@ -85,6 +276,10 @@ struct MemoryManager
 //! @brief Reference implementation of memory manager that uses
 //! @ref AsmJit::VirtualMemory class to allocate chunks of virtual memory
 //! and bit arrays to manage it.
+//!
+//! @c free() doesn't lock the memory manager. It overwrites the first bytes
+//! of the freed block by a link to other freed blocks, they are reused after
+//! the next allocation collects them.
 struct VirtualMemoryManager : public MemoryManager
 {
   // --------------------------------------------------------------------------
@@ -111,13 +306,40 @@ struct VirtualMemoryManager : public MemoryManager
   // --------------------------------------------------------------------------
 
   ASMJIT_API virtual void* alloc(size_t size, uint32_t type = kMemAllocFreeable) ASMJIT_NOTHROW;
+  ASMJIT_API virtual void* alloc(size_t size, uint32_t type, size_t alignment) ASMJIT_NOTHROW;
+  ASMJIT_API virtual void* allocNear(size_t size, const void* hint, uint32_t type = kMemAllocFreeable, size_t alignment = 0) ASMJIT_NOTHROW;
+  ASMJIT_API virtual void* allocOnNumaNode(size_t size, uint32_t numaNode, uint32_t type = kMemAllocFreeable, size_t alignment = 0) ASMJIT_NOTHROW;
   ASMJIT_API virtual bool free(void* address) ASMJIT_NOTHROW;
   ASMJIT_API virtual bool shrink(void* address, size_t used) ASMJIT_NOTHROW;
+  ASMJIT_API virtual bool grow(void* address, size_t size) ASMJIT_NOTHROW;
   ASMJIT_API virtual void freeAll() ASMJIT_NOTHROW;
 
   ASMJIT_API virtual size_t getUsedBytes() ASMJIT_NOTHROW;
   ASMJIT_API virtual size_t getAllocatedBytes() ASMJIT_NOTHROW;
 
+  ASMJIT_API virtual void* getWritableAddress(void* address) ASMJIT_NOTHROW;
+  ASMJIT_API virtual void* getTrampoline(void* address, const void* target, const void* code, size_t size) ASMJIT_NOTHROW;
+
+  ASMJIT_API virtual bool registerThread() ASMJIT_NOTHROW;
+  ASMJIT_API virtual void unregisterThread() ASMJIT_NOTHROW;
+  ASMJIT_API virtual void quiescent() ASMJIT_NOTHROW;
+  ASMJIT_API virtual bool retire(void* address) ASMJIT_NOTHROW;
+  ASMJIT_API virtual size_t reclaim() ASMJIT_NOTHROW;
+
+  //! @brief Get how many bytes are retired, but not freed yet.
+  ASMJIT_API size_t getRetiredBytes() ASMJIT_NOTHROW;
+
+  //! @brief Get how many bytes are in empty chunks kept for next
+  //! allocations (they are included in @c getAllocatedBytes()).
+  //!
+  //! @sa @c setRetainThreshold().
+  ASMJIT_API size_t getRetainedBytes() ASMJIT_NOTHROW;
+
+  //! @brief Get how many bytes of virtual memory were returned to the
+  //! system since the memory manager was created (not counting
+  //! @c freeAll()).
+  ASMJIT_API size_t getReleasedBytes() ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Virtual Memory Manager Specific]
   // --------------------------------------------------------------------------
@@ -142,6 +364,171 @@ struct VirtualMemoryManager : public MemoryManager
   //! @sa @c getKeepVirtualMemory().
   ASMJIT_API void setKeepVirtualMemory(bool keepVirtualMemory) ASMJIT_NOTHROW;
 
+  //! @brief Get the maximum count of bytes in empty chunks kept for next
+  //! allocations.
+  //!
+  //! @sa @c setRetainThreshold().
+  ASMJIT_API size_t getRetainThreshold() const ASMJIT_NOTHROW;
+
+  //! @brief Set the maximum count of bytes in empty chunks kept for next
+  //! allocations.
+  //!
+  //! Chunk of virtual memory which becomes empty is normally returned to the
+  //! system immediately. If code is generated and freed in bursts, it's
+  //! better to keep some empty chunks, so they are not mapped and unmapped
+  //! again and again. Empty chunks are kept until their size exceeds
+  //! @a threshold, chunks kept above the new threshold are released by this
+  //! call. Default threshold is zero (nothing is kept).
+  //!
+  //! Unused pages inside chunks larger than the default chunk size are
+  //! always returned to the system (but they stay mapped).
+  //!
+  //! @sa @c getRetainThreshold(), @c getRetainedBytes(),
+  //! @c getReleasedBytes().
+  ASMJIT_API void setRetainThreshold(size_t threshold) ASMJIT_NOTHROW;
+
+  //! @brief Get size of the smallest block of memory (and the default
+  //! alignment), 64 bytes by default.
+  //!
+  //! @sa @c setDensity().
+  ASMJIT_API size_t getDensity() const ASMJIT_NOTHROW;
+
+  //! @brief Set size of the smallest block of memory, the default alignment.
+  //!
+  //! Each allocation is rounded up to the multiple of @a density, so small
+  //! density wastes less memory when allocating small functions (thunks),
+  //! large density keeps functions aligned to the cache line without asking
+  //! for the alignment (see @c alloc()). The @a density must be power of 2
+  //! between 16 and the page size and it can be changed only when there is
+  //! no allocated memory. Returns @c true on success.
+  //!
+  //! @sa @c getDensity().
+  ASMJIT_API bool setDensity(size_t density) ASMJIT_NOTHROW;
+
+  //! @brief Get whether to use per-thread caches of allocated blocks.
+  //!
+  //! @sa @c setUseThreadCache().
+  ASMJIT_API bool getUseThreadCache() const ASMJIT_NOTHROW;
+
+  //! @brief Set whether to use per-thread caches of allocated blocks.
+  //!
+  //! If enabled, each thread keeps small blocks (up to 8 times density, 512
+  //! bytes by default) it freed and reuses them for its next allocations.
+  //! Blocks are moved between the thread cache and the memory manager in
+  //! batches, so the lock is taken only once per several calls to @c alloc()
+  //! and @c free(). This helps when many threads generate code at the same
+  //! time.
+  //!
+  //! Each thread also gets its own node for permanent memory, so permanent
+  //! allocations don't need the lock either. Without thread caches all
+  //! permanent allocations are made under the lock.
+  //!
+  //! There are some drawbacks:
+  //! - @c free() doesn't verify the address and it always returns @c true.
+  //!   Double free of a block cached by the thread is caught only by
+  //!   assertion in debug build.
+  //! - Cached blocks are reported by @c getUsedBytes() as used and they are
+  //!   returned to the memory manager when the thread exits (except Windows
+  //!   older than Vista) or when the thread cache is disabled.
+  //!
+  //! Thread caches need thread local storage, it's allocated when they are
+  //! enabled first time. If it can't be allocated (the system limits count
+  //! of keys), thread caches stay disabled and @c getUseThreadCache() returns
+  //! @c false.
+  //!
+  //! @note Call this method only when no other thread uses the memory manager.
+  //!
+  //! @sa @c getUseThreadCache().
+  ASMJIT_API void setUseThreadCache(bool useThreadCache) ASMJIT_NOTHROW;
+
+  //! @brief Get whether to place code into arenas backed by large pages.
+  //!
+  //! @sa @c setUseLargePages().
+  ASMJIT_API bool getUseLargePages() const ASMJIT_NOTHROW;
+
+  //! @brief Set whether to place code into arenas backed by large pages.
+  //!
+  //! If enabled, new chunks of virtual memory are not allocated separately,
+  //! but they are placed next to each other into arenas of the large page
+  //! size (2MB on x86/x64). Hot generated code then needs less TLB entries.
+  //! If the system doesn't provide large pages, arenas are allocated using
+  //! normal pages (and the system is advised to use transparent large pages
+  //! if it supports them).
+  //!
+  //! Affects only chunks allocated after the call. It's ignored by memory
+  //! manager of other process (Windows).
+  //!
+  //! @sa @c getUseLargePages().
+  ASMJIT_API void setUseLargePages(bool useLargePages) ASMJIT_NOTHROW;
+
+  //! @brief Get whether the virtual memory is mapped twice.
+  //!
+  //! @sa @c setDualMapping().
+  ASMJIT_API bool getDualMapping() const ASMJIT_NOTHROW;
+
+  //! @brief Set whether the virtual memory is mapped twice.
+  //!
+  //! If enabled, each chunk of virtual memory is mapped as read/execute and
+  //! the same pages are mapped as read/write at different address. The
+  //! memory is never writeable and executable at the same time, so it can be
+  //! used on systems that refuse such mappings. Use @c getWritableAddress()
+  //! to get the address where to write the code (@ref JitContext does it).
+  //!
+  //! Dual mapping can be changed only when there is no allocated memory and
+  //! it's only supported by Linux and Windows (and only for the current
+  //! process). Returns @c true on success.
+  //!
+  //! @sa @c getDualMapping().
+  ASMJIT_API bool setDualMapping(bool dualMapping) ASMJIT_NOTHROW;
+
+  //! @brief Get size of the reserved region, zero if not used.
+  //!
+  //! @sa @c setRegionSize().
+  ASMJIT_API size_t getRegionSize() const ASMJIT_NOTHROW;
+
+  //! @brief Get address of the reserved region or NULL if there is none.
+  //!
+  //! @sa @c setRegionSize().
+  ASMJIT_API void* getRegionAddress() ASMJIT_NOTHROW;
+
+  //! @brief Reserve contiguous region of @a size bytes of virtual memory
+  //! where all code is placed.
+  //!
+  //! Chunks of virtual memory are normally allocated separately and placed
+  //! anywhere in the address space. If the region is reserved, chunks are
+  //! placed into it and its pages are committed only when used (and
+  //! decommitted when freed). Then all code is in one range of addresses:
+  //! if the region is smaller than 2GB all code can call other code directly
+  //! (and @c allocNear() uses it if the whole region is near enough) and the
+  //! code is easy to find for profilers and debuggers. When the region is
+  //! full, allocation fails.
+  //!
+  //! The region can be reserved (or released by setting @a size to zero)
+  //! only when there is no allocated memory. It can't be used together with
+  //! dual mapping and by memory manager of other process (Windows). Returns
+  //! @c true on success.
+  //!
+  //! @note Memory allocated with kMemAllocPermanent is not placed into the
+  //! region.
+  //!
+  //! @sa @c getRegionSize(), @c getRegionAddress().
+  ASMJIT_API bool setRegionSize(size_t size) ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Statistics]
+  // --------------------------------------------------------------------------
+
+  //! @brief Fill @a snapshot with the current state of the memory manager.
+  //!
+  //! The snapshot contains the state of each chunk of virtual memory (its
+  //! size, used bytes, count of unused runs and the largest one) and the
+  //! histogram of sizes of allocated blocks. The memory manager is locked
+  //! while the chunks are scanned, it takes time proportional to the count
+  //! of chunks. Blocks of shared trampolines and blocks cached by threads
+  //! (see @c setUseThreadCache()) are counted as allocated. Returns @c false
+  //! if there is not enough memory for the snapshot.
+  ASMJIT_API bool getSnapshot(MemorySnapshot* snapshot) ASMJIT_NOTHROW;
+
   // --------------------------------------------------------------------------
   // [Debug]
   // --------------------------------------------------------------------------
@@ -17,16 +17,95 @@
 
 // [Dependencies - Posix]
 #if defined(ASMJIT_POSIX)
+# include <stdio.h>
+# include <string.h>
 # include <sys/types.h>
 # include <sys/mman.h>
+# include <errno.h>
 # include <unistd.h>
 #endif // ASMJIT_POSIX
 
+// [Dependencies - Linux]
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif // __linux__
+
 // [Api-Begin]
 #include "../Core/ApiBegin.h"
 
 namespace AsmJit {
 
+// ============================================================================
+// [AsmJit::VirtualMemory - Near]
+// ============================================================================
+
+//! @brief Iterates addresses where memory can be placed near the hint address,
+//! the nearest addresses first.
+struct NearIterator
+{
+  enum { kMinStep = 1024 * 1024 };
+
+  inline NearIterator(const void* hint, size_t range, size_t size, size_t alignment) ASMJIT_NOTHROW
+  {
+    size_t h = (size_t)hint;
+
+    _hint = h;
+    _size = size;
+    _alignment = alignment;
+    _step = IntUtil::roundUp<size_t>(size > (size_t)kMinStep ? size : (size_t)kMinStep, alignment);
+
+    _rangeStart = (h > range) ? h - range : 0;
+    _rangeEnd = (h + range >= h) ? h + range : ~(size_t)0;
+
+    _above = IntUtil::roundUp<size_t>(h, alignment);
+    _below = (h > size) ? (h - size) & ~(alignment - 1) : 0;
+    _toggle = false;
+  }
+
+  //! @brief Get whether @a address of allocated memory is in range and aligned.
+  inline bool isNear(const void* address) const ASMJIT_NOTHROW
+  {
+    size_t a = (size_t)address;
+    return (a & (_alignment - 1)) == 0 && a >= _rangeStart && a + _size >= a && a + _size <= _rangeEnd;
+  }
+
+  //! @brief Get the next address, returns false if there are no more.
+  inline bool next(uint8_t** address) ASMJIT_NOTHROW
+  {
+    bool aboveValid = _above >= _hint && isNear((void*)_above);
+    bool belowValid = _below != 0 && isNear((void*)_below);
+
+    if (!aboveValid && !belowValid)
+      return false;
+
+    _toggle = !_toggle;
+    if ((_toggle && aboveValid) || !belowValid)
+    {
+      *address = (uint8_t*)_above;
+      _above += _step;
+    }
+    else
+    {
+      *address = (uint8_t*)_below;
+      _below = (_below > _step) ? _below - _step : 0;
+    }
+
+    return true;
+  }
+
+  size_t _hint;
+  size_t _size;
+  size_t _alignment;
+  size_t _step;
+
+  size_t _rangeStart;
+  size_t _rangeEnd;
+
+  size_t _above;
+  size_t _below;
+  bool _toggle;
+};
+
 // ============================================================================
 // [AsmJit::VirtualMemory - Windows]
 // ============================================================================
@@ -42,10 +121,15 @@ struct VirtualMemoryLocal
 
     alignment = info.dwAllocationGranularity;
     pageSize = IntUtil::roundUpToPowerOf2<uint32_t>(info.dwPageSize);
+
+    // Zero if large pages are not supported.
+    largePageSize = GetLargePageMinimum();
+    if (largePageSize == 0) largePageSize = 2 * 1024 * 1024;
   }
 
   size_t alignment;
   size_t pageSize;
+  size_t largePageSize;
 };
 
 static VirtualMemoryLocal& vm()
@@ -67,6 +151,12 @@ void VirtualMemory::free(void* addr, size_t length)
   return freeProcessMemory(GetCurrentProcess(), addr, length);
 }
 
+bool VirtualMemory::discard(void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+  return discardProcessMemory(GetCurrentProcess(), addr, length);
+}
+
 void* VirtualMemory::allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, bool canExecute)
   ASMJIT_NOTHROW
 {
@@ -91,6 +181,183 @@ void VirtualMemory::freeProcessMemory(HANDLE hProcess, void* addr, size_t /* len
   VirtualFreeEx(hProcess, addr, 0, MEM_RELEASE);
 }
 
+bool VirtualMemory::discardProcessMemory(HANDLE hProcess, void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+  // Pages stay committed (so they can't fail when accessed again), but the
+  // system doesn't need to preserve their content.
+  return VirtualAllocEx(hProcess, addr, length, MEM_RESET, PAGE_NOACCESS) != NULL;
+}
+
+void* VirtualMemory::reserve(size_t length, size_t* allocated)
+  ASMJIT_NOTHROW
+{
+  size_t msize = IntUtil::roundUp(length, vm().alignment);
+
+  LPVOID mbase = VirtualAlloc(NULL, msize, MEM_RESERVE, PAGE_NOACCESS);
+  if (mbase == NULL) return NULL;
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+bool VirtualMemory::commit(void* addr, size_t length, bool canExecute)
+  ASMJIT_NOTHROW
+{
+  WORD protect = canExecute ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+  return VirtualAlloc(addr, length, MEM_COMMIT, protect) != NULL;
+}
+
+bool VirtualMemory::decommit(void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+  return VirtualFree(addr, length, MEM_DECOMMIT) != FALSE;
+}
+
+// Allocate memory at the nearest free address, or anywhere if @a hint is NULL.
+static LPVOID _VirtualAllocNear(size_t msize, size_t alignment, DWORD type, DWORD protect, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  if (hint == NULL)
+    return VirtualAlloc(NULL, msize, type, protect);
+
+  NearIterator it(hint, range, msize, alignment);
+  uint8_t* addr;
+
+  while (it.next(&addr))
+  {
+    // Fails if the address is not free.
+    LPVOID mbase = VirtualAlloc(addr, msize, type, protect);
+    if (mbase != NULL) return mbase;
+  }
+
+  return NULL;
+}
+
+void* VirtualMemory::allocNear(size_t length, size_t* allocated, bool canExecute, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  size_t msize = IntUtil::roundUp(length, vm().pageSize);
+  WORD protect = canExecute ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+
+  LPVOID mbase = _VirtualAllocNear(msize, vm().alignment, MEM_COMMIT | MEM_RESERVE, protect, hint, range);
+  if (mbase == NULL) return NULL;
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+void* VirtualMemory::allocLargePages(size_t length, size_t* allocated, bool canExecute, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  size_t lpsize = vm().largePageSize;
+  size_t msize = IntUtil::roundUp(length, lpsize);
+  WORD protect = canExecute ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+
+  // Large pages require SeLockMemoryPrivilege, use normal pages if we don't
+  // have it.
+  LPVOID mbase = _VirtualAllocNear(msize, lpsize, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, protect, hint, range);
+  if (mbase == NULL)
+    mbase = _VirtualAllocNear(msize, vm().alignment, MEM_COMMIT | MEM_RESERVE, protect, hint, range);
+  if (mbase == NULL) return NULL;
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+void* VirtualMemory::allocDualMapping(size_t length, size_t* allocated, void** rw, bool largePages, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  // Large pages can't be used by views of the pagefile backed section.
+  ASMJIT_UNUSED(largePages);
+  size_t msize = IntUtil::roundUp(length, vm().alignment);
+
+  HANDLE hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+    PAGE_EXECUTE_READWRITE | SEC_COMMIT,
+    (DWORD)((uint64_t)msize >> 32), (DWORD)(msize & 0xFFFFFFFF), NULL);
+  if (hMapping == NULL) return NULL;
+
+  LPVOID mbase = NULL;
+  LPVOID mrw = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, msize);
+
+  if (hint == NULL)
+  {
+    mbase = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, msize);
+  }
+  else
+  {
+    NearIterator it(hint, range, msize, vm().alignment);
+    uint8_t* addr;
+
+    while (mbase == NULL && it.next(&addr))
+      mbase = MapViewOfFileEx(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, msize, addr);
+  }
+
+  // Views keep the mapping alive.
+  CloseHandle(hMapping);
+
+  if (mbase == NULL || mrw == NULL)
+  {
+    if (mbase) UnmapViewOfFile(mbase);
+    if (mrw) UnmapViewOfFile(mrw);
+    return NULL;
+  }
+
+  if (allocated != NULL)
+    *allocated = msize;
+
+  *rw = mrw;
+  return mbase;
+}
+
+void VirtualMemory::freeDualMapping(void* addr, void* rw, size_t /* length */)
+  ASMJIT_NOTHROW
+{
+  UnmapViewOfFile(addr);
+  UnmapViewOfFile(rw);
+}
+
+bool VirtualMemory::discardDualMapping(void* addr, void* rw, size_t length)
+  ASMJIT_NOTHROW
+{
+  // Both views share the same pages.
+  ASMJIT_UNUSED(addr);
+  return VirtualAlloc(rw, length, MEM_RESET, PAGE_NOACCESS) != NULL;
+}
+
+bool VirtualMemory::bindNumaNode(void* addr, size_t length, uint32_t numaNode)
+  ASMJIT_NOTHROW
+{
+  // Pages are placed by the first touch.
+  ASMJIT_UNUSED(addr);
+  ASMJIT_UNUSED(length);
+  ASMJIT_UNUSED(numaNode);
+  return false;
+}
+
+uint32_t VirtualMemory::getNumaNodeCount()
+  ASMJIT_NOTHROW
+{
+  ULONG highest;
+  if (!GetNumaHighestNodeNumber(&highest)) return 1;
+  return (uint32_t)highest + 1;
+}
+
+uint32_t VirtualMemory::getCurrentNumaNode()
+  ASMJIT_NOTHROW
+{
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600
+  UCHAR node;
+  if (!GetNumaProcessorNode((UCHAR)GetCurrentProcessorNumber(), &node)) return 0;
+  return node < getNumaNodeCount() ? node : 0;
+#else
+  return 0;
+#endif // _WIN32_WINNT
+}
+
 size_t VirtualMemory::getAlignment()
   ASMJIT_NOTHROW
 {
@@ -102,6 +369,12 @@ size_t VirtualMemory::getPageSize()
 {
   return vm().pageSize;
 }
+
+size_t VirtualMemory::getLargePageSize()
+  ASMJIT_NOTHROW
+{
+  return vm().largePageSize;
+}
 #endif // ASMJIT_WINDOWS
 
 // ============================================================================
@@ -115,15 +388,80 @@ size_t VirtualMemory::getPageSize()
 # define MAP_ANONYMOUS MAP_ANON
 #endif // MAP_ANONYMOUS
 
+// Not all systems can map memory without reserving swap space.
+#if !defined(MAP_NORESERVE)
+# define MAP_NORESERVE 0
+#endif // MAP_NORESERVE
+
+// Linux 4.17+ fails instead of replacing existing mapping, older kernels take
+// the address only as a hint (the result must be checked in both cases).
+#if !defined(MAP_FIXED_NOREPLACE)
+# if defined(__linux__)
+#  define MAP_FIXED_NOREPLACE 0x100000
+# else
+#  define MAP_FIXED_NOREPLACE 0
+# endif
+#endif // MAP_FIXED_NOREPLACE
+
+#if defined(__linux__)
+// Read the highest node id of the node list (e.g. "0-3,8,10-11") in @a path.
+static bool _ReadNodeList(const char* path, uint32_t* highest) ASMJIT_NOTHROW
+{
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return false;
+
+  char buf[256];
+  bool ok = fgets(buf, sizeof(buf), f) != NULL;
+  fclose(f);
+  if (!ok) return false;
+
+  // Ranges are sorted, the last number is the highest.
+  uint32_t id = 0;
+  bool found = false;
+
+  for (const char* p = buf; *p; p++)
+  {
+    if (*p < '0' || *p > '9') continue;
+
+    if (p == buf || p[-1] < '0' || p[-1] > '9') id = 0;
+    id = id * 10 + (uint32_t)(*p - '0');
+    found = true;
+  }
+
+  // The kernel supports at most 1024 nodes (MAX_NUMNODES).
+  if (!found || id >= 1024) return false;
+
+  *highest = id;
+  return true;
+}
+#endif // __linux__
+
 struct VirtualMemoryLocal
 {
   VirtualMemoryLocal() ASMJIT_NOTHROW
   {
     alignment = pageSize = ::getpagesize();
+
+    // Default large page size of x86/x64.
+    largePageSize = 2 * 1024 * 1024;
+
+    // Node ids can have gaps (nodes can be offline or missing), the count is
+    // the highest possible id + 1, so any id returned by the system is valid.
+    numaNodeCount = 1;
+#if defined(__linux__)
+    uint32_t highest;
+    if (_ReadNodeList("/sys/devices/system/node/possible", &highest) ||
+        _ReadNodeList("/sys/devices/system/node/online", &highest))
+    {
+      numaNodeCount = highest + 1;
+    }
+#endif // __linux__
   }
 
   size_t alignment;
   size_t pageSize;
+  size_t largePageSize;
+  uint32_t numaNodeCount;
 };
 
 static VirtualMemoryLocal& vm()
@@ -154,6 +492,305 @@ void VirtualMemory::free(void* addr, size_t length)
   munmap(addr, length);
 }
 
+bool VirtualMemory::discard(void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+  return ::madvise(addr, length, MADV_DONTNEED) == 0;
+}
+
+void* VirtualMemory::reserve(size_t length, size_t* allocated)
+  ASMJIT_NOTHROW
+{
+  size_t msize = IntUtil::roundUp<size_t>(length, vm().pageSize);
+
+  void* mbase = ::mmap(NULL, msize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mbase == MAP_FAILED)
+    return NULL;
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+bool VirtualMemory::commit(void* addr, size_t length, bool canExecute)
+  ASMJIT_NOTHROW
+{
+  int protection = PROT_READ | PROT_WRITE | (canExecute ? PROT_EXEC : 0);
+  return ::mprotect(addr, length, protection) == 0;
+}
+
+bool VirtualMemory::decommit(void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+  // Mapping new pages over the committed ones releases them.
+  void* mbase = ::mmap(addr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  return mbase != MAP_FAILED;
+}
+
+// Map memory at the nearest free address within @a range from @a hint.
+static void* _MapNear(size_t msize, size_t alignment, int protection, int flags, int fd, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  NearIterator it(hint, range, msize, alignment);
+  uint8_t* addr;
+
+  while (it.next(&addr))
+  {
+    void* mbase = ::mmap(addr, msize, protection, flags | MAP_FIXED_NOREPLACE, fd, 0);
+
+    if (mbase == MAP_FAILED)
+    {
+      // The address is not free, other errors are not related to it.
+      if (errno == EEXIST) continue;
+      break;
+    }
+
+    if (it.isNear(mbase))
+      return mbase;
+
+    ::munmap(mbase, msize);
+  }
+
+  return MAP_FAILED;
+}
+
+// Map memory aligned to @a alignment, which must be a power of 2 multiple of
+// the page size. If @a hint is not NULL the memory is mapped near it.
+static void* _MapAligned(size_t msize, size_t alignment, int protection, int flags, int fd,
+  const void* hint = NULL, size_t range = 0)
+  ASMJIT_NOTHROW
+{
+  if (hint != NULL)
+    return _MapNear(msize, alignment, protection, flags, fd, hint, range);
+
+  if (alignment <= vm().pageSize)
+    return ::mmap(NULL, msize, protection, flags, fd, 0);
+
+  // Reserve more address space than needed and release the unaligned head
+  // and tail of it.
+  uint8_t* mraw = (uint8_t*)::mmap(NULL, msize + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mraw == (uint8_t*)MAP_FAILED)
+    return MAP_FAILED;
+
+  uint8_t* mbase = (uint8_t*)IntUtil::roundUp<size_t>((size_t)mraw, alignment);
+  size_t head = (size_t)(mbase - mraw);
+
+  if (head != 0) ::munmap(mraw, head);
+  ::munmap(mbase + msize, alignment - head);
+
+  void* result = ::mmap(mbase, msize, protection, flags | MAP_FIXED, fd, 0);
+  if (result == MAP_FAILED)
+    ::munmap(mbase, msize);
+
+  return result;
+}
+
+// Advise the system to use transparent large pages.
+static void _AdviseLargePages(void* addr, size_t length)
+  ASMJIT_NOTHROW
+{
+#if defined(MADV_HUGEPAGE)
+  ::madvise(addr, length, MADV_HUGEPAGE);
+#else
+  ASMJIT_UNUSED(addr);
+  ASMJIT_UNUSED(length);
+#endif // MADV_HUGEPAGE
+}
+
+void* VirtualMemory::allocNear(size_t length, size_t* allocated, bool canExecute, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  size_t msize = IntUtil::roundUp<size_t>(length, vm().pageSize);
+  int protection = PROT_READ | PROT_WRITE | (canExecute ? PROT_EXEC : 0);
+
+  void* mbase = _MapAligned(msize, vm().pageSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, hint, range);
+  if (mbase == MAP_FAILED)
+    return NULL;
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+void* VirtualMemory::allocLargePages(size_t length, size_t* allocated, bool canExecute, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+  size_t msize = IntUtil::roundUp<size_t>(length, vm().largePageSize);
+  int protection = PROT_READ | PROT_WRITE | (canExecute ? PROT_EXEC : 0);
+  void* mbase = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+  // Only succeeds if the system has reserved large pages.
+  if (hint == NULL)
+    mbase = ::mmap(NULL, msize, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  else
+    mbase = _MapNear(msize, vm().largePageSize, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, hint, range);
+#endif // MAP_HUGETLB
+
+  if (mbase == MAP_FAILED)
+  {
+    mbase = _MapAligned(msize, vm().largePageSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, hint, range);
+    if (mbase == MAP_FAILED)
+      return NULL;
+
+    _AdviseLargePages(mbase, msize);
+  }
+
+  if (allocated != NULL)
+    *allocated = msize;
+  return mbase;
+}
+
+#if defined(__linux__) && defined(__NR_memfd_create)
+// Map file @a fd of @a msize bytes as read/execute (near @a hint) and as
+// read/write, returns the read/execute view or MAP_FAILED. Mappings keep the
+// file alive, it can be closed then.
+static void* _MapDualMapping(int fd, size_t msize, size_t alignment, bool advise,
+  const void* hint, size_t range, void** rw)
+{
+  if (::ftruncate(fd, (off_t)msize) != 0)
+    return MAP_FAILED;
+
+  void* mbase = _MapAligned(msize, alignment, PROT_READ | PROT_EXEC, MAP_SHARED, fd, hint, range);
+  void* mrw = _MapAligned(msize, alignment, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+
+  if (mbase == MAP_FAILED || mrw == MAP_FAILED)
+  {
+    if (mbase != MAP_FAILED) ::munmap(mbase, msize);
+    if (mrw != MAP_FAILED) ::munmap(mrw, msize);
+    return MAP_FAILED;
+  }
+
+  if (advise)
+  {
+    _AdviseLargePages(mrw, msize);
+    _AdviseLargePages(mbase, msize);
+  }
+
+  *rw = mrw;
+  return mbase;
+}
+#endif // __linux__ && __NR_memfd_create
+
+void* VirtualMemory::allocDualMapping(size_t length, size_t* allocated, void** rw, bool largePages, const void* hint, size_t range)
+  ASMJIT_NOTHROW
+{
+#if defined(__linux__) && defined(__NR_memfd_create)
+  size_t alignment = largePages ? vm().largePageSize : vm().pageSize;
+  size_t msize = IntUtil::roundUp<size_t>(length, alignment);
+
+  void* mbase = MAP_FAILED;
+  void* mrw = MAP_FAILED;
+
+  // Anonymous file, the memory is released when both views are unmapped.
+  // Prefer the file backed by reserved large pages (MFD_HUGETLB), it's
+  // created even if no large pages are reserved, but then mapping it fails.
+  if (largePages)
+  {
+    int fd = (int)::syscall(__NR_memfd_create, "asmjit", 1 /* MFD_CLOEXEC */ | 4 /* MFD_HUGETLB */);
+    if (fd != -1)
+    {
+      mbase = _MapDualMapping(fd, msize, alignment, false, hint, range, &mrw);
+      ::close(fd);
+    }
+  }
+
+  // Normal file, the system is advised to use transparent large pages.
+  if (mbase == MAP_FAILED)
+  {
+    int fd = (int)::syscall(__NR_memfd_create, "asmjit", 1 /* MFD_CLOEXEC */);
+    if (fd == -1)
+      return NULL;
+
+    mbase = _MapDualMapping(fd, msize, alignment, largePages, hint, range, &mrw);
+    ::close(fd);
+
+    if (mbase == MAP_FAILED)
+      return NULL;
+  }
+
+  if (allocated != NULL)
+    *allocated = msize;
+
+  *rw = mrw;
+  return mbase;
+#else
+  // Not supported.
+  ASMJIT_UNUSED(length);
+  ASMJIT_UNUSED(allocated);
+  ASMJIT_UNUSED(rw);
+  ASMJIT_UNUSED(largePages);
+  ASMJIT_UNUSED(hint);
+  ASMJIT_UNUSED(range);
+  return NULL;
+#endif // __linux__ && __NR_memfd_create
+}
+
+void VirtualMemory::freeDualMapping(void* addr, void* rw, size_t length)
+  ASMJIT_NOTHROW
+{
+  munmap(addr, length);
+  munmap(rw, length);
+}
+
+bool VirtualMemory::discardDualMapping(void* addr, void* rw, size_t length)
+  ASMJIT_NOTHROW
+{
+  // Pages of shared mapping stay in the file after MADV_DONTNEED, they must
+  // be removed from the file (it affects both views).
+  ASMJIT_UNUSED(addr);
+#if defined(MADV_REMOVE)
+  return ::madvise(rw, length, MADV_REMOVE) == 0;
+#else
+  ASMJIT_UNUSED(rw);
+  ASMJIT_UNUSED(length);
+  return false;
+#endif // MADV_REMOVE
+}
+
+bool VirtualMemory::bindNumaNode(void* addr, size_t length, uint32_t numaNode)
+  ASMJIT_NOTHROW
+{
+#if defined(__linux__) && defined(__NR_mbind)
+  enum { kMaxNodes = 1024, kBitsPerLong = sizeof(unsigned long) * 8 };
+  if (numaNode >= kMaxNodes) return false;
+
+  unsigned long mask[kMaxNodes / kBitsPerLong];
+  memset(mask, 0, sizeof(mask));
+  mask[numaNode / kBitsPerLong] = 1UL << (numaNode % kBitsPerLong);
+
+  // mbind(addr, length, MPOL_PREFERRED, mask, maxnode, 0).
+  return ::syscall(__NR_mbind, addr, length, 1, mask, (unsigned long)kMaxNodes + 1, 0) == 0;
+#else
+  // Not supported.
+  ASMJIT_UNUSED(addr);
+  ASMJIT_UNUSED(length);
+  ASMJIT_UNUSED(numaNode);
+  return false;
+#endif // __linux__ && __NR_mbind
+}
+
+uint32_t VirtualMemory::getNumaNodeCount()
+  ASMJIT_NOTHROW
+{
+  return vm().numaNodeCount;
+}
+
+uint32_t VirtualMemory::getCurrentNumaNode()
+  ASMJIT_NOTHROW
+{
+#if defined(__linux__) && defined(__NR_getcpu)
+  unsigned int cpu;
+  unsigned int node;
+
+  // The count can be read from the list of online nodes (hotplug).
+  if (::syscall(__NR_getcpu, &cpu, &node, NULL) != 0) return 0;
+  return node < vm().numaNodeCount ? node : 0;
+#else
+  return 0;
+#endif // __linux__ && __NR_getcpu
+}
+
 size_t VirtualMemory::getAlignment()
   ASMJIT_NOTHROW
 {
@@ -165,6 +802,12 @@ size_t VirtualMemory::getPageSize()
 {
   return vm().pageSize;
 }
+
+size_t VirtualMemory::getLargePageSize()
+  ASMJIT_NOTHROW
+{
+  return vm().largePageSize;
+}
 #endif // ASMJIT_POSIX
 
 } // AsmJit namespace
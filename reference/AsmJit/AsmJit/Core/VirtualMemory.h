@@ -47,9 +47,53 @@ struct VirtualMemory
   //! allocated memory, or NULL if failed.
   ASMJIT_API static void* alloc(size_t length, size_t* allocated, bool canExecute) ASMJIT_NOTHROW;
 
-  //! @brief Free memory allocated by @c alloc()
+  //! @brief Free memory allocated by @c alloc() or @c allocLargePages()
   ASMJIT_API static void free(void* addr, size_t length) ASMJIT_NOTHROW;
 
+  //! @brief Return physical pages of memory allocated by @c alloc() to the
+  //! system, but keep them mapped.
+  //!
+  //! Content of pages is lost, they are mapped again when accessed next time.
+  //! Both @a addr and @a length must be aligned to the page size. Returns
+  //! @c false if not supported or failed.
+  ASMJIT_API static bool discard(void* addr, size_t length) ASMJIT_NOTHROW;
+
+  //! @brief Reserve virtual memory (address space only).
+  //!
+  //! Reserved pages are not accessible and they don't consume physical
+  //! memory until they are committed by @c commit(). Returns the address of
+  //! reserved memory, or NULL if failed. Use @c free() to release it.
+  ASMJIT_API static void* reserve(size_t length, size_t* allocated) ASMJIT_NOTHROW;
+
+  //! @brief Commit pages of memory reserved by @c reserve().
+  //!
+  //! Committed pages are readable/writeable, but they are not guaranteed to
+  //! be executable unless 'canExecute' is true. Both @a addr and @a length
+  //! must be aligned to the page size. Returns @c false if failed.
+  ASMJIT_API static bool commit(void* addr, size_t length, bool canExecute) ASMJIT_NOTHROW;
+
+  //! @brief Decommit pages committed by @c commit(), they stay reserved.
+  ASMJIT_API static bool decommit(void* addr, size_t length) ASMJIT_NOTHROW;
+
+  //! @brief Allocate virtual memory near @a hint.
+  //!
+  //! Works like @c alloc(), but the whole allocated memory is within @a range
+  //! bytes from @a hint. Returns NULL if there is no free space in range.
+  ASMJIT_API static void* allocNear(size_t length, size_t* allocated, bool canExecute, const void* hint, size_t range) ASMJIT_NOTHROW;
+
+  //! @brief Allocate virtual memory backed by large pages.
+  //!
+  //! The @a length is rounded up to the large page size and the returned
+  //! memory is aligned to it. If the system can't provide large pages, the
+  //! memory is allocated using normal pages and the system is advised to use
+  //! transparent large pages if it supports them. Returns the address of
+  //! allocated memory, or NULL if failed.
+  //!
+  //! If @a hint is not NULL the memory is allocated near it, see
+  //! @c allocNear().
+  ASMJIT_API static void* allocLargePages(size_t length, size_t* allocated, bool canExecute,
+    const void* hint = NULL, size_t range = 0) ASMJIT_NOTHROW;
+
 #if defined(ASMJIT_WINDOWS)
   //! @brief Allocate virtual memory of @a hProcess.
   //!
@@ -60,13 +104,65 @@ struct VirtualMemory
   //!
   //! @note This function is Windows specific.
   ASMJIT_API static void freeProcessMemory(HANDLE hProcess, void* addr, size_t length) ASMJIT_NOTHROW;
+
+  //! @brief Return physical pages of virtual memory of @a hProcess to the
+  //! system, see @c discard().
+  //!
+  //! @note This function is Windows specific.
+  ASMJIT_API static bool discardProcessMemory(HANDLE hProcess, void* addr, size_t length) ASMJIT_NOTHROW;
 #endif // ASMJIT_WINDOWS
 
+  //! @brief Allocate virtual memory mapped twice.
+  //!
+  //! Returned pages are readable/executable, but not writeable. The same
+  //! pages are mapped also as readable/writeable, but not executable and
+  //! stored to @a rw. This is used on systems that refuse to map memory
+  //! which is both writeable and executable. Returns the address of
+  //! executable memory, or NULL if failed or not supported by the system.
+  //!
+  //! If @a largePages is true the memory is allocated the same way as by
+  //! @c allocLargePages(). If @a hint is not NULL the executable memory is
+  //! allocated near it, see @c allocNear().
+  ASMJIT_API static void* allocDualMapping(size_t length, size_t* allocated, void** rw, bool largePages = false,
+    const void* hint = NULL, size_t range = 0) ASMJIT_NOTHROW;
+
+  //! @brief Free memory allocated by @c allocDualMapping()
+  ASMJIT_API static void freeDualMapping(void* addr, void* rw, size_t length) ASMJIT_NOTHROW;
+
+  //! @brief Return physical pages of memory allocated by
+  //! @c allocDualMapping() to the system, see @c discard().
+  ASMJIT_API static bool discardDualMapping(void* addr, void* rw, size_t length) ASMJIT_NOTHROW;
+
+  //! @brief Place physical pages of memory at @a addr on NUMA node
+  //! @a numaNode.
+  //!
+  //! It must be called before the pages are touched, the node is only
+  //! preferred (pages are placed elsewhere if the node has no free memory).
+  //! Returns @c false if not supported (Windows and systems other than
+  //! Linux), the pages are then placed on the node of the thread which
+  //! touches them first.
+  ASMJIT_API static bool bindNumaNode(void* addr, size_t length, uint32_t numaNode) ASMJIT_NOTHROW;
+
+  //! @brief Get count of NUMA nodes (one if the system doesn't support NUMA).
+  //!
+  //! It's the highest node id + 1, some nodes in the range may not exist.
+  ASMJIT_API static uint32_t getNumaNodeCount() ASMJIT_NOTHROW;
+
+  //! @brief Get NUMA node of the processor which runs the calling thread.
+  //!
+  //! The node is always less than @c getNumaNodeCount(), so it can be used as
+  //! index. The thread can be moved to other processor right after the call,
+  //! unless it's pinned.
+  ASMJIT_API static uint32_t getCurrentNumaNode() ASMJIT_NOTHROW;
+
   //! @brief Get the alignment guaranteed by alloc().
   ASMJIT_API static size_t getAlignment() ASMJIT_NOTHROW;
 
   //! @brief Get size of single page.
   ASMJIT_API static size_t getPageSize() ASMJIT_NOTHROW;
+
+  //! @brief Get size of single large page.
+  ASMJIT_API static size_t getLargePageSize() ASMJIT_NOTHROW;
 };
 
 //! @}
@@ -9,6 +9,7 @@
 // [Dependencies - AsmJit]
 #include "../Core/Defs.h"
 #include "../Core/IntUtil.h"
+#include "../Core/Lock.h"
 #include "../Core/ZoneMemory.h"
 
 // [Api-Begin]
@@ -16,6 +17,107 @@
 
 namespace AsmJit {
 
+// ============================================================================
+// [AsmJit::ZonePool]
+// ============================================================================
+
+ZonePool::ZonePool() ASMJIT_NOTHROW
+{
+  _chunks = NULL;
+  _chunkCount = 0;
+  _chunkBytes = 0;
+}
+
+ZonePool::~ZonePool() ASMJIT_NOTHROW
+{
+  reset();
+}
+
+ZoneChunk* ZonePool::take(size_t size) ASMJIT_NOTHROW
+{
+  ZoneChunk** pCur = &_chunks;
+  ZoneChunk** pBest = NULL;
+  ZoneChunk* cur;
+
+  // Take the smallest chunk large enough, so chunks for large allocations
+  // remain available. Most chunks have the default size of some zone, so the
+  // search usually ends by exact match.
+  while ((cur = *pCur) != NULL)
+  {
+    if (cur->size >= size && (pBest == NULL || cur->size < (*pBest)->size))
+    {
+      pBest = pCur;
+      if (cur->size == size) break;
+    }
+    pCur = &cur->prev;
+  }
+
+  if (pBest == NULL)
+    return NULL;
+
+  cur = *pBest;
+  *pBest = cur->prev;
+
+  _chunkCount--;
+  _chunkBytes -= cur->size;
+  return cur;
+}
+
+void ZonePool::put(ZoneChunk* chunk) ASMJIT_NOTHROW
+{
+  chunk->prev = _chunks;
+  _chunks = chunk;
+
+  _chunkCount++;
+  _chunkBytes += chunk->size;
+}
+
+void ZonePool::reset() ASMJIT_NOTHROW
+{
+  ZoneChunk* cur = _chunks;
+
+  _chunks = NULL;
+  _chunkCount = 0;
+  _chunkBytes = 0;
+
+  while (cur != NULL)
+  {
+    ZoneChunk* prev = cur->prev;
+    ASMJIT_FREE(cur);
+    cur = prev;
+  }
+}
+
+static void ASMJIT_THREAD_LOCAL_CALL _DestroyThreadPool(void* pool)
+{
+  ZonePool* p = reinterpret_cast<ZonePool*>(pool);
+
+  p->~ZonePool();
+  ASMJIT_FREE(p);
+}
+
+static ThreadLocal _threadPool(_DestroyThreadPool);
+
+ZonePool* ZonePool::getThreadPool() ASMJIT_NOTHROW
+{
+  ZonePool* pool = reinterpret_cast<ZonePool*>(_threadPool.get());
+  if (pool != NULL) return pool;
+
+  pool = reinterpret_cast<ZonePool*>(ASMJIT_MALLOC(sizeof(ZonePool)));
+  if (pool == NULL) return NULL;
+
+  new(pool) ZonePool();
+
+  // Thread local storage is not available, the pool would leak.
+  if (!_threadPool.set(pool))
+  {
+    _DestroyThreadPool(pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
 // ============================================================================
 // [AsmJit::ZoneMemory]
 // ============================================================================
@@ -25,6 +127,16 @@ ZoneMemory::ZoneMemory(size_t chunkSize) ASMJIT_NOTHROW
   _chunks = NULL;
   _total = 0;
   _chunkSize = chunkSize;
+  _pool = NULL;
+}
+
+// Return @a chunk to @a pool or free it.
+static inline void _FreeChunk(ZonePool* pool, ZoneChunk* chunk) ASMJIT_NOTHROW
+{
+  if (pool != NULL)
+    pool->put(chunk);
+  else
+    ASMJIT_FREE(chunk);
 }
 
 ZoneMemory::~ZoneMemory() ASMJIT_NOTHROW
@@ -46,13 +158,19 @@ void* ZoneMemory::alloc(size_t size) ASMJIT_NOTHROW
     if (chSize < size)
       chSize = size;
 
-    cur = (ZoneChunk*)ASMJIT_MALLOC(sizeof(ZoneChunk) - sizeof(void*) + chSize);
+    cur = (_pool != NULL) ? _pool->take(chSize) : NULL;
+
     if (cur == NULL)
-      return NULL;
+    {
+      cur = (ZoneChunk*)ASMJIT_MALLOC(sizeof(ZoneChunk) - sizeof(void*) + chSize);
+      if (cur == NULL)
+        return NULL;
+
+      cur->size = chSize;
+    }
 
     cur->prev = _chunks;
     cur->pos = 0;
-    cur->size = _chunkSize;
     _chunks = cur;
   }
 
@@ -89,15 +207,17 @@ void ZoneMemory::clear() ASMJIT_NOTHROW
   if (cur == NULL)
     return;
 
+  // Keep the newest chunk, the older chunks are freed.
+  cur = cur->prev;
+
   _chunks->pos = 0;
   _chunks->prev = NULL;
   _total = 0;
 
-  cur = cur->prev;
   while (cur != NULL)
   {
     ZoneChunk* prev = cur->prev;
-    ASMJIT_FREE(cur);
+    _FreeChunk(_pool, cur);
     cur = prev;
   }
 }
@@ -112,7 +232,7 @@ void ZoneMemory::reset() ASMJIT_NOTHROW
   while (cur != NULL)
   {
     ZoneChunk* prev = cur->prev;
-    ASMJIT_FREE(cur);
+    _FreeChunk(_pool, cur);
     cur = prev;
   }
 }
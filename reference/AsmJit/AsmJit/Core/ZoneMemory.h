@@ -47,6 +47,72 @@ struct ZoneChunk
   uint8_t data[sizeof(void*)];
 };
 
+// ============================================================================
+// [AsmJit::ZonePool]
+// ============================================================================
+
+//! @brief Cache of chunks shared by @c ZoneMemory instances.
+//!
+//! Zone using the pool (see @c ZoneMemory::setPool()) takes chunks from the
+//! pool before allocating them from the heap and returns them back to the
+//! pool when it's cleared or reset. The pool keeps all chunks returned, so
+//! it contains the most chunks used at the same time and zones used the
+//! same way again don't allocate at all.
+//!
+//! The pool is not thread-safe, use @c getThreadPool() to get the pool of
+//! the calling thread.
+struct ZonePool
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create new instance of @c ZonePool.
+  ASMJIT_API ZonePool() ASMJIT_NOTHROW;
+  //! @brief Destroy @ref ZonePool instance, all chunks are freed.
+  ASMJIT_API ~ZonePool() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Methods]
+  // --------------------------------------------------------------------------
+
+  //! @brief Take chunk which contains at least @a size bytes, returns NULL if
+  //! there is no such chunk.
+  ASMJIT_API ZoneChunk* take(size_t size) ASMJIT_NOTHROW;
+  //! @brief Return @a chunk to the pool.
+  ASMJIT_API void put(ZoneChunk* chunk) ASMJIT_NOTHROW;
+  //! @brief Free all chunks.
+  ASMJIT_API void reset() ASMJIT_NOTHROW;
+
+  //! @brief Get count of chunks in the pool.
+  inline size_t getChunkCount() const ASMJIT_NOTHROW { return _chunkCount; }
+  //! @brief Get total size of chunks in the pool.
+  inline size_t getChunkBytes() const ASMJIT_NOTHROW { return _chunkBytes; }
+
+  // --------------------------------------------------------------------------
+  // [Statics]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get pool of the calling thread, it's created when used first time
+  //! and destroyed when the thread exits.
+  //!
+  //! @note Pool is not destroyed under Windows older than Vista (thread local
+  //! storage doesn't support destructors), its chunks are freed only by
+  //! @c reset().
+  ASMJIT_API static ZonePool* getThreadPool() ASMJIT_NOTHROW;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Chunks in the pool.
+  ZoneChunk* _chunks;
+  //! @brief Count of chunks in the pool.
+  size_t _chunkCount;
+  //! @brief Total size of chunks in the pool.
+  size_t _chunkBytes;
+};
+
 // ============================================================================
 // [AsmJit::ZoneMemory]
 // ============================================================================
@@ -132,6 +198,15 @@ struct ZoneMemory
   //! @brief Get (default) chunk size.
   inline size_t getChunkSize() const ASMJIT_NOTHROW { return _chunkSize; }
 
+  //! @brief Get pool where chunks are taken from and returned to.
+  inline ZonePool* getPool() const ASMJIT_NOTHROW { return _pool; }
+  //! @brief Set pool where chunks are taken from and returned to (NULL to
+  //! allocate and free them).
+  //!
+  //! Chunks allocated before are returned to the new pool. The pool must
+  //! exist until the zone is reset or destroyed.
+  inline void setPool(ZonePool* pool) ASMJIT_NOTHROW { _pool = pool; }
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -142,6 +217,8 @@ struct ZoneMemory
   size_t _total;
   //! @brief One chunk size.
   size_t _chunkSize;
+  //! @brief Pool of chunks or NULL.
+  ZonePool* _pool;
 };
 
 //! @}
@@ -0,0 +1,354 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// [Guard]
+#ifndef _ASMJIT_CORE_ZONEVECTOR_H
+#define _ASMJIT_CORE_ZONEVECTOR_H
+
+// [Dependencies - AsmJit]
+#include "../Core/Assert.h"
+#include "../Core/Defs.h"
+#include "../Core/ZoneMemory.h"
+
+// [Dependencies - C]
+#include <string.h>
+
+namespace AsmJit {
+
+//! @addtogroup AsmJit_Core
+//! @{
+
+// ============================================================================
+// [AsmJit::ZoneVector<T>]
+// ============================================================================
+
+//! @brief Array of POD data allocated by @c ZoneMemory.
+//!
+//! The interface is the same as @c PodVector has, but the array is never
+//! freed by the vector, it's released together with all other memory of the
+//! zone. When the array grows the new one is allocated from the zone and
+//! the old one remains there until the zone is cleared or reset.
+//!
+//! @note Call @c reset() each time the zone is cleared or reset, the array
+//! is not valid anymore.
+template <typename T>
+struct ZoneVector
+{
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create new instance of ZoneVector template using @a zone. Data
+  //! will not be allocated (will be NULL).
+  inline ZoneVector(ZoneMemory* zone) ASMJIT_NOTHROW :
+    _data(NULL),
+    _length(0),
+    _capacity(0),
+    _zone(zone)
+  {
+  }
+
+  //! @brief Destroy ZoneVector (data are owned by the zone).
+  inline ~ZoneVector() ASMJIT_NOTHROW
+  {
+  }
+
+  // --------------------------------------------------------------------------
+  // [Data]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get data.
+  inline T* getData() ASMJIT_NOTHROW { return _data; }
+  //! @overload
+  inline const T* getData() const ASMJIT_NOTHROW { return _data; }
+
+  //! @brief Get length.
+  inline size_t getLength() const ASMJIT_NOTHROW { return _length; }
+  //! @brief Get capacity.
+  inline size_t getCapacity() const ASMJIT_NOTHROW { return _capacity; }
+
+  //! @brief Get zone used to allocate data.
+  inline ZoneMemory* getZone() const ASMJIT_NOTHROW { return _zone; }
+
+  // --------------------------------------------------------------------------
+  // [Manipulation]
+  // --------------------------------------------------------------------------
+
+  //! @brief Clear vector data, but keep the array for reuse.
+  inline void clear() ASMJIT_NOTHROW
+  {
+    _length = 0;
+  }
+
+  //! @brief Clear vector data and forget the array (the memory is released
+  //! by the zone).
+  inline void reset() ASMJIT_NOTHROW
+  {
+    _data = NULL;
+    _length = 0;
+    _capacity = 0;
+  }
+
+  //! @brief Prepend @a item to vector.
+  bool prepend(const T& item) ASMJIT_NOTHROW
+  {
+    if (_length == _capacity && !_grow()) return false;
+
+    memmove(_data + 1, _data, sizeof(T) * _length);
+    memcpy(_data, &item, sizeof(T));
+
+    _length++;
+    return true;
+  }
+
+  //! @brief Insert an @a item at the @a index.
+  bool insert(size_t index, const T& item) ASMJIT_NOTHROW
+  {
+    ASMJIT_ASSERT(index <= _length);
+    if (_length == _capacity && !_grow()) return false;
+
+    T* dst = _data + index;
+    memmove(dst + 1, dst, sizeof(T) * (_length - index));
+    memcpy(dst, &item, sizeof(T));
+
+    _length++;
+    return true;
+  }
+
+  //! @brief Append @a item to vector.
+  inline bool append(const T& item) ASMJIT_NOTHROW
+  {
+    if (_length == _capacity && !_grow()) return false;
+
+    memcpy(_data + _length, &item, sizeof(T));
+
+    _length++;
+    return true;
+  }
+
+  //! @brief Get index of @a val or kInvalidSize if not found.
+  size_t indexOf(const T& val) const ASMJIT_NOTHROW
+  {
+    size_t i = 0, len = _length;
+    for (i = 0; i < len; i++) { if (_data[i] == val) return i; }
+    return kInvalidSize;
+  }
+
+  //! @brief Remove element at index @a i.
+  void removeAt(size_t i) ASMJIT_NOTHROW
+  {
+    ASMJIT_ASSERT(i < _length);
+
+    T* dst = _data + i;
+    _length--;
+    memmove(dst, dst + 1, sizeof(T) * (_length - i));
+  }
+
+  //! @brief Reserve space for @a to items, returns false if out of memory.
+  bool reserve(size_t to) ASMJIT_NOTHROW
+  {
+    return to <= _capacity || _realloc(to);
+  }
+
+  //! @brief Get item at position @a i.
+  inline T& operator[](size_t i) ASMJIT_NOTHROW
+  {
+    ASMJIT_ASSERT(i < _length);
+    return _data[i];
+  }
+  //! @brief Get item at position @a i.
+  inline const T& operator[](size_t i) const ASMJIT_NOTHROW
+  {
+    ASMJIT_ASSERT(i < _length);
+    return _data[i];
+  }
+
+  //! @brief Append the item and return address so it can be initialized.
+  inline T* newItem() ASMJIT_NOTHROW
+  {
+    if (_length == _capacity && !_grow()) return NULL;
+    return _data + (_length++);
+  }
+
+  // --------------------------------------------------------------------------
+  // [Private]
+  // --------------------------------------------------------------------------
+
+  //! @brief Called to grow internal array.
+  bool _grow() ASMJIT_NOTHROW
+  {
+    return _realloc(_capacity < 16 ? 16 : _capacity * 2);
+  }
+
+  //! @brief Allocate new array which fits @a to items and copy the data.
+  bool _realloc(size_t to) ASMJIT_NOTHROW
+  {
+    ASMJIT_ASSERT(to >= _length);
+
+    T* p = reinterpret_cast<T*>(_zone->alloc(to * sizeof(T)));
+    if (p == NULL)
+      return false;
+
+    if (_length != 0)
+      memcpy(p, _data, _length * sizeof(T));
+
+    _data = p;
+    _capacity = to;
+    return true;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief Items data.
+  T* _data;
+  //! @brief Length of buffer (count of items in array).
+  size_t _length;
+  //! @brief Capacity of buffer (maximum items that can fit to current array).
+  size_t _capacity;
+  //! @brief Zone used to allocate data.
+  ZoneMemory* _zone;
+
+  ASMJIT_NO_COPY(ZoneVector<T>)
+};
+
+// ============================================================================
+// [AsmJit::ZoneList<T>]
+// ============================================================================
+
+//! @brief Singly linked list of POD data allocated by @c ZoneMemory.
+//!
+//! Unlike @c ZoneVector the items are never copied, so the list is better
+//! for queues where items are only appended and walked.
+//!
+//! @note Call @c reset() each time the zone is cleared or reset.
+template <typename T>
+struct ZoneList
+{
+  // --------------------------------------------------------------------------
+  // [Link]
+  // --------------------------------------------------------------------------
+
+  //! @brief Link of the list.
+  struct Link
+  {
+    //! @brief Get next link or NULL.
+    inline Link* getNext() const ASMJIT_NOTHROW { return next; }
+    //! @brief Get item.
+    inline T& getItem() ASMJIT_NOTHROW { return item; }
+    //! @overload
+    inline const T& getItem() const ASMJIT_NOTHROW { return item; }
+
+    //! @brief Next link.
+    Link* next;
+    //! @brief Item.
+    T item;
+  };
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! @brief Create new instance of ZoneList template using @a zone.
+  inline ZoneList(ZoneMemory* zone) ASMJIT_NOTHROW :
+    _first(NULL),
+    _last(NULL),
+    _length(0),
+    _zone(zone)
+  {
+  }
+
+  //! @brief Destroy ZoneList (links are owned by the zone).
+  inline ~ZoneList() ASMJIT_NOTHROW
+  {
+  }
+
+  // --------------------------------------------------------------------------
+  // [Data]
+  // --------------------------------------------------------------------------
+
+  //! @brief Get first link or NULL if the list is empty.
+  inline Link* getFirst() const ASMJIT_NOTHROW { return _first; }
+  //! @brief Get last link or NULL if the list is empty.
+  inline Link* getLast() const ASMJIT_NOTHROW { return _last; }
+
+  //! @brief Get count of items.
+  inline size_t getLength() const ASMJIT_NOTHROW { return _length; }
+  //! @brief Get whether the list is empty.
+  inline bool isEmpty() const ASMJIT_NOTHROW { return _length == 0; }
+
+  //! @brief Get zone used to allocate links.
+  inline ZoneMemory* getZone() const ASMJIT_NOTHROW { return _zone; }
+
+  // --------------------------------------------------------------------------
+  // [Manipulation]
+  // --------------------------------------------------------------------------
+
+  //! @brief Clear the list (the links are released by the zone).
+  inline void reset() ASMJIT_NOTHROW
+  {
+    _first = NULL;
+    _last = NULL;
+    _length = 0;
+  }
+
+  //! @brief Prepend @a item to list.
+  bool prepend(const T& item) ASMJIT_NOTHROW
+  {
+    Link* link = reinterpret_cast<Link*>(_zone->alloc(sizeof(Link)));
+    if (link == NULL) return false;
+
+    link->next = _first;
+    memcpy(&link->item, &item, sizeof(T));
+
+    if (_last == NULL) _last = link;
+    _first = link;
+
+    _length++;
+    return true;
+  }
+
+  //! @brief Append @a item to list.
+  bool append(const T& item) ASMJIT_NOTHROW
+  {
+    Link* link = reinterpret_cast<Link*>(_zone->alloc(sizeof(Link)));
+    if (link == NULL) return false;
+
+    link->next = NULL;
+    memcpy(&link->item, &item, sizeof(T));
+
+    if (_last != NULL)
+      _last->next = link;
+    else
+      _first = link;
+    _last = link;
+
+    _length++;
+    return true;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! @brief First link.
+  Link* _first;
+  //! @brief Last link.
+  Link* _last;
+  //! @brief Count of items.
+  size_t _length;
+  //! @brief Zone used to allocate links.
+  ZoneMemory* _zone;
+
+  ASMJIT_NO_COPY(ZoneList<T>)
+};
+
+//! @}
+
+} // AsmJit namespace
+
+#endif // _ASMJIT_CORE_ZONEVECTOR_H
@@ -471,18 +471,25 @@ void X86Assembler::_emitJmpOrCallReloc(uint32_t instruction, void* target) ASMJI
   RelocData rd;
 
   rd.type = kRelocTrampoline;
-
-#if defined(ASMJIT_X64)
-  // If we are compiling in 64-bit mode, we can use trampoline if relative jump
-  // is not possible.
-  _trampolineSize += X64TrampolineWriter::kSizeTotal;
-#endif // ARCHITECTURE_SPECIFIC
-
   rd.size = 4;
+  rd.prevRelocId = kInvalidValue;
   rd.offset = getOffset();
   rd.address = target;
 
-  _relocData.append(rd);
+  if (_relocData.append(rd))
+  {
+#if defined(ASMJIT_X64)
+    // If we are compiling in 64-bit mode, we can use trampoline if relative
+    // jump is not possible. The trampoline is shared by all jumps and calls
+    // to the same target, they are linked by prevRelocId.
+    uint32_t relocId = (uint32_t)_relocData.getLength() - 1;
+    uint32_t prevRelocId = _linkTrampoline(relocId);
+
+    _relocData[relocId].prevRelocId = prevRelocId;
+    if (prevRelocId == kInvalidValue)
+      _trampolineSize += X64TrampolineWriter::kSizeTotal;
+#endif // ARCHITECTURE_SPECIFIC
+  }
 
   // Emit dummy 32-bit integer (will be overwritten by relocCode()).
   _emitInt32(0);
@@ -2557,30 +2564,60 @@ void X86Assembler::_emitJcc(uint32_t code, const Label* label, uint32_t hint) AS
 // [AsmJit::Assembler - Relocation helpers]
 // ============================================================================
 
-size_t X86Assembler::relocCode(void* _dst, sysuint_t addressBase) const ASMJIT_NOTHROW
+size_t X86Assembler::relocCode(void* dst, sysuint_t addressBase) const ASMJIT_NOTHROW
+{
+  return relocCode(dst, addressBase, NULL);
+}
+
+size_t X86Assembler::relocCode(void* dst, sysuint_t addressBase, MemoryManager* memmgr) const ASMJIT_NOTHROW
+{
+  return relocRaw(dst, addressBase, memmgr,
+    _buffer.getData(), _buffer.getOffset(), _relocData.getData(), _relocData.getLength(),
+    getLogger());
+}
+
+Assembler::RelocFunc X86Assembler::getRelocFunc() const ASMJIT_NOTHROW
+{
+  return relocRaw;
+}
+
+#if defined(ASMJIT_X64)
+// Get offset (from the start of the code) the already relocated 32-bit
+// displacement @a r jumps to.
+static inline sysuint_t _GetRelocTarget(const uint8_t* dst, const Assembler::RelocData& r) ASMJIT_NOTHROW
+{
+  return (sysuint_t)r.offset + 4 + (sysint_t)*reinterpret_cast<const int32_t*>(dst + r.offset);
+}
+#endif // ASMJIT_X64
+
+size_t X86Assembler::relocRaw(void* _dst, sysuint_t addressBase, MemoryManager* memmgr,
+  const uint8_t* code, size_t codeSize, const RelocData* relocData, size_t relocCount,
+  Logger* logger) ASMJIT_NOTHROW
 {
   // Copy code to virtual memory (this is a given _dst pointer).
   uint8_t* dst = reinterpret_cast<uint8_t*>(_dst);
-
-  size_t coff = _buffer.getOffset();
-  size_t csize = getCodeSize();
+  size_t coff = codeSize;
 
   // We are copying the exact size of the generated code. Extra code for trampolines
   // is generated on-the-fly by relocator (this code doesn't exist at the moment).
-  memcpy(dst, _buffer.getData(), coff);
+  // The code emitted directly to the destination is relocated in place.
+  if (dst != code)
+    memcpy(dst, code, coff);
 
 #if defined(ASMJIT_X64)
   // Trampoline pointer.
   uint8_t* tramp = dst + coff;
+#else
+  ASMJIT_UNUSED(memmgr);
+  ASMJIT_UNUSED(logger);
 #endif // ASMJIT_X64
 
   // Relocate all recorded locations.
   size_t i;
-  size_t len = _relocData.getLength();
 
-  for (i = 0; i < len; i++)
+  for (i = 0; i < relocCount; i++)
   {
-    const RelocData& r = _relocData[i];
+    const RelocData& r = relocData[i];
     sysint_t val;
 
 #if defined(ASMJIT_X64)
@@ -2590,7 +2627,7 @@ size_t X86Assembler::relocCode(void* _dst, sysuint_t addressBase) const ASMJIT_N
 #endif // ASMJIT_X64
 
     // Be sure that reloc data structure is correct.
-    ASMJIT_ASSERT((size_t)(r.offset + r.size) <= csize);
+    ASMJIT_ASSERT((size_t)(r.offset + r.size) <= coff);
 
     switch (r.type)
     {
@@ -2609,8 +2646,53 @@ size_t X86Assembler::relocCode(void* _dst, sysuint_t addressBase) const ASMJIT_N
 #if defined(ASMJIT_X64)
         if (r.type == kRelocTrampoline && !IntUtil::isInt32(val))
         {
-          val = (sysint_t)( (sysuint_t)tramp - ((sysuint_t)_dst + (sysuint_t)r.offset + 4) );
-          useTrampoline = true;
+          // Trampoline used by the previous relocation to the same target
+          // (relocations are linked by prevRelocId), it's either shared or
+          // written after the code.
+          if (r.prevRelocId != kInvalidValue)
+          {
+            val = (sysint_t)( _GetRelocTarget(dst, relocData[r.prevRelocId]) - ((sysuint_t)r.offset + 4) );
+            if (IntUtil::isInt32(val))
+              break;
+          }
+
+          // Trampoline shared with other code placed near by memory manager.
+          if (memmgr != NULL)
+          {
+            uint8_t code[X64TrampolineWriter::kSizeTotal];
+            X64TrampolineWriter::writeTrampoline(code, (uint64_t)r.address);
+
+            void* shared = memmgr->getTrampoline(
+              (void*)(addressBase + r.offset), r.address, code, X64TrampolineWriter::kSizeTotal);
+
+            if (shared != NULL)
+            {
+              val = (sysint_t)( (sysuint_t)shared - (addressBase + (sysuint_t)r.offset + 4) );
+              if (IntUtil::isInt32(val))
+                break;
+            }
+          }
+
+          // Trampoline to the same target already written after the code by
+          // some previous relocation, there is at most one.
+          sysuint_t trampOffset = (sysuint_t)(tramp - dst);
+          uint32_t prevId = r.prevRelocId;
+
+          while (prevId != kInvalidValue)
+          {
+            const RelocData& prev = relocData[prevId];
+            sysuint_t prevTarget = _GetRelocTarget(dst, prev);
+
+            if (prevTarget >= (sysuint_t)coff && prevTarget < (sysuint_t)(tramp - dst))
+            {
+              trampOffset = prevTarget;
+              break;
+            }
+            prevId = prev.prevRelocId;
+          }
+
+          val = (sysint_t)( trampOffset - ((sysuint_t)r.offset + 4) );
+          useTrampoline = (trampOffset == (sysuint_t)(tramp - dst));
         }
 #endif // ASMJIT_X64
         break;
@@ -2636,9 +2718,9 @@ size_t X86Assembler::relocCode(void* _dst, sysuint_t addressBase) const ASMJIT_N
 #if defined(ASMJIT_X64)
     if (useTrampoline)
     {
-      if (getLogger())
+      if (logger)
       {
-        getLogger()->logFormat("; Trampoline from %p -> %p\n", (int8_t*)addressBase + r.offset, r.address);
+        logger->logFormat("; Trampoline from %p -> %p\n", (int8_t*)addressBase + r.offset, r.address);
       }
 
       X64TrampolineWriter::writeTrampoline(tramp, (uint64_t)r.address);
@@ -2843,6 +2925,12 @@ void X86Assembler::registerLabels(size_t count) ASMJIT_NOTHROW
   l_data.offset = -1;
   l_data.links = NULL;
 
+  if (!_labels.reserve(_labels.getLength() + count))
+  {
+    setError(kErrorNoHeapMemory);
+    return;
+  }
+
   for (size_t i = 0; i < count; i++)
     _labels.append(l_data);
 }
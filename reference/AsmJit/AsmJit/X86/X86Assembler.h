@@ -565,6 +565,20 @@ struct X86Assembler : public Assembler
   // --------------------------------------------------------------------------
 
   ASMJIT_API virtual size_t relocCode(void* dst, sysuint_t addressBase) const ASMJIT_NOTHROW;
+  ASMJIT_API virtual size_t relocCode(void* dst, sysuint_t addressBase, MemoryManager* memmgr) const ASMJIT_NOTHROW;
+  ASMJIT_API virtual RelocFunc getRelocFunc() const ASMJIT_NOTHROW;
+
+  //! @brief Relocate @a codeSize bytes of @a code using @a relocData to
+  //! @a dst, returns the bytes used.
+  //!
+  //! This is how @c relocCode() relocates the code of the assembler, it can
+  //! be used to relocate the code and relocation data copied from an
+  //! assembler which doesn't exist anymore. The @a dst must have space also
+  //! for trampolines (see @c getTrampolineSize()). Trampolines written after
+  //! the code are logged to @a logger (can be @c NULL).
+  ASMJIT_API static size_t relocRaw(void* dst, sysuint_t addressBase, MemoryManager* memmgr,
+    const uint8_t* code, size_t codeSize, const RelocData* relocData, size_t relocCount,
+    Logger* logger) ASMJIT_NOTHROW;
 
   // --------------------------------------------------------------------------
   // [Make]
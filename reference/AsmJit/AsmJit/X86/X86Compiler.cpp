@@ -662,6 +662,7 @@ void* X86Compiler::make() ASMJIT_NOTHROW
   X86Assembler x86Asm(_context);
 
   x86Asm._properties = _properties;
+  x86Asm._codeAlignment = _codeAlignment;
   x86Asm.setLogger(_logger);
 
   serialize(x86Asm);
@@ -788,10 +789,15 @@ void X86Compiler::serialize(Assembler& a) ASMJIT_NOTHROW
 
       x86Context._isUnreachable = true;
 
-      size_t len = x86Context._backCode.getLength();
-      while (x86Context._backPos < len)
+      for (;;)
       {
-        cur = x86Context._backCode[x86Context._backPos++]->getNext();
+        ZoneList<X86CompilerJmpInst*>::Link* link = (x86Context._backPos != NULL)
+          ? x86Context._backPos->getNext()
+          : x86Context._backCode.getFirst();
+        if (link == NULL) break;
+
+        x86Context._backPos = link;
+        cur = link->getItem()->getNext();
         if (!cur->isTranslated()) break;
 
         cur = NULL;
@@ -844,6 +850,21 @@ void X86Compiler::serialize(Assembler& a) ASMJIT_NOTHROW
     // - Emit instructions to Assembler stream.
     // ------------------------------------------------------------------------
 
+    // Reserve the code buffer so it's not reallocated while emitting (items
+    // with unknown size are not counted, the buffer still grows if needed).
+    {
+      size_t maxSize = x86Asm.getOffset();
+
+      for (cur = start; ; cur = cur->getNext())
+      {
+        int s = cur->getMaxSize();
+        if (s > 0) maxSize += (size_t)s;
+        if (cur == extraBlock) break;
+      }
+
+      x86Asm.reserve(maxSize);
+    }
+
     for (cur = start; ; cur = cur->getNext())
     {
       cur->emit(x86Asm);
@@ -27,7 +27,8 @@ namespace AsmJit {
 // ============================================================================
 
 X86CompilerContext::X86CompilerContext(X86Compiler* x86Compiler) ASMJIT_NOTHROW :
-  CompilerContext(x86Compiler)
+  CompilerContext(x86Compiler),
+  _backCode(&_zoneMemory)
 {
   _state = &_x86State;
 
@@ -84,8 +85,8 @@ void X86CompilerContext::_clear() ASMJIT_NOTHROW
 
   _memBytesTotal = 0;
 
-  _backCode.clear();
-  _backPos = 0;
+  _backCode.reset();
+  _backPos = NULL;
 }
 
 // ============================================================================
@@ -1408,7 +1409,8 @@ void X86CompilerContext::translateOperands(Operand* operands, uint32_t count) AS
 
 void X86CompilerContext::addBackwardCode(X86CompilerJmpInst* from) ASMJIT_NOTHROW
 {
-  _backCode.append(from);
+  if (!_backCode.append(from))
+    _compiler->setError(kErrorNoHeapMemory);
 }
 
 void X86CompilerContext::addForwardJump(X86CompilerJmpInst* inst) ASMJIT_NOTHROW
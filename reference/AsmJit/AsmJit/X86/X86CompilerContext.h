@@ -10,7 +10,7 @@
 
 // [Dependencies - AsmJit]
 #include "../Core/IntUtil.h"
-#include "../Core/PodVector.h"
+#include "../Core/ZoneVector.h"
 
 #include "../X86/X86Assembler.h"
 #include "../X86/X86Compiler.h"
@@ -302,10 +302,10 @@ struct X86CompilerContext : public CompilerContext
 
   //! @brief List of items which need to be translated. These items are filled
   //! by @c addBackwardCode().
-  PodVector<X86CompilerJmpInst*> _backCode;
+  ZoneList<X86CompilerJmpInst*> _backCode;
 
-  //! @brief Backward code position (starts at 0).
-  sysuint_t _backPos;
+  //! @brief Last link of @c _backCode processed (starts at NULL).
+  ZoneList<X86CompilerJmpInst*>::Link* _backPos;
   //! @brief Whether to emit comments.
   bool _emitComments;
 };
@@ -0,0 +1,142 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to benchmark calls of many small generated functions in
+// random order (it's mostly sensitive to TLB misses).
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ASMJIT_WINDOWS)
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif // ASMJIT_WINDOWS
+
+using namespace AsmJit;
+
+// This is type of function we will generate.
+typedef int (*MyFn)(void);
+
+static double now()
+{
+#if defined(ASMJIT_WINDOWS)
+  return (double)GetTickCount() / 1000.0;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif // ASMJIT_WINDOWS
+}
+
+static int problems = 0;
+
+static void bench(const char* name, VirtualMemoryManager* memmgr, const size_t* order, size_t count, size_t rounds)
+{
+  JitContext context;
+  context.setMemoryManager(memmgr);
+
+  MyFn* fn = (MyFn*)malloc(sizeof(MyFn) * count);
+  size_t i, j;
+
+  if (fn == NULL)
+  {
+    printf("Out of memory.\n");
+    exit(1);
+  }
+
+  // Generate functions, each returns its index.
+  for (i = 0; i < count; i++)
+  {
+    X86Assembler a(&context);
+
+    a.mov(eax, imm((sysint_t)i));
+    a.ret();
+
+    fn[i] = asmjit_cast<MyFn>(a.make());
+    if (fn[i] == NULL)
+    {
+      printf("Couldn't generate function %d.\n", (int)i);
+      exit(1);
+    }
+  }
+
+  // Call them in random order.
+  double t = now();
+  size_t sum = 0;
+
+  for (j = 0; j < rounds; j++)
+  {
+    for (i = 0; i < count; i++)
+      sum += (size_t)fn[order[i]]();
+  }
+
+  t = now() - t;
+
+  if (sum != rounds * (count * (count - 1) / 2))
+  {
+    printf("%s: Invalid result.\n", name);
+    problems++;
+  }
+
+  printf("%-14s: %.0f calls/sec (%.3f sec)\n", name,
+    t > 0.0 ? (double)(count * rounds) / t : 0.0, t);
+
+  for (i = 0; i < count; i++)
+    memmgr->free((void*)fn[i]);
+  free(fn);
+}
+
+int main(int argc, char* argv[])
+{
+  size_t count = 100000;
+  size_t rounds = 20;
+  size_t i;
+
+  printf("Calling %d functions in random order, %d rounds\n\n", (int)count, (int)rounds);
+
+  size_t* order = (size_t*)malloc(sizeof(size_t) * count);
+  if (order == NULL) return 1;
+
+  for (i = 0; i < count; i++)
+    order[i] = i;
+
+  srand(100);
+  for (i = 0; i < count; i++)
+  {
+    size_t si = (size_t)rand() % count;
+    size_t t = order[i];
+
+    order[i] = order[si];
+    order[si] = t;
+  }
+
+  {
+    VirtualMemoryManager memmgr;
+    bench("Normal pages", &memmgr, order, count, rounds);
+  }
+
+  {
+    VirtualMemoryManager memmgr;
+    memmgr.setUseLargePages(true);
+    bench("Large pages", &memmgr, order, count, rounds);
+  }
+
+  free(order);
+
+  printf("\n");
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return problems != 0;
+}
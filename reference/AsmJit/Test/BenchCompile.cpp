@@ -0,0 +1,169 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to benchmark heap allocations and time spent by compiling
+// a function with many labels and variables (heap allocations are counted by
+// malloc hook, it's available only with glibc).
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ASMJIT_WINDOWS)
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif // ASMJIT_WINDOWS
+
+using namespace AsmJit;
+
+// ============================================================================
+// [Malloc Hook]
+// ============================================================================
+
+static size_t mallocCount = 0;
+
+#if defined(__GLIBC__)
+# define BENCH_MALLOC_HOOK
+
+extern "C" void* __libc_malloc(size_t size);
+
+// Replaces malloc() of the C library, also for calls done by AsmJit.
+extern "C" void* malloc(size_t size)
+{
+  mallocCount++;
+  return __libc_malloc(size);
+}
+#endif // __GLIBC__
+
+// ============================================================================
+// [Benchmark]
+// ============================================================================
+
+// This is type of function we will generate.
+typedef int (*MyFn)(int, int);
+
+enum { kBlocks = 64 };
+
+static double now()
+{
+#if defined(ASMJIT_WINDOWS)
+  return (double)GetTickCount() / 1000.0;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif // ASMJIT_WINDOWS
+}
+
+static int problems = 0;
+
+// Each block creates a label and adds y to x using a new variable. There is
+// only one jump and only each 16th label is bound (register state is saved
+// for each jump and bound label and it would dominate the compile time). The
+// function returns x + y * kBlocks.
+static void compile(ZonePool* pool, X86Assembler& a)
+{
+  X86Compiler c;
+  c.setZonePool(pool);
+
+  c.newFunc(kX86FuncConvDefault, FuncBuilder2<int, int, int>());
+
+  GpVar x(c.getGpArg(0));
+  GpVar y(c.getGpArg(1));
+  GpVar t(c.newGpVar());
+
+  Label L_Exit = c.newLabel();
+
+  c.mov(t, x);
+  c.cmp(y, imm(0));
+  c.je(L_Exit);
+
+  for (int k = 0; k < kBlocks; k++)
+  {
+    GpVar v(c.newGpVar());
+    Label L = c.newLabel();
+
+    if ((k & 15) == 0) c.bind(L);
+    c.mov(v, y);
+    c.add(t, v);
+  }
+
+  c.bind(L_Exit);
+  c.ret(t);
+  c.endFunc();
+
+  a.clear();
+  c.serialize(a);
+}
+
+static void bench(const char* name, ZonePool* pool, bool reuseAssembler, size_t count)
+{
+  X86Assembler reused;
+  size_t i;
+
+  // Warm-up.
+  compile(pool, reused);
+
+  size_t allocs = mallocCount;
+  double t = now();
+
+  for (i = 0; i < count; i++)
+  {
+    if (reuseAssembler)
+    {
+      compile(pool, reused);
+    }
+    else
+    {
+      X86Assembler a;
+      compile(pool, a);
+    }
+  }
+
+  t = now() - t;
+  allocs = mallocCount - allocs;
+
+  MyFn fn = asmjit_cast<MyFn>(reused.make());
+  if (fn == NULL || fn(1, 2) != 1 + 2 * kBlocks)
+  {
+    printf("%s: Invalid result.\n", name);
+    problems++;
+  }
+
+  if (fn != NULL)
+    MemoryManager::getGlobal()->free((void*)fn);
+
+  printf("%-20s: %.0f compiles/sec (%.3f sec), %.1f heap allocations/compile\n", name,
+    t > 0.0 ? (double)count / t : 0.0, t, (double)allocs / (double)count);
+}
+
+int main(int argc, char* argv[])
+{
+  size_t count = 50000;
+
+  printf("Compiling function with %d blocks, %d times\n\n", (int)kBlocks, (int)count);
+
+  bench("Default", NULL, false, count);
+  bench("Reused assembler", NULL, true, count);
+  bench("Pooled", ZonePool::getThreadPool(), true, count);
+
+#if !defined(BENCH_MALLOC_HOOK)
+  printf("\nHeap allocations are not counted on this platform.\n");
+#endif // BENCH_MALLOC_HOOK
+
+  printf("\n");
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return problems != 0;
+}
@@ -0,0 +1,362 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to benchmark time spent by compiling a function when the
+// output is logged by FileLogger and AsyncLogger (both log to temporary file,
+// FileLogger also to unbuffered one, like stderr is). It also tests that the
+// output of both loggers is the same and that AsyncLogger frees buffers of
+// exited threads.
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ASMJIT_WINDOWS)
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <sys/time.h>
+#endif // ASMJIT_WINDOWS
+
+using namespace AsmJit;
+
+// ============================================================================
+// [Benchmark]
+// ============================================================================
+
+// This is type of function we will generate.
+typedef int (*MyFn)(int, int);
+
+enum { kBlocks = 64 };
+
+static double now()
+{
+#if defined(ASMJIT_WINDOWS)
+  return (double)GetTickCount() / 1000.0;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif // ASMJIT_WINDOWS
+}
+
+static int problems = 0;
+
+// Logger which only measures time spent by formatting the output.
+struct NullLogger : public Logger
+{
+  virtual void logString(const char*, size_t) ASMJIT_NOTHROW {}
+};
+
+// Function returns x + y * kBlocks, see BenchCompile.cpp.
+static void compile(Logger* logger, X86Assembler& a)
+{
+  X86Compiler c;
+  c.setZonePool(ZonePool::getThreadPool());
+  c.setLogger(logger);
+
+  c.newFunc(kX86FuncConvDefault, FuncBuilder2<int, int, int>());
+
+  GpVar x(c.getGpArg(0));
+  GpVar y(c.getGpArg(1));
+  GpVar t(c.newGpVar());
+
+  Label L_Exit = c.newLabel();
+
+  c.mov(t, x);
+  c.cmp(y, imm(0));
+  c.je(L_Exit);
+
+  for (int k = 0; k < kBlocks; k++)
+  {
+    GpVar v(c.newGpVar());
+    Label L = c.newLabel();
+
+    if ((k & 15) == 0) c.bind(L);
+    c.mov(v, y);
+    c.add(t, v);
+  }
+
+  c.bind(L_Exit);
+  c.ret(t);
+  c.endFunc();
+
+  a.clear();
+  c.serialize(a);
+}
+
+// Returns time of one compile in microseconds.
+static double bench(const char* name, Logger* logger, size_t count)
+{
+  X86Assembler a;
+  size_t i;
+
+  // Warm-up.
+  compile(logger, a);
+
+  double t = now();
+  for (i = 0; i < count; i++)
+    compile(logger, a);
+  t = now() - t;
+
+  MyFn fn = asmjit_cast<MyFn>(a.make());
+  if (fn == NULL || fn(1, 2) != 1 + 2 * kBlocks)
+  {
+    printf("%s: Invalid result.\n", name);
+    problems++;
+  }
+
+  if (fn != NULL)
+    MemoryManager::getGlobal()->free((void*)fn);
+
+  t = t * 1000000.0 / (double)count;
+  printf("%-22s: %.2f us/compile\n", name, t);
+  return t;
+}
+
+static long getFileSize(FILE* file)
+{
+  fseek(file, 0, SEEK_END);
+  return ftell(file);
+}
+
+// Returns offset of the first different byte of files @a a and @a b, or -1
+// if they are the same.
+static long compareFiles(FILE* a, FILE* b)
+{
+  char bufA[4096];
+  char bufB[4096];
+  long offset = 0;
+
+  rewind(a);
+  rewind(b);
+
+  for (;;)
+  {
+    size_t lenA = fread(bufA, 1, sizeof(bufA), a);
+    size_t lenB = fread(bufB, 1, sizeof(bufB), b);
+    size_t len = lenA < lenB ? lenA : lenB;
+
+    for (size_t i = 0; i < len; i++)
+    {
+      if (bufA[i] != bufB[i])
+        return offset + (long)i;
+    }
+
+    if (lenA != lenB)
+      return offset + (long)len;
+    if (lenA == 0)
+      return -1;
+
+    offset += (long)len;
+  }
+}
+
+// ============================================================================
+// [Threads]
+// ============================================================================
+
+enum { kThreads = 16, kThreadLines = 100 };
+
+static AsyncLogger* threadLogger;
+
+// Each thread logs kThreadLines lines of 100 bytes and exits.
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI logThread(LPVOID)
+#else
+static void* logThread(void*)
+#endif // ASMJIT_WINDOWS
+{
+  char line[100];
+  memset(line, 'x', 99);
+  line[99] = '\n';
+
+  for (int i = 0; i < kThreadLines; i++)
+    threadLogger->logString(line, 100);
+
+  return 0;
+}
+
+static void runThreads()
+{
+#if defined(ASMJIT_WINDOWS)
+  HANDLE threads[kThreads];
+
+  for (int i = 0; i < kThreads; i++)
+    threads[i] = CreateThread(NULL, 0, logThread, NULL, 0, NULL);
+
+  for (int i = 0; i < kThreads; i++)
+  {
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+  }
+#else
+  pthread_t threads[kThreads];
+
+  for (int i = 0; i < kThreads; i++)
+    pthread_create(&threads[i], NULL, logThread, NULL);
+
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], NULL);
+#endif // ASMJIT_WINDOWS
+}
+
+int main(int argc, char* argv[])
+{
+  size_t count = 20000;
+
+  printf("Compiling function with %d blocks, %d times\n\n", (int)kBlocks, (int)count);
+
+  FILE* fileOut = tmpfile();
+  FILE* unbufferedOut = tmpfile();
+  FILE* asyncOut = tmpfile();
+
+  if (fileOut == NULL || unbufferedOut == NULL || asyncOut == NULL)
+  {
+    printf("Can't create temporary file.\n");
+    return 1;
+  }
+
+  setvbuf(unbufferedOut, NULL, _IONBF, 0);
+
+  double tNone = bench("No logger", NULL, count);
+
+  NullLogger nullLogger;
+  double tNull = bench("Formatting only", &nullLogger, count);
+
+  FileLogger fileLogger(fileOut);
+  double tFile = bench("FileLogger", &fileLogger, count);
+
+  FileLogger unbufferedLogger(unbufferedOut);
+  double tUnbuffered = bench("FileLogger unbuffered", &unbufferedLogger, count);
+
+  // The buffer fits several compiles, so messages are not dropped if the
+  // logger thread keeps up with the compiler.
+  AsyncLogger asyncLogger(asyncOut, 1024 * 1024);
+  double tAsync = bench("AsyncLogger", &asyncLogger, count);
+
+  asyncLogger.flush();
+  fflush(fileOut);
+
+  size_t dropped = asyncLogger.getDroppedCount();
+  long fileSize = getFileSize(fileOut);
+  long asyncSize = getFileSize(asyncOut);
+
+  printf("\n");
+  printf("Formatting          : %.2f us\n", tNull - tNone);
+  printf("Writing             : FileLogger %.2f us, unbuffered %.2f us, AsyncLogger %.2f us\n",
+    tFile - tNull, tUnbuffered - tNull, tAsync - tNull);
+  printf("Logged              : FileLogger %ld bytes, AsyncLogger %ld bytes, %d dropped\n",
+    fileSize, asyncSize, (int)dropped);
+
+  // Both loggers logged the same compiles, the output can only differ if
+  // AsyncLogger dropped messages.
+  if (dropped == 0)
+  {
+    long offset = compareFiles(fileOut, asyncOut);
+    if (offset != -1)
+    {
+      printf("Failed, AsyncLogger output differs at offset %ld\n", offset);
+      problems++;
+    }
+  }
+  else
+  {
+    printf("Output not compared, AsyncLogger dropped messages\n");
+  }
+
+  // Messages that don't fit to small buffer are dropped, but never split.
+  {
+    AsyncLogger smallLogger(NULL, 256);
+    FILE* smallOut = tmpfile();
+    if (smallOut == NULL)
+    {
+      printf("Can't create temporary file.\n");
+      return 1;
+    }
+    smallLogger.setStream(smallOut);
+
+    char line[100];
+    memset(line, 'x', 99);
+    line[99] = '\n';
+
+    size_t lines = 10000;
+    for (size_t i = 0; i < lines; i++)
+      smallLogger.logString(line, 100);
+
+    smallLogger.flush();
+    dropped = smallLogger.getDroppedCount();
+    long size = getFileSize(smallOut);
+
+    printf("Small buffer        : %d lines logged, %d dropped\n",
+      (int)(size / 100), (int)dropped);
+
+    if (size % 100 != 0 || (size_t)(size / 100) + dropped != lines)
+    {
+      printf("Failed, messages split or not counted\n");
+      problems++;
+    }
+
+    smallLogger.setStream(NULL);
+    fclose(smallOut);
+  }
+
+  // Buffers of exited threads are freed once their messages are written.
+  {
+    FILE* threadOut = tmpfile();
+    if (threadOut == NULL)
+    {
+      printf("Can't create temporary file.\n");
+      return 1;
+    }
+
+    AsyncLogger logger(threadOut);
+    threadLogger = &logger;
+
+    runThreads();
+    logger.flush();
+
+    size_t buffers = logger.getBufferCount();
+    long size = getFileSize(threadOut);
+
+    printf("Threads             : %d lines logged, %d buffers remain\n",
+      (int)(size / 100), (int)buffers);
+
+    if (size != (long)kThreads * kThreadLines * 100 || logger.getDroppedCount() != 0)
+    {
+      printf("Failed, messages of threads lost\n");
+      problems++;
+    }
+
+    // Windows older than Vista doesn't destroy thread local values.
+#if !defined(ASMJIT_WINDOWS) || (defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600)
+    if (buffers != 0)
+    {
+      printf("Failed, buffers of exited threads not freed\n");
+      problems++;
+    }
+#endif // ASMJIT_WINDOWS
+
+    logger.setStream(NULL);
+    fclose(threadOut);
+  }
+
+  fclose(fileOut);
+  fclose(unbufferedOut);
+  fclose(asyncOut);
+
+  printf("\n");
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return problems != 0;
+}
@@ -0,0 +1,367 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to benchmark memory managers used by many threads at the
+// same time (throughput, latency of single operation and fragmentation).
+//
+// Usage: BenchMem [max threads] [operations per thread]
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ASMJIT_WINDOWS)
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <time.h>
+# include <sys/resource.h>
+#endif // ASMJIT_WINDOWS
+
+using namespace AsmJit;
+
+// ============================================================================
+// [Helpers]
+// ============================================================================
+
+// Get time in nanoseconds.
+static double now()
+{
+#if defined(ASMJIT_WINDOWS)
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)counter.QuadPart * 1000000000.0 / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000000000.0 + (double)ts.tv_nsec;
+#endif // ASMJIT_WINDOWS
+}
+
+// Get peak resident set size of the process in kB (0 if not known).
+static size_t getPeakRss()
+{
+#if defined(ASMJIT_WINDOWS)
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+# if defined(__APPLE__)
+  return (size_t)usage.ru_maxrss / 1024;
+# else
+  return (size_t)usage.ru_maxrss;
+# endif // __APPLE__
+#endif // ASMJIT_WINDOWS
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// ============================================================================
+// [Configuration]
+// ============================================================================
+
+//! @brief Distribution of allocated sizes.
+struct SizeDistribution
+{
+  const char* name;
+  size_t minSize;
+  size_t maxSize;
+};
+
+static const SizeDistribution sizeDistributions[] =
+{
+  { "small" , 16  , 256   },
+  { "mixed" , 16  , 4096  },
+  { "large" , 4096, 65536 }
+};
+
+//! @brief Mix of operations, percentage of allocations (the rest are frees).
+//!
+//! Zero means teardown, each thread frees blocks allocated before the
+//! measurement.
+struct OperationMix
+{
+  const char* name;
+  uint32_t allocPercent;
+};
+
+static const OperationMix operationMixes[] =
+{
+  { "steady"  , 50 },
+  { "grow"    , 70 },
+  { "teardown", 0  }
+};
+
+enum
+{
+  //! @brief Maximum count of blocks kept by one thread.
+  kMaxLive = 4096,
+  //! @brief Latency is measured for each n-th operation.
+  kSampleRate = 8
+};
+
+// ============================================================================
+// [Worker]
+// ============================================================================
+
+//! @brief Data of one benchmark thread.
+struct Worker
+{
+  MemoryManager* memmgr;
+  const SizeDistribution* sizes;
+  const OperationMix* mix;
+
+  size_t operations;
+  uint32_t seed;
+
+  // Blocks allocated and not freed.
+  void* live[kMaxLive];
+  size_t liveCount;
+
+  // Sampled latencies in nanoseconds.
+  double* samples;
+  size_t sampleCount;
+
+  bool failed;
+};
+
+// Simple xorshift generator, rand() is not thread-safe.
+static inline uint32_t nextRandom(uint32_t& seed)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void runWorker(Worker* w)
+{
+  MemoryManager* memmgr = w->memmgr;
+  size_t range = w->sizes->maxSize - w->sizes->minSize + 1;
+  size_t i;
+
+  for (i = 0; i < w->operations; i++)
+  {
+    uint32_t r = nextRandom(w->seed);
+    bool doAlloc = w->liveCount == 0 ||
+      (w->liveCount < kMaxLive && (r % 100) < w->mix->allocPercent);
+
+    double t = (i % kSampleRate == 0) ? now() : 0.0;
+
+    if (doAlloc)
+    {
+      size_t size = w->sizes->minSize + (size_t)(nextRandom(w->seed) % range);
+      void* p = memmgr->alloc(size);
+
+      if (p == NULL)
+      {
+        w->failed = true;
+        return;
+      }
+
+      // Touch the memory, so it's counted by RSS.
+      memset(p, 0xCC, 16);
+      w->live[w->liveCount++] = p;
+    }
+    else
+    {
+      size_t index = (size_t)(r >> 8) % w->liveCount;
+      memmgr->free(w->live[index]);
+      w->live[index] = w->live[--w->liveCount];
+    }
+
+    if (t != 0.0)
+      w->samples[w->sampleCount++] = now() - t;
+  }
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI workerEntry(LPVOID arg)
+{
+  runWorker(reinterpret_cast<Worker*>(arg));
+  return 0;
+}
+#else
+static void* workerEntry(void* arg)
+{
+  runWorker(reinterpret_cast<Worker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+// ============================================================================
+// [Bench]
+// ============================================================================
+
+static int problems = 0;
+
+static void bench(const char* name, MemoryManager* memmgr,
+  const SizeDistribution* sizes, const OperationMix* mix,
+  size_t threads, size_t operations)
+{
+  Worker* workers = (Worker*)malloc(sizeof(Worker) * threads);
+  size_t samplesPerThread = operations / kSampleRate + 1;
+  double* samples = (double*)malloc(sizeof(double) * samplesPerThread * threads);
+  size_t i, j;
+
+  if (workers == NULL || samples == NULL)
+  {
+    printf("Out of memory.\n");
+    exit(1);
+  }
+
+  for (i = 0; i < threads; i++)
+  {
+    Worker* w = &workers[i];
+
+    w->memmgr = memmgr;
+    w->sizes = sizes;
+    w->mix = mix;
+    w->operations = operations;
+    w->seed = (uint32_t)(i * 7919 + 1);
+    w->liveCount = 0;
+    w->samples = samples + i * samplesPerThread;
+    w->sampleCount = 0;
+    w->failed = false;
+
+    if (mix->allocPercent == 0)
+    {
+      while (w->liveCount < kMaxLive && w->liveCount < operations)
+      {
+        size_t size = sizes->minSize + (size_t)(nextRandom(w->seed) % (sizes->maxSize - sizes->minSize + 1));
+        void* p = memmgr->alloc(size);
+        if (p == NULL) break;
+
+        w->live[w->liveCount++] = p;
+      }
+      w->operations = w->liveCount;
+    }
+  }
+
+  double t = now();
+
+#if defined(ASMJIT_WINDOWS)
+  HANDLE* handles = (HANDLE*)malloc(sizeof(HANDLE) * threads);
+  for (i = 0; i < threads; i++)
+    handles[i] = CreateThread(NULL, 0, workerEntry, &workers[i], 0, NULL);
+  for (i = 0; i < threads; i++)
+  {
+    WaitForSingleObject(handles[i], INFINITE);
+    CloseHandle(handles[i]);
+  }
+  free(handles);
+#else
+  pthread_t* handles = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+  for (i = 0; i < threads; i++)
+    pthread_create(&handles[i], NULL, workerEntry, &workers[i]);
+  for (i = 0; i < threads; i++)
+    pthread_join(handles[i], NULL);
+  free(handles);
+#endif // ASMJIT_WINDOWS
+
+  t = now() - t;
+
+  // Fragmentation is measured while the blocks are still allocated.
+  size_t used = memmgr->getUsedBytes();
+  size_t allocated = memmgr->getAllocatedBytes();
+
+  // Merge samples of all threads.
+  size_t sampleCount = 0;
+  size_t total = 0;
+  for (i = 0; i < threads; i++)
+  {
+    Worker* w = &workers[i];
+    total += w->operations;
+
+    if (w->failed)
+    {
+      printf("Couldn't allocate virtual memory.\n");
+      problems++;
+    }
+
+    for (j = 0; j < w->sampleCount; j++)
+      samples[sampleCount++] = w->samples[j];
+  }
+
+  qsort(samples, sampleCount, sizeof(double), compareDouble);
+  double p50 = sampleCount ? samples[sampleCount / 2] : 0.0;
+  double p99 = sampleCount ? samples[sampleCount * 99 / 100] : 0.0;
+
+  printf("%-14s %-6s %-6s %2d threads: %10.0f ops/sec, p50 %6.0f ns, p99 %7.0f ns, used %9d / allocated %9d (%5.1f%%), peak RSS %d kB\n",
+    name, sizes->name, mix->name, (int)threads,
+    t > 0.0 ? (double)total * 1000000000.0 / t : 0.0,
+    p50, p99,
+    (int)used, (int)allocated, allocated ? (double)used * 100.0 / (double)allocated : 100.0,
+    (int)getPeakRss());
+
+  for (i = 0; i < threads; i++)
+  {
+    Worker* w = &workers[i];
+    for (j = 0; j < w->liveCount; j++)
+      memmgr->free(w->live[j]);
+  }
+
+  free(samples);
+  free(workers);
+}
+
+int main(int argc, char* argv[])
+{
+  size_t maxThreads = (argc > 1) ? (size_t)atoi(argv[1]) : 8;
+  size_t operations = (argc > 2) ? (size_t)atoi(argv[2]) : 200000;
+
+  if (maxThreads == 0) maxThreads = 1;
+
+  VirtualMemoryManager customMemmgr;
+  VirtualMemoryManager cachedMemmgr;
+  cachedMemmgr.setUseThreadCache(true);
+
+  struct { const char* name; MemoryManager* memmgr; } memmgrs[] =
+  {
+    { "global"      , MemoryManager::getGlobal() },
+    { "custom"      , &customMemmgr },
+    { "thread-cache", &cachedMemmgr }
+  };
+
+  printf("Benchmark - %d operations per thread\n\n", (int)operations);
+
+  size_t m, s, x, threads;
+  for (m = 0; m < ASMJIT_ARRAY_SIZE(memmgrs); m++)
+  {
+    for (s = 0; s < ASMJIT_ARRAY_SIZE(sizeDistributions); s++)
+    {
+      for (x = 0; x < ASMJIT_ARRAY_SIZE(operationMixes); x++)
+      {
+        for (threads = 1; threads <= maxThreads; threads *= 2)
+        {
+          bench(memmgrs[m].name, memmgrs[m].memmgr,
+            &sizeDistributions[s], &operationMixes[x], threads, operations);
+        }
+      }
+    }
+    printf("\n");
+  }
+
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return 0;
+}
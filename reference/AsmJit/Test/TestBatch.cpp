@@ -0,0 +1,111 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to test generating functions calling each other in one
+// batch.
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace AsmJit;
+
+// This is type of function we will generate.
+typedef int (*MyFn)(void);
+
+enum { kCount = 500 };
+
+int main(int argc, char* argv[])
+{
+  VirtualMemoryManager memmgr;
+  JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  X86Assembler* assemblers[kCount];
+  void* functions[kCount];
+  size_t i;
+
+  int problems = 0;
+
+  // The first function returns zero, each other function calls the previous
+  // one and adds one to its result.
+  for (i = 0; i < kCount; i++)
+  {
+    X86Assembler* a = new X86Assembler(&context);
+    assemblers[i] = a;
+
+    if (i == 0)
+    {
+      a->xor_(eax, eax);
+    }
+    else
+    {
+      a->call((void*)assemblers[i - 1]);
+      a->add(eax, imm(1));
+    }
+    a->ret();
+  }
+
+  printf("Generating %d functions...", (int)kCount);
+  uint32_t error = context.generateBatch(functions, reinterpret_cast<Assembler**>(assemblers), kCount);
+  printf("done\n");
+
+  if (error != kErrorOk)
+  {
+    printf("Failed to generate batch: %s\n", getErrorString(error));
+    problems++;
+  }
+  else
+  {
+    printf("-- Used: %d\n", (int)memmgr.getUsedBytes());
+
+    for (i = 0; i < kCount; i++)
+    {
+      MyFn fn = asmjit_cast<MyFn>(functions[i]);
+      if (fn() != (int)i)
+      {
+        printf("Function %d returned %d\n", (int)i, fn());
+        problems++;
+        break;
+      }
+
+      // Call of the previous function must be direct.
+      if (i > 0)
+      {
+        uint8_t* p = (uint8_t*)functions[i];
+        int32_t rel = *(int32_t*)(p + 1);
+
+        if (p[0] != 0xE8 || p + 5 + rel != (uint8_t*)functions[i - 1])
+        {
+          printf("Function %d doesn't call the previous function directly\n", (int)i);
+          problems++;
+          break;
+        }
+      }
+    }
+
+    // Functions are placed next to each other in one block.
+    if (!memmgr.free(functions[0]) || memmgr.getUsedBytes() != 0)
+    {
+      printf("Batch is not one block of memory\n");
+      problems++;
+    }
+  }
+
+  for (i = 0; i < kCount; i++)
+    delete assemblers[i];
+
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return 0;
+}
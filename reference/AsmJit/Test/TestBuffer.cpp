@@ -0,0 +1,212 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to test that the code buffer grows geometrically, also
+// when it's reserved repeatedly (once per function by Compiler), and that
+// the code reserved by reserve() is emitted without growing the buffer.
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace AsmJit;
+
+// ============================================================================
+// [CountingMemoryManager]
+// ============================================================================
+
+// Memory manager which counts how many times the buffer allocated by it was
+// grown or moved.
+struct CountingMemoryManager : public VirtualMemoryManager
+{
+  CountingMemoryManager() : allocCount(0), growCount(0) {}
+
+  using VirtualMemoryManager::alloc;
+
+  virtual void* alloc(size_t size, uint32_t type) ASMJIT_NOTHROW
+  {
+    allocCount++;
+    return VirtualMemoryManager::alloc(size, type);
+  }
+
+  virtual bool grow(void* address, size_t size) ASMJIT_NOTHROW
+  {
+    growCount++;
+    return VirtualMemoryManager::grow(address, size);
+  }
+
+  size_t allocCount;
+  size_t growCount;
+};
+
+// ============================================================================
+// [Tests]
+// ============================================================================
+
+enum
+{
+  kBlobSize = 4 * 1024 * 1024,
+  kBlobChunk = 4096,
+  kFunctions = 256,
+
+  // Geometric growth needs a few tens of reallocs for all sizes above, the
+  // count would be proportional to the number of chunks or functions if the
+  // buffer grew linearly.
+  kMaxReallocs = 32
+};
+
+static int problems = 0;
+
+// Emit a large blob in chunks, each chunk is reserved first (as Compiler
+// does for each function).
+static void testBlob()
+{
+  Buffer buf;
+  uint8_t chunk[kBlobChunk];
+  size_t reallocs = 0;
+
+  memset(chunk, 0xCC, kBlobChunk);
+
+  for (size_t i = 0; i < kBlobSize / kBlobChunk; i++)
+  {
+    size_t capacity = buf.getCapacity();
+
+    if (!buf.reserve(buf.getOffset() + kBlobChunk))
+    {
+      printf("Out of memory.\n");
+      exit(1);
+    }
+
+    if (buf.getCapacity() != capacity)
+      reallocs++;
+
+    buf.emitData(chunk, kBlobChunk);
+  }
+
+  printf("Blob of %u bytes reserved by %u bytes: %u reallocs\n",
+    (unsigned int)kBlobSize, (unsigned int)kBlobChunk, (unsigned int)reallocs);
+
+  if (buf.getOffset() != kBlobSize)
+  {
+    printf("Failed, blob is %u bytes\n", (unsigned int)buf.getOffset());
+    problems++;
+  }
+
+  if (reallocs > kMaxReallocs)
+  {
+    printf("Failed, buffer grows linearly\n");
+    problems++;
+  }
+}
+
+// Emit reserved bytes one by one as Assembler does.
+static void testReserve(MemoryManager* memmgr)
+{
+  Buffer buf;
+  buf.setMemoryManager(memmgr);
+
+  // Some code already emitted.
+  buf.emitData("\xCC\xCC\xCC\xCC", 4);
+
+  size_t size = 100000;
+  if (!buf.reserve(size))
+  {
+    printf("Out of memory.\n");
+    exit(1);
+  }
+
+  uint8_t* data = buf.getData();
+  size_t capacity = buf.getCapacity();
+
+  while (buf.getOffset() < size)
+  {
+    if (!buf.ensureSpace())
+    {
+      printf("Out of memory.\n");
+      exit(1);
+    }
+
+    buf.emitByte(0xCC);
+  }
+
+  if (buf.getData() != data || buf.getCapacity() != capacity)
+  {
+    printf("Failed, reserved buffer grown (%s)\n", memmgr ? "direct" : "heap");
+    problems++;
+  }
+}
+
+// Serialize many functions to the buffer allocated by the memory manager.
+static void testSerialize()
+{
+  CountingMemoryManager memmgr;
+  X86Compiler c;
+
+  for (int i = 0; i < kFunctions; i++)
+  {
+    c.newFunc(kX86FuncConvDefault, FuncBuilder2<int, int, int>());
+
+    GpVar x(c.getGpArg(0));
+    GpVar y(c.getGpArg(1));
+
+    for (int k = 0; k < 8; k++)
+    {
+      c.add(x, y);
+      c.xor_(y, imm(k));
+    }
+
+    c.ret(x);
+    c.endFunc();
+  }
+
+  X86Assembler a;
+  a.setDirectMemoryManager(&memmgr);
+  c.serialize(a);
+
+  // Each realloc calls grow() and, if it fails, alloc() (the first one only
+  // calls alloc()).
+  size_t reallocs = memmgr.allocCount + memmgr.growCount;
+
+  printf("%u functions serialized (%u bytes): %u allocs, %u grows\n",
+    (unsigned int)kFunctions, (unsigned int)a.getCodeSize(),
+    (unsigned int)memmgr.allocCount, (unsigned int)memmgr.growCount);
+
+  if (a.getError() != kErrorOk)
+  {
+    printf("Failed, error %u\n", (unsigned int)a.getError());
+    problems++;
+  }
+
+  if (reallocs > kMaxReallocs)
+  {
+    printf("Failed, buffer reallocated for each function\n");
+    problems++;
+  }
+
+  a.setDirectMemoryManager(NULL);
+}
+
+int main(int argc, char* argv[])
+{
+  VirtualMemoryManager memmgr;
+
+  testBlob();
+  testReserve(NULL);
+  testReserve(&memmgr);
+  testSerialize();
+
+  printf("\n");
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return problems != 0;
+}
@@ -0,0 +1,156 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to test the code cache with limited size.
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace AsmJit;
+
+// This is type of function we will generate.
+typedef int (*MyFn)(void);
+
+static int problems = 0;
+
+// Listener which counts evicted functions.
+struct MyListener : public CodeCacheListener
+{
+  MyListener() ASMJIT_NOTHROW : evicted(0), lastKey(0) {}
+
+  virtual void onEvict(uint64_t key, void* func) ASMJIT_NOTHROW
+  {
+    ASMJIT_UNUSED(func);
+
+    evicted++;
+    lastKey = key;
+  }
+
+  size_t evicted;
+  uint64_t lastKey;
+};
+
+// Get function returning @a key from the cache, generate it if not stored.
+static MyFn getFunction(CodeCache* cache, uint64_t key)
+{
+  MyFn fn = (MyFn)cache->get(key);
+  if (fn != NULL) return fn;
+
+  CodeCacheContext context(cache, key);
+  X86Assembler a(&context);
+
+  a.mov(eax, imm((sysint_t)key));
+  a.ret();
+
+  // Make functions larger, so the memory manager needs more chunks.
+  uint8_t padding[500];
+  memset(padding, 0xCC, sizeof(padding));
+  a.embed(padding, sizeof(padding));
+
+  return asmjit_cast<MyFn>(a.make());
+}
+
+static void check(bool condition, const char* message)
+{
+  if (!condition)
+  {
+    printf("Failed: %s\n", message);
+    problems++;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  const size_t limit = 256 * 1024;
+  const size_t count = 4096;
+
+  CodeCache cache(limit);
+  MyListener listener;
+  cache.setListener(&listener);
+
+  size_t i;
+
+  printf("Generating %d functions, limit %d bytes...", (int)count, (int)limit);
+  for (i = 0; i < count; i++)
+  {
+    MyFn fn = getFunction(&cache, (uint64_t)i);
+    if (fn == NULL || fn() != (int)i)
+    {
+      printf("Failed to generate function %d\n", (int)i);
+      problems++;
+      break;
+    }
+
+    // Keep the first function used.
+    getFunction(&cache, 0);
+  }
+  printf("done\n");
+
+  printf("-- Functions: %d\n", (int)cache.getCount());
+  printf("-- Used: %d\n", (int)cache.getUsedBytes());
+  printf("-- Allocated: %d\n", (int)cache.getAllocatedBytes());
+  printf("-- Hits: %d\n", (int)cache.getHits());
+  printf("-- Misses: %d\n", (int)cache.getMisses());
+  printf("-- Evictions: %d\n", (int)cache.getEvictions());
+
+  check(cache.getAllocatedBytes() <= limit, "allocated memory exceeds limit");
+  check(cache.getEvictions() == listener.evicted, "listener not called for all evictions");
+  check(cache.getCount() + cache.getEvictions() == count, "functions lost");
+  check(cache.get(0) != NULL, "recently used function evicted");
+  check(cache.get(1) == NULL, "least recently used function not evicted");
+  check(cache.get(count - 1) != NULL, "last function evicted");
+
+  // Remove doesn't call the listener.
+  size_t evicted = listener.evicted;
+  check(cache.remove(count - 1), "failed to remove function");
+  check(cache.get(count - 1) == NULL, "removed function still stored");
+  check(listener.evicted == evicted, "listener called by remove");
+
+  cache.clear();
+  check(cache.getCount() == 0 && cache.getAllocatedBytes() == 0, "memory not freed by clear");
+
+  // Evicted functions are retired while this thread is registered, they are
+  // not freed before it calls quiescent(), so the cache can't evict them all
+  // to get under the limit.
+  printf("\nGenerating %d functions without quiescent()...", (int)count);
+  {
+    CodeCache retiring(limit);
+    VirtualMemoryManager* memmgr = retiring.getMemoryManager();
+    memmgr->registerThread();
+
+    for (i = 0; i < count; i++)
+      getFunction(&retiring, (uint64_t)i);
+    printf("done\n");
+
+    printf("-- Functions: %d\n", (int)retiring.getCount());
+    printf("-- Retired: %d\n", (int)memmgr->getRetiredBytes());
+    check(retiring.getUsedBytes() > limit / 2, "functions evicted because of retired memory");
+
+    // Functions evicted now are freed after the next quiescent().
+    memmgr->quiescent();
+    getFunction(&retiring, (uint64_t)count);
+    check(retiring.getAllocatedBytes() - memmgr->getRetiredBytes() <= limit, "retired memory not reclaimed");
+
+    memmgr->quiescent();
+    memmgr->reclaim();
+    printf("-- Allocated after quiescent(): %d\n", (int)retiring.getAllocatedBytes());
+    check(retiring.getAllocatedBytes() <= limit, "allocated memory exceeds limit");
+
+    memmgr->unregisterThread();
+  }
+
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return 0;
+}
@@ -0,0 +1,165 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to test moving functions by the code compactor.
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace AsmJit;
+
+// This is type of function we will generate.
+typedef int (*MyFn)(void);
+
+enum { kCount = 2000 };
+
+static int problems = 0;
+
+static void check(bool condition, const char* message)
+{
+  if (!condition)
+  {
+    printf("Failed: %s\n", message);
+    problems++;
+  }
+}
+
+// Check that all functions not removed return their index.
+static bool verify(void** functions)
+{
+  size_t i;
+  for (i = 0; i < kCount; i++)
+  {
+    if (functions[i] == NULL) continue;
+
+    MyFn fn = asmjit_cast<MyFn>(functions[i]);
+    if (fn() != (int)i)
+    {
+      printf("Function %d returned %d\n", (int)i, fn());
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  CodeCompactor compactor;
+  CodeCompactorContext context(&compactor);
+
+  void* functions[kCount];
+  size_t i;
+
+  // Even function returns its index, odd function calls the previous one
+  // (through its entry stub) and adds one. Assemblers are destroyed after
+  // make(), the compactor keeps its own copy of the code.
+  printf("Generating %d functions...", (int)kCount);
+  for (i = 0; i < kCount; i++)
+  {
+    X86Assembler a(&context);
+
+    if ((i & 1) == 0)
+    {
+      a.mov(eax, imm((sysint_t)i));
+    }
+    else
+    {
+      a.call(functions[i - 1]);
+      a.add(eax, imm(1));
+    }
+    a.ret();
+
+    // Functions of different sizes.
+    uint8_t padding[256];
+    memset(padding, 0xCC, sizeof(padding));
+    a.embed(padding, rand() % sizeof(padding));
+
+    functions[i] = a.make();
+    if (functions[i] == NULL)
+    {
+      printf("Failed to generate function %d\n", (int)i);
+      return 1;
+    }
+  }
+  printf("done\n");
+  check(verify(functions), "generated function returned wrong value");
+
+  // Compiler uses temporary assembler.
+  void* compiled;
+  {
+    X86Compiler c(&context);
+    c.newFunc(kX86FuncConvDefault, FuncBuilder0<int>());
+
+    GpVar x(c.newGpVar());
+    c.mov(x, imm(1000));
+    c.ret(x);
+    c.endFunc();
+
+    compiled = c.make();
+  }
+  check(compiled != NULL && asmjit_cast<MyFn>(compiled)() == 1000, "compiled function returned wrong value");
+
+  // Remove half of functions, so most chunks are used only partially.
+  for (i = 0; i < kCount; i++)
+  {
+    if ((i & 3) < 2) continue;
+
+    check(compactor.remove(functions[i]), "failed to remove function");
+    functions[i] = NULL;
+  }
+  compactor.reclaim();
+
+  size_t allocated = compactor.getAllocatedBytes();
+  void* code = compactor.getCode(functions[0]);
+
+  printf("-- Functions: %d\n", (int)compactor.getCount());
+  printf("-- Used: %d\n", (int)compactor.getUsedBytes());
+  printf("-- Allocated: %d\n", (int)allocated);
+
+  printf("Compacting...");
+  check(compactor.compact() == kErrorOk, "compact() failed");
+  compactor.reclaim();
+  printf("done\n");
+
+  printf("-- Used: %d\n", (int)compactor.getUsedBytes());
+  printf("-- Allocated: %d\n", (int)compactor.getAllocatedBytes());
+  printf("-- Moves: %d\n", (int)compactor.getMoves());
+
+  check(verify(functions), "moved function returned wrong value");
+  check(asmjit_cast<MyFn>(compiled)() == 1000, "moved compiled function returned wrong value");
+  check(compactor.getCode(functions[0]) != code, "function not moved");
+  check(compactor.getAllocatedBytes() < allocated, "memory not reclaimed");
+  check(compactor.getMoves() == compactor.getCount(), "not all functions moved");
+  check(compactor.getCode(&allocated) == NULL, "unknown function found");
+
+  // Move the functions back.
+  check(compactor.compact() == kErrorOk, "second compact() failed");
+  check(verify(functions), "function moved twice returned wrong value");
+  check(asmjit_cast<MyFn>(compiled)() == 1000, "compiled function moved twice returned wrong value");
+
+  for (i = 0; i < kCount; i++)
+  {
+    if (functions[i] == NULL) continue;
+    check(compactor.remove(functions[i]), "failed to remove function");
+  }
+  check(compactor.remove(compiled), "failed to remove compiled function");
+  compactor.reclaim();
+
+  check(compactor.getCount() == 0 && compactor.getUsedBytes() == 0, "functions not removed");
+  check(compactor.getAllocatedBytes() == 0, "memory not freed");
+
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return 0;
+}
@@ -12,61 +12,2018 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(ASMJIT_WINDOWS)
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif // ASMJIT_WINDOWS
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif // __linux__
+
 static int problems = 0;
 
-static void gen(void* a, void* b, int i)
+static double now()
+{
+#if defined(ASMJIT_WINDOWS)
+  return (double)GetTickCount() / 1000.0;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif // ASMJIT_WINDOWS
+}
+
+static void rate(size_t count, double t)
+{
+  printf("-- Rate: %.0f allocations/sec\n", t > 0.0 ? (double)count / t : 0.0);
+}
+
+static void gen(void* a, void* b, int i)
+{
+  int pattern = rand() % 256;
+  *(int *)a  = i;
+  *(int *)b  = i;
+  memset((char*)a + sizeof(int), pattern, i - sizeof(int));
+  memset((char*)b + sizeof(int), pattern, i - sizeof(int));
+}
+
+static void verify(void* a, void* b)
+{
+  int ai = *(int*)a;
+  int bi = *(int*)b;
+  if (ai != bi || memcmp(a, b, ai) != 0)
+  {
+    printf("Failed to verify %p\n", a);
+    problems++;
+  }
+}
+
+static void die()
+{
+  printf("Couldn't allocate virtual memory, this test needs at least 100MB of free virtual memory.\n");
+  exit(1);
+}
+
+static void stats(const char* dumpFile)
+{
+  AsmJit::MemoryManager* memmgr = AsmJit::MemoryManager::getGlobal();
+
+  printf("-- Used: %d\n", (int)memmgr->getUsedBytes());
+  printf("-- Allocated: %d\n", (int)memmgr->getAllocatedBytes());
+
+#if defined(ASMJIT_MEMORY_MANAGER_DUMP)
+  reinterpret_cast<AsmJit::VirtualMemoryManager*>(memmgr)->dump(dumpFile);
+#endif // ASMJIT_MEMORY_MANAGER_DUMP
+}
+
+static void shuffle(void **a, void **b, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    size_t si = (size_t)rand() % count;
+
+    void *ta = a[i];
+    void *tb = b[i];
+
+    a[i] = a[si];
+    b[i] = b[si];
+
+    a[si] = ta;
+    b[si] = tb;
+  }
+}
+
+// Alloc/free small blocks using memory manager with thread cache enabled.
+static void testThreadCache(void** a, void** b, int* s, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  memmgr.setUseThreadCache(true);
+
+  size_t i;
+  double t;
+
+  printf("Thread cache alloc/free test - %d allocations\n\n", (int)count);
+
+  for (i = 0; i < count; i++)
+    s[i] = (rand() % 500) + 4;
+
+  printf("Alloc...");
+  t = now();
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc(s[i]);
+    if (a[i] == NULL) die();
+  }
+  t = now() - t;
+
+  for (i = 0; i < count; i++)
+  {
+    b[i] = malloc(s[i]);
+    if (b[i] == NULL) die();
+
+    gen(a[i], b[i], s[i]);
+  }
+  printf("done\n");
+  rate(count, t);
+
+  printf("\n");
+  printf("Verify, free and alloc again...");
+  shuffle(a, b, count);
+
+  for (i = 0; i < count; i++)
+  {
+    verify(a[i], b[i]);
+
+    // Sizes are shuffled together with blocks, get it from the copy.
+    s[i] = *(int*)b[i];
+  }
+
+  t = now();
+  for (i = 0; i < count; i++)
+  {
+    memmgr.free(a[i]);
+
+    a[i] = memmgr.alloc(s[i]);
+    if (a[i] == NULL) die();
+  }
+  t = now() - t;
+
+  for (i = 0; i < count; i++)
+    gen(a[i], b[i], s[i]);
+  printf("done\n");
+  rate(count, t);
+
+  printf("\n");
+  printf("Verify and free...");
+  for (i = 0; i < count; i++)
+  {
+    verify(a[i], b[i]);
+    memmgr.free(a[i]);
+    free(b[i]);
+  }
+
+  // Return all cached blocks, nothing should remain used.
+  memmgr.setUseThreadCache(false);
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+// Retire blocks and check they are freed only after quiescent state.
+static void testRetire(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  size_t i;
+
+  printf("Deferred free test - %d allocations\n\n", (int)count);
+
+  if (!memmgr.registerThread())
+  {
+    printf("Failed to register thread\n");
+    problems++;
+    return;
+  }
+
+  printf("Alloc and retire...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+  }
+
+  size_t used = memmgr.getUsedBytes();
+  for (i = 0; i < count; i++)
+  {
+    if (!memmgr.retire(a[i]))
+    {
+      printf("Failed to retire %p\n", a[i]);
+      problems++;
+    }
+  }
+  printf("done\n");
+
+  // This thread can still execute the retired code.
+  if (memmgr.getUsedBytes() != used || memmgr.getRetiredBytes() != used)
+  {
+    printf("Failed, retired memory was freed before quiescent state\n");
+    problems++;
+  }
+
+  printf("Quiescent state and reclaim...");
+  memmgr.quiescent();
+  memmgr.reclaim();
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0 || memmgr.getRetiredBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  memmgr.unregisterThread();
+  printf("\n");
+}
+
+// Free blocks and check empty chunks are kept up to the threshold.
+static void testRetain(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  size_t threshold = 256 * 1024;
+  size_t i;
+
+  printf("Retain test - %d allocations, threshold %d bytes\n\n", (int)count, (int)threshold);
+  memmgr.setRetainThreshold(threshold);
+
+  printf("Alloc and free...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+  }
+
+  for (i = 0; i < count; i++)
+    memmgr.free(a[i]);
+  printf("done\n");
+
+  printf("-- Retained: %d\n", (int)memmgr.getRetainedBytes());
+  printf("-- Released: %d\n", (int)memmgr.getReleasedBytes());
+
+  if (memmgr.getRetainedBytes() == 0 ||
+      memmgr.getRetainedBytes() > threshold ||
+      memmgr.getAllocatedBytes() != memmgr.getRetainedBytes() ||
+      memmgr.getReleasedBytes() == 0)
+  {
+    printf("Failed, empty chunks not kept up to the threshold\n");
+    problems++;
+  }
+
+  // Kept chunk is reused.
+  size_t released = memmgr.getReleasedBytes();
+  void* p = memmgr.alloc(64);
+
+  if (p == NULL || memmgr.getAllocatedBytes() > threshold || memmgr.getReleasedBytes() != released)
+  {
+    printf("Failed, empty chunk not reused\n");
+    problems++;
+  }
+  memmgr.free(p);
+
+  memmgr.setRetainThreshold(0);
+  if (memmgr.getRetainedBytes() != 0 || memmgr.getAllocatedBytes() != 0)
+  {
+    printf("Failed, empty chunks not released\n");
+    problems++;
+  }
+
+  // Unused pages of large chunk are returned to the system.
+  size_t large = 1024 * 1024;
+  released = memmgr.getReleasedBytes();
+
+  p = memmgr.alloc(large);
+  if (p == NULL) die();
+
+  memset(p, 0xCC, large);
+  memmgr.shrink(p, 100);
+
+  printf("-- Released by shrink: %d\n", (int)(memmgr.getReleasedBytes() - released));
+  if (memmgr.getReleasedBytes() - released < large - AsmJit::VirtualMemory::getPageSize())
+  {
+    printf("Failed, unused pages not released\n");
+    problems++;
+  }
+
+  memmgr.free(p);
+  printf("\n");
+}
+
+// Alloc nodes in arenas backed by large pages and check they are placed next
+// to each other and released with their arena.
+static void testArena()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  memmgr.setUseLargePages(true);
+
+  // Each allocation takes the most of the default node (64kB, one slot).
+  size_t slotSize = 65536;
+  size_t blockSize = 60000;
+  size_t largePageSize = AsmJit::VirtualMemory::getLargePageSize();
+  size_t slots = largePageSize / slotSize;
+  size_t i;
+
+  printf("Arena test - large page %d bytes\n\n", (int)largePageSize);
+
+  if (slots < 2 || slotSize % AsmJit::VirtualMemory::getPageSize() != 0)
+  {
+    printf("Skipped, large page is too small\n\n");
+    return;
+  }
+
+  uint8_t** nodes = (uint8_t**)malloc(sizeof(uint8_t*) * slots);
+  if (nodes == NULL) die();
+
+  printf("Alloc %d nodes...", (int)slots);
+  for (i = 0; i < slots; i++)
+  {
+    nodes[i] = (uint8_t*)memmgr.alloc(blockSize);
+    if (nodes[i] == NULL) die();
+    memset(nodes[i], 0xCC, blockSize);
+  }
+  printf("done\n");
+
+  // Nodes fill one arena, they are in consecutive slots.
+  for (i = 1; i < slots; i++)
+  {
+    if (nodes[i] != nodes[0] + i * slotSize)
+    {
+      printf("Failed, node %p is not in the slot after %p\n", nodes[i], nodes[i - 1]);
+      problems++;
+      break;
+    }
+  }
+
+  if (memmgr.getAllocatedBytes() != slots * slotSize)
+  {
+    printf("Failed, %d bytes allocated\n", (int)memmgr.getAllocatedBytes());
+    problems++;
+  }
+
+  // Slot of released node is reused by the next node.
+  memmgr.free(nodes[1]);
+  nodes[1] = (uint8_t*)memmgr.alloc(blockSize);
+
+  if (nodes[1] != nodes[0] + slotSize)
+  {
+    printf("Failed, slot of released node not reused\n");
+    problems++;
+  }
+
+  // The arena is full, the next node is placed into a new arena, which is
+  // released with the node.
+  uint8_t* p = (uint8_t*)memmgr.alloc(blockSize);
+  if (p == NULL) die();
+
+  if (p >= nodes[0] && p < nodes[0] + slots * slotSize)
+  {
+    printf("Failed, node %p placed into full arena\n", p);
+    problems++;
+  }
+
+  size_t released = memmgr.getReleasedBytes();
+  memmgr.free(p);
+
+  printf("-- Released with arena: %d\n", (int)(memmgr.getReleasedBytes() - released));
+  if (memmgr.getReleasedBytes() - released < largePageSize)
+  {
+    printf("Failed, empty arena not released\n");
+    problems++;
+  }
+
+  printf("Free...");
+  for (i = 0; i < slots; i++)
+    memmgr.free(nodes[i]);
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0 || memmgr.getAllocatedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used, %d bytes allocated\n",
+      (int)memmgr.getUsedBytes(), (int)memmgr.getAllocatedBytes());
+    problems++;
+  }
+
+  // The last arena is kept, new nodes are placed into it again.
+  p = (uint8_t*)memmgr.alloc(blockSize);
+  if (p < nodes[0] || p >= nodes[0] + slots * slotSize)
+  {
+    printf("Failed, node %p not placed into the kept arena\n", p);
+    problems++;
+  }
+  memmgr.free(p);
+
+  free(nodes);
+  printf("\n");
+}
+
+// Alloc blocks in reserved region and check they are all inside.
+static void testRegion(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  size_t regionSize = 256 * 1024 * 1024;
+  size_t i;
+
+  printf("Region test - %d allocations, region %d bytes\n\n", (int)count, (int)regionSize);
+
+  if (!memmgr.setRegionSize(regionSize))
+  {
+    printf("Failed to reserve region\n");
+    problems++;
+    return;
+  }
+
+  uint8_t* start = (uint8_t*)memmgr.getRegionAddress();
+  uint8_t* end = start + regionSize;
+
+  printf("Alloc...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+
+    if ((uint8_t*)a[i] < start || (uint8_t*)a[i] >= end)
+    {
+      printf("Failed, %p is outside of the region\n", a[i]);
+      problems++;
+      break;
+    }
+
+    // Committed memory must be writable.
+    memset(a[i], 0xCC, 4);
+  }
+  printf("done\n");
+
+  // Near allocation is placed into the region too.
+  void* p = memmgr.allocNear(64, start);
+  if ((uint8_t*)p < start || (uint8_t*)p >= end)
+  {
+    printf("Failed, near allocation %p is outside of the region\n", p);
+    problems++;
+  }
+  memmgr.free(p);
+
+  // Region is full.
+  if (memmgr.alloc(regionSize) != NULL)
+  {
+    printf("Failed, allocated more than the region size\n");
+    problems++;
+  }
+
+  printf("Free...");
+  for (i = 0; i < count; i++)
+    memmgr.free(a[i]);
+  printf("done\n");
+
+  if (memmgr.getAllocatedBytes() != 0 || memmgr.getRegionAddress() != start)
+  {
+    printf("Failed, region not kept\n");
+    problems++;
+  }
+
+  printf("\n");
+}
+
+// Alloc blocks with various alignment and small density.
+static void testAlignment(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  size_t i;
+
+  printf("Alignment test - %d allocations\n\n", (int)count);
+
+  if (!memmgr.setDensity(16) || memmgr.getDensity() != 16)
+  {
+    printf("Failed to set density\n");
+    problems++;
+    return;
+  }
+
+  printf("Alloc...");
+  for (i = 0; i < count; i++)
+  {
+    size_t alignment = (size_t)16 << (rand() % 6);
+    a[i] = memmgr.alloc((rand() % 200) + 4, AsmJit::kMemAllocFreeable, alignment);
+    if (a[i] == NULL) die();
+
+    if (((size_t)a[i] & (alignment - 1)) != 0)
+    {
+      printf("Failed, %p is not aligned to %d\n", a[i], (int)alignment);
+      problems++;
+      break;
+    }
+  }
+  printf("done\n");
+
+  printf("Free...");
+  for (i = 0; i < count; i++)
+    memmgr.free(a[i]);
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  // Small block uses only one block of density.
+  void* p = memmgr.alloc(10);
+  if (memmgr.getUsedBytes() != 16)
+  {
+    printf("Failed, small block uses %d bytes\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  // Density can't be changed when memory is allocated.
+  if (memmgr.setDensity(64))
+  {
+    printf("Failed, density changed when memory is allocated\n");
+    problems++;
+  }
+  memmgr.free(p);
+
+  printf("\n");
+}
+
+static void testSnapshot(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  AsmJit::MemorySnapshot snapshot;
+  size_t i;
+
+  printf("Snapshot test - %d allocations\n\n", (int)count);
+
+  printf("Alloc and free every second block...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+  }
+
+  for (i = 0; i < count; i += 2)
+    memmgr.free(a[i]);
+  printf("done\n");
+
+  if (!memmgr.getSnapshot(&snapshot)) die();
+
+  size_t size = 0;
+  size_t used = 0;
+  size_t freeRuns = 0;
+  size_t allocations = 0;
+
+  for (i = 0; i < snapshot.nodeCount; i++)
+  {
+    const AsmJit::MemorySnapshot::Node& node = snapshot.nodes[i];
+
+    size += node.size;
+    used += node.used;
+    freeRuns += node.freeRuns;
+
+    if (node.largestFreeRun > node.size - node.used ||
+       (node.largestFreeRun == 0) != (node.freeRuns == 0))
+    {
+      printf("Failed, node %p has invalid free runs\n", node.address);
+      problems++;
+      break;
+    }
+  }
+
+  printf("-- Nodes: %d\n", (int)snapshot.nodeCount);
+  printf("-- Free runs: %d\n", (int)freeRuns);
+  printf("-- Histogram:");
+  for (i = 0; i < AsmJit::MemorySnapshot::kHistogramSize; i++)
+  {
+    allocations += snapshot.histogram[i];
+    printf(" %d", (int)snapshot.histogram[i]);
+  }
+  printf("\n");
+
+  if (size != snapshot.allocated || size != memmgr.getAllocatedBytes() ||
+      used != snapshot.used || used != memmgr.getUsedBytes())
+  {
+    printf("Failed, node statistics don't match the memory manager\n");
+    problems++;
+  }
+
+  if (allocations != count / 2 || freeRuns < count / 4)
+  {
+    printf("Failed, %d allocations and %d free runs found\n", (int)allocations, (int)freeRuns);
+    problems++;
+  }
+
+  for (i = 1; i < count; i += 2)
+    memmgr.free(a[i]);
+
+  if (!memmgr.getSnapshot(&snapshot)) die();
+  if (snapshot.nodeCount != 0 || snapshot.allocated != 0)
+  {
+    printf("Failed, snapshot of empty memory manager contains nodes\n");
+    problems++;
+  }
+
+  printf("\n");
+}
+
+// Get NUMA node where the page at @a p is placed (the page must be touched)
+// or -1 if it's not known.
+static int getPageNumaNode(void* p)
+{
+#if defined(__linux__) && defined(__NR_get_mempolicy)
+  int node = -1;
+
+  // get_mempolicy(&node, NULL, 0, p, MPOL_F_NODE | MPOL_F_ADDR).
+  if (syscall(__NR_get_mempolicy, &node, NULL, 0, p, 3) != 0)
+    return -1;
+  return node;
+#else
+  return -1;
+#endif // __linux__ && __NR_get_mempolicy
+}
+
+typedef int (*NumaFn)(void);
+
+static void testNuma(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  uint32_t nodeCount = AsmJit::VirtualMemory::getNumaNodeCount();
+  uint32_t node = AsmJit::VirtualMemory::getCurrentNumaNode();
+  size_t i;
+
+  printf("NUMA test - %d allocations\n\n", (int)count);
+  printf("-- Nodes: %d\n", (int)nodeCount);
+  printf("-- Current node: %d\n", (int)node);
+
+  if (nodeCount == 0 || node >= nodeCount)
+  {
+    printf("Failed, invalid current node\n");
+    problems++;
+  }
+
+  printf("Alloc on each node...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.allocOnNumaNode((rand() % 1000) + 4, (uint32_t)(i % nodeCount));
+    if (a[i] == NULL) die();
+    memset(a[i], 0xCC, 4);
+  }
+  printf("done\n");
+
+  // Pages are placed on the requested node (if the system can tell).
+  printf("-- Node of the first block: %d\n", getPageNumaNode(a[0]));
+  for (i = 0; i < count; i++)
+  {
+    int pageNode = getPageNumaNode(a[i]);
+    if (pageNode != -1 && pageNode != (int)(i % nodeCount))
+    {
+      printf("Failed, %p is placed on node %d instead of %d\n", a[i], pageNode, (int)(i % nodeCount));
+      problems++;
+      break;
+    }
+  }
+
+  // Invalid node falls back to the default allocation.
+  void* p = memmgr.allocOnNumaNode(64, nodeCount);
+  if (p == NULL)
+  {
+    printf("Failed, allocation on invalid node failed\n");
+    problems++;
+  }
+  memmgr.free(p);
+
+  printf("Free...");
+  for (i = 0; i < count; i++)
+  {
+    if (!memmgr.free(a[i]))
+    {
+      printf("Failed to free %p\n", a[i]);
+      problems++;
+    }
+  }
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  AsmJit::JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  AsmJit::X86Assembler asm1(&context);
+  asm1.mov(AsmJit::eax, AsmJit::imm(42));
+  asm1.ret();
+
+  // Each replica is placed on its node.
+  void** replicas = (void**)malloc(sizeof(void*) * nodeCount);
+  if (replicas == NULL) die();
+
+  printf("Generate replicas...");
+  if (context.generateReplicas(replicas, &asm1) != AsmJit::kErrorOk) die();
+  printf("done\n");
+
+  for (i = 0; i < nodeCount; i++)
+  {
+    int pageNode = getPageNumaNode(replicas[i]);
+    if (asmjit_cast<NumaFn>(replicas[i])() != 42 || (pageNode != -1 && pageNode != (int)i))
+    {
+      printf("Failed, replica %d at %p is placed on node %d\n", (int)i, replicas[i], pageNode);
+      problems++;
+    }
+    memmgr.free(replicas[i]);
+  }
+  free(replicas);
+
+  // Code is placed on the node of the calling thread (it can migrate to
+  // other node between the calls, so only valid nodes are checked).
+  context.setNumaPlacement(true);
+
+  void* fn;
+  if (context.generate(&fn, &asm1) != AsmJit::kErrorOk) die();
+
+  int pageNode = getPageNumaNode(fn);
+  if (asmjit_cast<NumaFn>(fn)() != 42 || pageNode >= (int)nodeCount ||
+      (nodeCount == 1 && pageNode != -1 && pageNode != 0))
+  {
+    printf("Failed, code placed on node %d\n", pageNode);
+    problems++;
+  }
+  memmgr.free(fn);
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used after generating code\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+static int nearHelper()
+{
+  return 2000;
+}
+
+typedef int (*NearFn)(void);
+
+// Get whether @a p can call @a target by rel32 displacement.
+static bool isNear(const void* p, const void* target)
+{
+#if defined(ASMJIT_X64)
+  size_t distance = (const uint8_t*)p > (const uint8_t*)target
+    ? (size_t)((const uint8_t*)p - (const uint8_t*)target)
+    : (size_t)((const uint8_t*)target - (const uint8_t*)p);
+  return distance < (size_t)0x7FFF0000;
+#else
+  ASMJIT_UNUSED(p);
+  ASMJIT_UNUSED(target);
+  return true;
+#endif // ASMJIT_X64
+}
+
+static void testNear()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  memmgr.setUseThreadCache(true);
+
+  void* hint = (void*)nearHelper;
+  void* nearBlocks[16];
+  void* blocks[16];
+  size_t i, j;
+
+  printf("Near test\n\n");
+
+  printf("Alloc near...");
+  for (i = 0; i < 16; i++)
+  {
+    nearBlocks[i] = memmgr.allocNear(64, hint);
+    if (nearBlocks[i] == NULL) die();
+
+    if (!isNear(nearBlocks[i], hint))
+    {
+      printf("Failed, %p is not near %p\n", nearBlocks[i], hint);
+      problems++;
+      break;
+    }
+  }
+  printf("done\n");
+
+  // Freed near blocks must not be reused by allocations of other heaps
+  // (the thread cache returns them when its list of pending blocks is full).
+  for (i = 0; i < 16; i++)
+    memmgr.free(nearBlocks[i]);
+
+  for (i = 0; i < 16; i++)
+  {
+    blocks[i] = memmgr.alloc(64);
+    if (blocks[i] == NULL) die();
+
+    for (j = 0; j < 16; j++)
+    {
+      if (blocks[i] == nearBlocks[j])
+      {
+        printf("Failed, near block %p reused by default allocation\n", blocks[i]);
+        problems++;
+        break;
+      }
+    }
+  }
+
+  for (i = 0; i < 16; i++)
+    memmgr.free(blocks[i]);
+
+  // Generated code is placed near the called function and calls it directly.
+  AsmJit::JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  AsmJit::X86Assembler a(&context);
+  a.sub(AsmJit::zsp, AsmJit::imm(8));
+  a.call(hint);
+  a.add(AsmJit::zsp, AsmJit::imm(8));
+  a.ret();
+
+  uint8_t* fn = (uint8_t*)a.make();
+  if (fn == NULL) die();
+
+  bool direct = false;
+  for (i = 0; i + 5 <= a.getOffset(); i++)
+  {
+    if (fn[i] == 0xE8 && fn + i + 5 + *(int32_t*)(fn + i + 1) == (uint8_t*)hint)
+    {
+      direct = true;
+      break;
+    }
+  }
+
+  printf("-- Distance: %d MB\n", (int)(((fn > (uint8_t*)hint)
+    ? (size_t)(fn - (uint8_t*)hint) : (size_t)((uint8_t*)hint - fn)) >> 20));
+
+  if (!isNear(fn, hint) || !direct)
+  {
+    printf("Failed, code at %p doesn't call %p directly\n", fn, hint);
+    problems++;
+  }
+
+  if (asmjit_cast<NearFn>(fn)() != 2000)
+  {
+    printf("Failed, function returned %d\n", asmjit_cast<NearFn>(fn)());
+    problems++;
+  }
+  memmgr.free(fn);
+
+  memmgr.setUseThreadCache(false);
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+// Get target of the first call in @a code of @a size bytes or NULL.
+static uint8_t* getCallTarget(uint8_t* code, size_t size)
+{
+  for (size_t i = 0; i + 5 <= size; i++)
+  {
+    if (code[i] == 0xE8)
+      return code + i + 5 + *(int32_t*)(code + i + 1);
+  }
+  return NULL;
+}
+
+enum { kTrampolineFunctions = 8 };
+
+// Functions calling the same far target share one trampoline of the node.
+static void testTrampolines()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  AsmJit::JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  void* target = (void*)nearHelper;
+  uint8_t* functions[kTrampolineFunctions];
+  uint8_t* trampoline = NULL;
+  uint8_t scratch[256];
+  size_t i;
+
+  printf("Shared trampolines test - %d functions\n\n", (int)kTrampolineFunctions);
+
+  for (i = 0; i < kTrampolineFunctions; i++)
+  {
+    AsmJit::X86Assembler a(&context);
+    a.sub(AsmJit::zsp, AsmJit::imm(8));
+    a.call(target);
+    a.add(AsmJit::zsp, AsmJit::imm(8));
+    a.ret();
+
+    // Functions are allocated without hint, so they are not near the target.
+    size_t codeSize = a.getCodeSize();
+    uint8_t* p = (uint8_t*)memmgr.alloc(codeSize);
+    if (p == NULL || codeSize > sizeof(scratch)) die();
+    functions[i] = p;
+
+    if (a.getTrampolineSize() == 0 || isNear(p, target))
+    {
+      printf("Skipped, code is near the target\n\n");
+      memmgr.freeAll();
+      return;
+    }
+
+    size_t sharedSize = a.relocCode(memmgr.getWritableAddress(p), (sysuint_t)p, &memmgr);
+    size_t ownSize = a.relocCode(scratch, (sysuint_t)p);
+    memmgr.shrink(p, sharedSize);
+
+    if (i == 0)
+    {
+      printf("-- Code: %d\n", (int)a.getOffset());
+      printf("-- Code with own trampoline: %d\n", (int)ownSize);
+      printf("-- Code with shared trampoline: %d\n", (int)sharedSize);
+    }
+
+    if (sharedSize != a.getOffset() || sharedSize >= ownSize)
+    {
+      printf("Failed, function %d has its own trampoline\n", (int)i);
+      problems++;
+    }
+
+    // All functions jump to the same trampoline outside of their code.
+    uint8_t* t = getCallTarget(p, sharedSize);
+    if (i == 0) trampoline = t;
+
+    if (t == NULL || t == (uint8_t*)target || t != trampoline ||
+        (t >= p && t < p + sharedSize))
+    {
+      printf("Failed, function %d calls %p instead of shared trampoline %p\n", (int)i, t, trampoline);
+      problems++;
+    }
+
+    if (asmjit_cast<NearFn>(p)() != 2000)
+    {
+      printf("Failed, function %d returned %d\n", (int)i, asmjit_cast<NearFn>(p)());
+      problems++;
+    }
+  }
+
+  for (i = 0; i < kTrampolineFunctions; i++)
+    memmgr.free(functions[i]);
+
+  // The node with shared trampolines is released when its code is freed.
+  printf("-- Allocated after free: %d\n", (int)memmgr.getAllocatedBytes());
+  if (memmgr.getUsedBytes() != 0 || memmgr.getAllocatedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+enum
+{
+  kManyTrampolineCalls = 40000,
+  kManyTrampolineTargets = 4000
+};
+
+// Get the far target of the trampoline (jmp [rip+disp]) at @a t or zero.
+static sysuint_t getTrampolineTarget(const uint8_t* t)
+{
+  if (t[0] != 0xFF || t[1] != 0x25)
+    return 0;
+  return *(const sysuint_t*)(t + 6 + *(const int32_t*)(t + 2));
+}
+
+// Emit @a count calls to @a targets far targets and relocate them, with
+// trampolines after the code or shared by @a memmgr. Return the time it took
+// or a negative value if the code is near the targets.
+static double emitManyTrampolines(size_t count, size_t targets, AsmJit::VirtualMemoryManager* memmgr)
+{
+  sysuint_t base = (sysuint_t)(void*)nearHelper ^ ((sysuint_t)1 << 40);
+  size_t i;
+
+  // Size of one trampoline.
+  size_t trampolineSize;
+  {
+    AsmJit::X86Assembler a;
+    a.call((void*)base);
+    trampolineSize = a.getTrampolineSize();
+  }
+
+  double t = now();
+
+  AsmJit::X86Assembler a;
+  for (i = 0; i < count; i++)
+    a.call((void*)(base + (i % targets) * 64));
+
+  size_t codeSize = a.getCodeSize();
+  uint8_t* p = (uint8_t*)(memmgr ? memmgr->alloc(codeSize) : ASMJIT_MALLOC(codeSize));
+  if (p == NULL) die();
+
+  if (trampolineSize == 0 || isNear(p, (void*)base))
+  {
+    if (memmgr) memmgr->free(p); else ASMJIT_FREE(p);
+    return -1.0;
+  }
+
+  uint8_t* code = memmgr ? (uint8_t*)memmgr->getWritableAddress(p) : p;
+  size_t size = a.relocCode(code, (sysuint_t)p, memmgr);
+  t = now() - t;
+
+  // Calls to the same target share one trampoline.
+  if (a.getTrampolineSize() != targets * trampolineSize)
+  {
+    printf("Failed, %d bytes of trampolines for %d targets\n",
+      (int)a.getTrampolineSize(), (int)targets);
+    problems++;
+  }
+
+  // Trampolines not shared by the node (it's full) are written after the code.
+  if (size > a.getCodeSize())
+  {
+    printf("Failed, code relocated to %d bytes\n", (int)size);
+    problems++;
+  }
+
+  size_t failed = 0;
+  for (i = 0; i < count; i++)
+  {
+    // Trampolines are read through the address they are executed at.
+    const uint8_t* tramp = p + i * 5 + 5 + *(int32_t*)(code + i * 5 + 1);
+    if (code[i * 5] != 0xE8 || getTrampolineTarget(tramp) != base + (i % targets) * 64)
+      failed++;
+  }
+
+  if (failed)
+  {
+    printf("Failed, %d of %d calls don't reach their target\n", (int)failed, (int)count);
+    problems++;
+  }
+
+  if (memmgr) memmgr->free(p); else ASMJIT_FREE(p);
+  return t;
+}
+
+// Many calls to far targets (each target is looked up in a table, the time
+// must grow linearly with the number of targets).
+static void testManyTrampolines()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+
+  printf("Many trampolines test - %d calls to %d targets\n\n",
+    (int)kManyTrampolineCalls, (int)kManyTrampolineTargets);
+
+  double small = emitManyTrampolines(kManyTrampolineCalls / 4, kManyTrampolineCalls / 4, NULL);
+  double large = emitManyTrampolines(kManyTrampolineCalls, kManyTrampolineCalls, NULL);
+
+  if (small < 0.0 || large < 0.0)
+  {
+    printf("Skipped, code is near the targets\n\n");
+    return;
+  }
+
+  double own = emitManyTrampolines(kManyTrampolineCalls, kManyTrampolineTargets, NULL);
+  double shared = emitManyTrampolines(kManyTrampolineCalls, kManyTrampolineTargets, &memmgr);
+
+  printf("-- Time (%d targets): %.3f s\n", (int)kManyTrampolineCalls / 4, small);
+  printf("-- Time (%d targets): %.3f s\n", (int)kManyTrampolineCalls, large);
+  printf("-- Time (%d targets, own): %.3f s\n", (int)kManyTrampolineTargets, own);
+  printf("-- Time (%d targets, shared): %.3f s\n", (int)kManyTrampolineTargets, shared);
+
+  // 4x more targets, quadratic lookup would take 16x more time.
+  if (large > 0.05 && large > small * 10.0)
+  {
+    printf("Failed, time grows quadratically\n");
+    problems++;
+  }
+
+  memmgr.freeAll();
+  printf("\n");
+}
+
+// Place code near the called function into dual mapped arenas backed by large
+// pages (the system may have no large pages reserved).
+static void testDualMappingNear()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  void* hint = (void*)nearHelper;
+
+  printf("Dual mapping near test\n\n");
+
+  if (!memmgr.setDualMapping(true))
+  {
+    printf("Skipped, dual mapping not supported\n\n");
+    return;
+  }
+  memmgr.setUseLargePages(true);
+
+  uint8_t* p = (uint8_t*)memmgr.allocNear(64, hint);
+  if (p == NULL)
+  {
+    printf("Failed, near block not allocated\n\n");
+    problems++;
+    return;
+  }
+
+  uint8_t* rw = (uint8_t*)memmgr.getWritableAddress(p);
+  if (!isNear(p, hint) || rw == NULL || rw == p)
+  {
+    printf("Failed, block %p (writable %p) is not near %p\n", p, rw, hint);
+    problems++;
+  }
+  else
+  {
+    // Both views map the same pages.
+    rw[0] = 0xCC;
+    if (p[0] != 0xCC)
+    {
+      printf("Failed, write to %p not visible at %p\n", rw, p);
+      problems++;
+    }
+  }
+  memmgr.free(p);
+
+  // Generated code calls the function directly.
+  AsmJit::JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  AsmJit::X86Assembler a(&context);
+  a.sub(AsmJit::zsp, AsmJit::imm(8));
+  a.call(hint);
+  a.add(AsmJit::zsp, AsmJit::imm(8));
+  a.ret();
+
+  uint8_t* fn = (uint8_t*)a.make();
+  if (fn == NULL) die();
+
+  if (!isNear(fn, hint) || getCallTarget(fn, a.getOffset()) != (uint8_t*)hint)
+  {
+    printf("Failed, code at %p doesn't call %p directly\n", fn, hint);
+    problems++;
+  }
+
+  if (asmjit_cast<NearFn>(fn)() != 2000)
+  {
+    printf("Failed, function returned %d\n", asmjit_cast<NearFn>(fn)());
+    problems++;
+  }
+  memmgr.free(fn);
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+enum { kTestThreads = 4 };
+
+#if defined(ASMJIT_WINDOWS)
+typedef DWORD (WINAPI *ThreadEntry)(LPVOID arg);
+#else
+typedef void* (*ThreadEntry)(void* arg);
+#endif // ASMJIT_WINDOWS
+
+// Run @a entry in kTestThreads threads, each gets one of @a args.
+static void runThreads(ThreadEntry entry, void* args, size_t argSize)
+{
+  size_t i;
+
+#if defined(ASMJIT_WINDOWS)
+  HANDLE handles[kTestThreads];
+  for (i = 0; i < kTestThreads; i++)
+    handles[i] = CreateThread(NULL, 0, entry, (char*)args + i * argSize, 0, NULL);
+  for (i = 0; i < kTestThreads; i++)
+  {
+    WaitForSingleObject(handles[i], INFINITE);
+    CloseHandle(handles[i]);
+  }
+#else
+  pthread_t handles[kTestThreads];
+  for (i = 0; i < kTestThreads; i++)
+    pthread_create(&handles[i], NULL, entry, (char*)args + i * argSize);
+  for (i = 0; i < kTestThreads; i++)
+    pthread_join(handles[i], NULL);
+#endif // ASMJIT_WINDOWS
+}
+
+// Wait until @a step (changed by other thread) is @a value.
+static void waitStep(volatile int* step, int value)
+{
+  while (*step != value)
+  {
+#if defined(ASMJIT_WINDOWS)
+    Sleep(0);
+#else
+    usleep(100);
+#endif // ASMJIT_WINDOWS
+  }
+}
+
+//! @brief Data of registered thread in testRetireMT().
+struct RetireWorker
+{
+  AsmJit::VirtualMemoryManager* memmgr;
+  volatile int step;
+};
+
+// Register, wait until the main thread retires blocks and announce quiescent
+// state when asked.
+static void runRetireWorker(RetireWorker* w)
+{
+  w->memmgr->registerThread();
+  w->step = 1;
+
+  waitStep(&w->step, 2);
+  w->memmgr->quiescent();
+  w->step = 3;
+
+  waitStep(&w->step, 4);
+  w->memmgr->unregisterThread();
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI retireWorkerEntry(LPVOID arg)
+{
+  runRetireWorker(reinterpret_cast<RetireWorker*>(arg));
+  return 0;
+}
+#else
+static void* retireWorkerEntry(void* arg)
+{
+  runRetireWorker(reinterpret_cast<RetireWorker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+// Retire blocks and check they are not freed until other registered thread
+// (registered after some of them were retired) is in quiescent state.
+static void testRetireMT(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  RetireWorker worker;
+  size_t i;
+
+  printf("Deferred free test - %d allocations, 2 threads\n\n", (int)count);
+
+  worker.memmgr = &memmgr;
+  worker.step = 0;
+
+  if (!memmgr.registerThread()) die();
+
+  printf("Alloc and retire...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+  }
+
+  size_t used = memmgr.getUsedBytes();
+
+  // The first half is retired before the other thread registers, it can
+  // already have pointer to the code.
+  for (i = 0; i < count / 2; i++)
+    memmgr.retire(a[i]);
+
+#if defined(ASMJIT_WINDOWS)
+  HANDLE handle = CreateThread(NULL, 0, retireWorkerEntry, &worker, 0, NULL);
+#else
+  pthread_t handle;
+  pthread_create(&handle, NULL, retireWorkerEntry, &worker);
+#endif // ASMJIT_WINDOWS
+  waitStep(&worker.step, 1);
+
+  for (i = count / 2; i < count; i++)
+    memmgr.retire(a[i]);
+  printf("done\n");
+
+  // This thread is in quiescent state, the other thread is not.
+  memmgr.quiescent();
+  memmgr.reclaim();
+
+  if (memmgr.getUsedBytes() != used || memmgr.getRetiredBytes() != used)
+  {
+    printf("Failed, %d bytes freed before quiescent state of other thread\n",
+      (int)(used - memmgr.getUsedBytes()));
+    problems++;
+  }
+
+  printf("Quiescent state of other thread and reclaim...");
+  worker.step = 2;
+  waitStep(&worker.step, 3);
+
+  memmgr.reclaim();
+  printf("done\n");
+
+  if (memmgr.getUsedBytes() != 0 || memmgr.getRetiredBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  worker.step = 4;
+#if defined(ASMJIT_WINDOWS)
+  WaitForSingleObject(handle, INFINITE);
+  CloseHandle(handle);
+#else
+  pthread_join(handle, NULL);
+#endif // ASMJIT_WINDOWS
+
+  memmgr.unregisterThread();
+  printf("\n");
+}
+
+//! @brief Data of thread freeing blocks in testConcurrentFree().
+struct FreeWorker
+{
+  AsmJit::VirtualMemoryManager* memmgr;
+  void** blocks;
+  size_t count;
+  size_t first;
+  size_t freed;
+};
+
+static void runFreeWorker(FreeWorker* w)
+{
+  // Each block is freed by two threads, starting at different positions.
+  for (size_t n = 0; n < w->count; n++)
+  {
+    if (w->memmgr->free(w->blocks[(w->first + n) % w->count]))
+      w->freed++;
+  }
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI freeWorkerEntry(LPVOID arg)
+{
+  runFreeWorker(reinterpret_cast<FreeWorker*>(arg));
+  return 0;
+}
+#else
+static void* freeWorkerEntry(void* arg)
+{
+  runFreeWorker(reinterpret_cast<FreeWorker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+static void testConcurrentFree(void** a, size_t count)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  FreeWorker workers[kTestThreads];
+  size_t i;
+
+  printf("Concurrent free test - %d allocations, %d threads\n\n", (int)count, (int)kTestThreads);
+
+  printf("Alloc...");
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr.alloc((rand() % 1000) + 4);
+    if (a[i] == NULL) die();
+  }
+  printf("done\n");
+
+  // Two threads free each half of blocks, so every block is freed twice at
+  // the same time, but only one free can succeed.
+  for (i = 0; i < kTestThreads; i++)
+  {
+    FreeWorker* w = &workers[i];
+    size_t half = count / 2;
+
+    w->memmgr = &memmgr;
+    w->blocks = a + (i & 1) * half;
+    w->count = (i & 1) ? count - half : half;
+    w->first = (i / 2) * (w->count / 2);
+    w->freed = 0;
+  }
+
+  printf("Free...");
+  runThreads(freeWorkerEntry, workers, sizeof(FreeWorker));
+  printf("done\n");
+
+  size_t freed = 0;
+  for (i = 0; i < kTestThreads; i++)
+    freed += workers[i].freed;
+
+  printf("-- Freed: %d\n", (int)freed);
+  if (freed != count)
+  {
+    printf("Failed, %d blocks freed successfully\n", (int)freed);
+    problems++;
+  }
+
+  if (memmgr.getUsedBytes() != 0 || memmgr.getAllocatedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used, %d bytes allocated\n",
+      (int)memmgr.getUsedBytes(), (int)memmgr.getAllocatedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+enum { kPermanentCount = 2000 };
+
+//! @brief Data of thread allocating permanent blocks in testPermanent().
+struct PermanentWorker
+{
+  AsmJit::VirtualMemoryManager* memmgr;
+  int id;
+  void* blocks[kPermanentCount];
+  size_t sizes[kPermanentCount];
+  size_t used;
+  bool failed;
+};
+
+static void runPermanentWorker(PermanentWorker* w)
+{
+  uint32_t seed = (uint32_t)w->id * 7919 + 1;
+
+  for (size_t i = 0; i < kPermanentCount; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    size_t size = (size_t)(seed >> 16) % 500 + 4;
+
+    void* p = w->memmgr->alloc(size, AsmJit::kMemAllocPermanent);
+    if (p == NULL || ((size_t)p & 31) != 0)
+    {
+      w->failed = true;
+      return;
+    }
+
+    memset(p, w->id, size);
+    w->blocks[i] = p;
+    w->sizes[i] = size;
+    w->used += (size + 31) & ~(size_t)31;
+  }
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI permanentWorkerEntry(LPVOID arg)
+{
+  runPermanentWorker(reinterpret_cast<PermanentWorker*>(arg));
+  return 0;
+}
+#else
+static void* permanentWorkerEntry(void* arg)
+{
+  runPermanentWorker(reinterpret_cast<PermanentWorker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+enum { kCacheBlocks = 10000 };
+
+//! @brief Data of thread allocating and freeing blocks in
+//! testThreadCacheMT().
+struct CacheWorker
+{
+  AsmJit::VirtualMemoryManager* memmgr;
+  int id;
+  void* blocks[kCacheBlocks];
+  size_t sizes[kCacheBlocks];
+  CacheWorker* other;
+  bool failed;
+};
+
+// Get whether @a size bytes at @a p are all @a id.
+static bool checkFill(const void* p, size_t size, int id)
+{
+  const uint8_t* b = (const uint8_t*)p;
+  for (size_t i = 0; i < size; i++)
+  {
+    if (b[i] != (uint8_t)id) return false;
+  }
+  return true;
+}
+
+static void runCacheAllocWorker(CacheWorker* w)
+{
+  uint32_t seed = (uint32_t)w->id * 7919 + 1;
+
+  for (size_t i = 0; i < kCacheBlocks; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    size_t size = (size_t)(seed >> 16) % 500 + 4;
+
+    void* p = w->memmgr->alloc(size);
+    if (p == NULL) { w->failed = true; return; }
+
+    memset(p, w->id, size);
+    w->blocks[i] = p;
+    w->sizes[i] = size;
+
+    // Free and alloc some blocks again, so they go through the cache.
+    if ((i & 3) == 3)
+    {
+      w->memmgr->free(w->blocks[i - 1]);
+
+      p = w->memmgr->alloc(w->sizes[i - 1]);
+      if (p == NULL) { w->failed = true; return; }
+
+      memset(p, w->id, w->sizes[i - 1]);
+      w->blocks[i - 1] = p;
+    }
+  }
+}
+
+// Free blocks allocated by other thread and replace them by new blocks.
+static void runCacheFreeWorker(CacheWorker* w)
+{
+  CacheWorker* other = w->other;
+
+  for (size_t i = 0; i < kCacheBlocks; i++)
+  {
+    size_t size = other->sizes[i];
+
+    if (!checkFill(other->blocks[i], size, other->id))
+      w->failed = true;
+    w->memmgr->free(other->blocks[i]);
+
+    void* p = w->memmgr->alloc(size);
+    if (p == NULL) { w->failed = true; return; }
+
+    memset(p, other->id, size);
+    other->blocks[i] = p;
+  }
+}
+
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI cacheAllocWorkerEntry(LPVOID arg)
 {
-  int pattern = rand() % 256;
-  *(int *)a  = i;
-  *(int *)b  = i;
-  memset((char*)a + sizeof(int), pattern, i - sizeof(int));
-  memset((char*)b + sizeof(int), pattern, i - sizeof(int));
+  runCacheAllocWorker(reinterpret_cast<CacheWorker*>(arg));
+  return 0;
 }
 
-static void verify(void* a, void* b)
+static DWORD WINAPI cacheFreeWorkerEntry(LPVOID arg)
 {
-  int ai = *(int*)a;
-  int bi = *(int*)b;
-  if (ai != bi || memcmp(a, b, ai) != 0)
+  runCacheFreeWorker(reinterpret_cast<CacheWorker*>(arg));
+  return 0;
+}
+#else
+static void* cacheAllocWorkerEntry(void* arg)
+{
+  runCacheAllocWorker(reinterpret_cast<CacheWorker*>(arg));
+  return NULL;
+}
+
+static void* cacheFreeWorkerEntry(void* arg)
+{
+  runCacheFreeWorker(reinterpret_cast<CacheWorker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+// Alloc/free blocks by several threads with thread cache enabled, blocks
+// allocated by one thread are freed by other one.
+static void testThreadCacheMT()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  CacheWorker* workers = (CacheWorker*)malloc(sizeof(CacheWorker) * kTestThreads);
+  size_t i, j;
+
+  if (workers == NULL) die();
+  printf("Thread cache test - %d allocations, %d threads\n\n", (int)kCacheBlocks, (int)kTestThreads);
+
+  memmgr.setUseThreadCache(true);
+
+  for (i = 0; i < kTestThreads; i++)
   {
-    printf("Failed to verify %p\n", a);
+    workers[i].memmgr = &memmgr;
+    workers[i].id = (int)i + 1;
+    workers[i].other = &workers[(i + 1) % kTestThreads];
+    workers[i].failed = false;
+  }
+
+  printf("Alloc...");
+  runThreads(cacheAllocWorkerEntry, workers, sizeof(CacheWorker));
+  printf("done\n");
+
+  printf("Free by other thread and alloc...");
+  runThreads(cacheFreeWorkerEntry, workers, sizeof(CacheWorker));
+  printf("done\n");
+
+  // Blocks of all threads must not overlap.
+  for (i = 0; i < kTestThreads; i++)
+  {
+    CacheWorker* w = &workers[i];
+    if (w->failed)
+    {
+      printf("Failed, thread %d found overwritten block\n", w->id);
+      problems++;
+    }
+
+    for (j = 0; j < kCacheBlocks; j++)
+    {
+      if (!checkFill(w->blocks[j], w->sizes[j], w->id))
+      {
+        printf("Failed, block %p overwritten\n", w->blocks[j]);
+        problems++;
+        break;
+      }
+    }
+  }
+
+  printf("Free...");
+  for (i = 0; i < kTestThreads; i++)
+  {
+    for (j = 0; j < kCacheBlocks; j++)
+      memmgr.free(workers[i].blocks[j]);
+  }
+  printf("done\n");
+
+  // Caches of exited threads and of this thread are returned.
+  memmgr.setUseThreadCache(false);
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
     problems++;
   }
+
+  free(workers);
+  printf("\n");
 }
 
-static void die()
+// Memory managers allocate thread local keys only if they use thread caches
+// and they work without them when there are no keys left.
+static void testThreadLocalKeys()
 {
-  printf("Couldn't allocate virtual memory, this test needs at least 100MB of free virtual memory.\n");
-  exit(1);
+  enum { kManagers = 2000, kKeys = 4096 };
+
+  size_t i;
+
+  printf("Thread local keys test - %d memory managers\n\n", (int)kManagers);
+
+  AsmJit::VirtualMemoryManager** managers = new AsmJit::VirtualMemoryManager*[kManagers];
+  for (i = 0; i < kManagers; i++)
+    managers[i] = new AsmJit::VirtualMemoryManager();
+
+  {
+    AsmJit::ThreadLocal key;
+    if (!key.create(NULL))
+    {
+      printf("Failed, thread local keys used up by memory managers\n");
+      problems++;
+    }
+  }
+
+  for (i = 0; i < kManagers; i++)
+    delete managers[i];
+  delete[] managers;
+
+  // Use up all keys.
+  AsmJit::ThreadLocal* keys = new AsmJit::ThreadLocal[kKeys];
+  for (i = 0; i < kKeys; i++)
+  {
+    if (!keys[i].create(NULL))
+      break;
+  }
+
+  if (i == kKeys)
+  {
+    printf("Skipped, count of thread local keys is not limited\n\n");
+    delete[] keys;
+    return;
+  }
+
+  printf("-- Keys: %d\n", (int)i);
+
+  {
+    AsmJit::VirtualMemoryManager memmgr;
+    memmgr.setUseThreadCache(true);
+
+    if (memmgr.getUseThreadCache())
+    {
+      printf("Failed, thread cache enabled without thread local key\n");
+      problems++;
+    }
+
+    if (memmgr.registerThread())
+    {
+      printf("Failed, thread registered without thread local key\n");
+      problems++;
+    }
+
+    void* p = memmgr.alloc(64);
+    if (p == NULL) die();
+
+    if (!memmgr.free(p) || memmgr.getUsedBytes() != 0)
+    {
+      printf("Failed, memory not freed without thread local key\n");
+      problems++;
+    }
+  }
+
+  delete[] keys;
+  printf("\n");
 }
 
-static void stats(const char* dumpFile)
+//! @brief Data of thread in testCacheOutlivesManager().
+struct OutliveWorker
 {
-  AsmJit::MemoryManager* memmgr = AsmJit::MemoryManager::getGlobal();
+  AsmJit::VirtualMemoryManager** memmgr;
+  volatile int* steps;
+  int id;
+};
 
-  printf("-- Used: %d\n", (int)memmgr->getUsedBytes());
-  printf("-- Allocated: %d\n", (int)memmgr->getAllocatedBytes());
+// The first thread destroys the memory manager while the other threads keep
+// their caches, they exit after it's destroyed.
+static void runOutliveWorker(OutliveWorker* w)
+{
+  int i;
 
-#if defined(ASMJIT_MEMORY_MANAGER_DUMP)
-  reinterpret_cast<AsmJit::VirtualMemoryManager*>(memmgr)->dump(dumpFile);
-#endif // ASMJIT_MEMORY_MANAGER_DUMP
+  if (w->id == 0)
+  {
+    for (i = 1; i < kTestThreads; i++)
+      waitStep(&w->steps[i], 1);
+
+    delete *w->memmgr;
+    *w->memmgr = NULL;
+
+    for (i = 1; i < kTestThreads; i++)
+      w->steps[i] = 2;
+  }
+  else
+  {
+    void* p = (*w->memmgr)->alloc(64);
+    if (p == NULL) die();
+    (*w->memmgr)->free(p);
+
+    w->steps[w->id] = 1;
+    waitStep(&w->steps[w->id], 2);
+  }
 }
 
-static void shuffle(void **a, void **b, size_t count)
+#if defined(ASMJIT_WINDOWS)
+static DWORD WINAPI outliveWorkerEntry(LPVOID arg)
 {
-  for (size_t i = 0; i < count; ++i)
+  runOutliveWorker(reinterpret_cast<OutliveWorker*>(arg));
+  return 0;
+}
+#else
+static void* outliveWorkerEntry(void* arg)
+{
+  runOutliveWorker(reinterpret_cast<OutliveWorker*>(arg));
+  return NULL;
+}
+#endif // ASMJIT_WINDOWS
+
+// Destroy memory manager while other threads have caches, they must not be
+// released by the exiting threads (Windows releases them when the manager
+// frees its thread local key).
+static void testCacheOutlivesManager()
+{
+  AsmJit::VirtualMemoryManager* memmgr = new AsmJit::VirtualMemoryManager();
+  memmgr->setUseThreadCache(true);
+
+  volatile int steps[kTestThreads];
+  OutliveWorker workers[kTestThreads];
+  int i;
+
+  printf("Cache outlives manager test - %d threads\n\n", (int)kTestThreads);
+
+  for (i = 0; i < kTestThreads; i++)
   {
-    size_t si = (size_t)rand() % count;
+    steps[i] = 0;
+    workers[i].memmgr = &memmgr;
+    workers[i].steps = steps;
+    workers[i].id = i;
+  }
 
-    void *ta = a[i];
-    void *tb = b[i];
+  runThreads(outliveWorkerEntry, workers, sizeof(OutliveWorker));
 
-    a[i] = a[si];
-    b[i] = b[si];
+  if (memmgr != NULL)
+  {
+    printf("Failed, memory manager not destroyed\n");
+    problems++;
+    delete memmgr;
+  }
 
-    a[si] = ta;
-    b[si] = tb;
+  printf("\n");
+}
+
+static void testPermanent(bool useThreadCache)
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  PermanentWorker* workers = (PermanentWorker*)malloc(sizeof(PermanentWorker) * kTestThreads);
+  size_t i, j;
+
+  if (workers == NULL) die();
+  printf("Permanent test - %d allocations, %d threads, %s\n\n", (int)kPermanentCount, (int)kTestThreads,
+    useThreadCache ? "thread caches" : "no thread caches");
+
+  memmgr.setUseThreadCache(useThreadCache);
+
+  for (i = 0; i < kTestThreads; i++)
+  {
+    workers[i].memmgr = &memmgr;
+    workers[i].id = (int)i + 1;
+    workers[i].used = 0;
+    workers[i].failed = false;
+  }
+
+  printf("Alloc...");
+  runThreads(permanentWorkerEntry, workers, sizeof(PermanentWorker));
+  printf("done\n");
+
+  // Blocks of all threads must not overlap.
+  size_t used = 0;
+  for (i = 0; i < kTestThreads; i++)
+  {
+    PermanentWorker* w = &workers[i];
+    if (w->failed) die();
+
+    used += w->used;
+    for (j = 0; j < kPermanentCount; j++)
+    {
+      const uint8_t* p = (const uint8_t*)w->blocks[j];
+      size_t k;
+
+      for (k = 0; k < w->sizes[j] && p[k] == (uint8_t)w->id; k++) continue;
+      if (k != w->sizes[j])
+      {
+        printf("Failed, block %p overwritten\n", w->blocks[j]);
+        problems++;
+        break;
+      }
+    }
+  }
+
+  printf("-- Used: %d\n", (int)memmgr.getUsedBytes());
+  if (memmgr.getUsedBytes() != used)
+  {
+    printf("Failed, %d bytes should be used\n", (int)used);
+    problems++;
+  }
+
+  free(workers);
+  printf("\n");
+}
+
+static void testGrow()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+
+  printf("Grow test\n\n");
+
+  // The first allocation is placed at the start of a new node, the rest of
+  // the node is free.
+  uint8_t* p = (uint8_t*)memmgr.alloc(64);
+  if (p == NULL) die();
+
+  if (!memmgr.grow(p, 256))
+  {
+    printf("Failed, memory followed by free blocks not grown\n");
+    problems++;
+  }
+  memset(p, 0xCC, 256);
+
+  // The next allocation follows the grown one.
+  uint8_t* q = (uint8_t*)memmgr.alloc(64);
+  if (q == NULL) die();
+
+  if (q != p + 256)
+  {
+    printf("Failed, %p doesn't follow the grown memory at %p\n", q, p);
+    problems++;
+  }
+  else if (memmgr.grow(p, 512))
+  {
+    printf("Failed, memory followed by used blocks grown\n");
+    problems++;
+  }
+
+  printf("-- Used: %d\n", (int)memmgr.getUsedBytes());
+  if (memmgr.getUsedBytes() != 320)
+  {
+    printf("Failed, 320 bytes should be used\n");
+    problems++;
+  }
+
+  memmgr.free(q);
+  memmgr.free(p);
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
+}
+
+static int directHelper()
+{
+  return 1000;
+}
+
+typedef int (*DirectFn)(void);
+
+static void testDirect()
+{
+  AsmJit::VirtualMemoryManager memmgr;
+  AsmJit::JitContext context;
+  context.setMemoryManager(&memmgr);
+
+  size_t count = 100000;
+  size_t i;
+
+  printf("Direct assembler test - %d instructions\n\n", (int)count);
+
+  AsmJit::X86Assembler a(&context);
+  a.setDirectMemoryManager(&memmgr);
+
+  // Jump is relocated in place.
+  AsmJit::Label L = a.newLabel();
+  a.mov(AsmJit::eax, AsmJit::imm(1000));
+  a.jmp(L);
+  a.int3();
+  a.bind(L);
+
+  for (i = 0; i < count; i++)
+    a.add(AsmJit::eax, AsmJit::imm(1));
+  a.ret();
+
+  void* address = a._buffer.getAddress();
+  if (address == NULL || memmgr.getUsedBytes() < a.getCodeSize())
+  {
+    printf("Failed, code not emitted to the memory manager\n");
+    problems++;
+  }
+
+  size_t capacity = a.getCapacity();
+  printf("-- Code: %d\n", (int)a.getCodeSize());
+  printf("-- Buffer: %d\n", (int)capacity);
+
+  DirectFn fn = asmjit_cast<DirectFn>(a.make());
+  if (fn == NULL) die();
+
+  printf("-- Used: %d\n", (int)memmgr.getUsedBytes());
+
+  if ((void*)fn != address)
+  {
+    printf("Failed, code copied\n");
+    problems++;
+  }
+
+  if (fn() != 1000 + (int)count)
+  {
+    printf("Failed, function returned %d\n", fn());
+    problems++;
+  }
+
+  // The buffer is taken and shrunk.
+  if (a.getCode() != NULL || memmgr.getUsedBytes() >= capacity)
+  {
+    printf("Failed, buffer not taken\n");
+    problems++;
+  }
+
+  memmgr.free((void*)fn);
+
+  if (memmgr.getUsedBytes() != 0)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  // The code calling a function is copied if it's not near it.
+  a.clear();
+  a.setDirectMemoryManager(&memmgr);
+  a.sub(AsmJit::zsp, AsmJit::imm(8));
+  a.call((void*)directHelper);
+  a.add(AsmJit::zsp, AsmJit::imm(8));
+  a.ret();
+
+  address = a._buffer.getAddress();
+  bool near = isNear(address, (void*)directHelper);
+
+  fn = asmjit_cast<DirectFn>(a.make());
+  if (fn == NULL) die();
+
+  printf("-- Call: %s\n", near ? "near" : "far");
+
+  if (near ? ((void*)fn != address) : ((void*)fn == address))
+  {
+    printf("Failed, code %s\n", near ? "copied" : "not copied");
+    problems++;
   }
+
+  if (fn() != 1000)
+  {
+    printf("Failed, function returned %d\n", fn());
+    problems++;
+  }
+
+  memmgr.free((void*)fn);
+  a.setDirectMemoryManager(NULL);
+
+  // Only the block of shared trampolines (64 bytes) can remain.
+  if (memmgr.getUsedBytes() > 64)
+  {
+    printf("Failed, %d bytes still used\n", (int)memmgr.getUsedBytes());
+    problems++;
+  }
+
+  printf("\n");
 }
 
 int main(int argc, char* argv[])
@@ -80,23 +2037,31 @@ int main(int argc, char* argv[])
 
   void** a = (void**)malloc(sizeof(void*) * count);
   void** b = (void**)malloc(sizeof(void*) * count);
-  if (!a || !b) die();
+  int* s = (int*)malloc(sizeof(int) * count);
+  if (!a || !b || !s) die();
+
+  double t;
 
   srand(100);
   printf("Allocating virtual memory...");
 
   for (i = 0; i < count; i++)
-  {
-    int r = (rand() % 1000) + 4;
+    s[i] = (rand() % 1000) + 4;
 
-    a[i] = memmgr->alloc(r);
+  t = now();
+  for (i = 0; i < count; i++)
+  {
+    a[i] = memmgr->alloc(s[i]);
     if (a[i] == NULL) die();
-
-    memset(a[i], 0, r);
   }
+  t = now() - t;
+
+  for (i = 0; i < count; i++)
+    memset(a[i], 0, s[i]);
 
   printf("done\n");
   stats("dump0.dot");
+  rate(count, t);
 
   printf("\n");
   printf("Freeing virtual memory...");
@@ -117,18 +2082,27 @@ int main(int argc, char* argv[])
   printf("Verified alloc/free test - %d allocations\n\n", (int)count);
 
   printf("Alloc...");
+  for (i = 0; i < count; i++)
+    s[i] = (rand() % 1000) + 4;
+
+  t = now();
   for (i = 0; i < count; i++)
   {
-    int r = (rand() % 1000) + 4;
+    a[i] = memmgr->alloc(s[i]);
+    if (a[i] == NULL) die();
+  }
+  t = now() - t;
 
-    a[i] = memmgr->alloc(r);
-    b[i] = malloc(r);
-    if (a[i] == NULL || b[i] == NULL) die();
+  for (i = 0; i < count; i++)
+  {
+    b[i] = malloc(s[i]);
+    if (b[i] == NULL) die();
 
-    gen(a[i], b[i], r);
+    gen(a[i], b[i], s[i]);
   }
   printf("done\n");
   stats("dump2.dot");
+  rate(count, t);
 
   printf("\n");
   printf("Shuffling...");
@@ -151,19 +2125,28 @@ int main(int argc, char* argv[])
   stats("dump3.dot");
 
   printf("\n");
-  printf("Alloc...");
+  printf("Alloc (fragmented)...");
+  for (i = 0; i < count/2; i++)
+    s[i] = (rand() % 1000) + 4;
+
+  t = now();
   for (i = 0; i < count/2; i++)
   {
-    int r = (rand() % 1000) + 4;
+    a[i] = memmgr->alloc(s[i]);
+    if (a[i] == NULL) die();
+  }
+  t = now() - t;
 
-    a[i] = memmgr->alloc(r);
-    b[i] = malloc(r);
-    if (a[i] == NULL || b[i] == NULL) die();
+  for (i = 0; i < count/2; i++)
+  {
+    b[i] = malloc(s[i]);
+    if (b[i] == NULL) die();
 
-    gen(a[i], b[i], r);
+    gen(a[i], b[i], s[i]);
   }
   printf("done\n");
   stats("dump4.dot");
+  rate(count/2, t);
 
   printf("\n");
   printf("Verify and free...");
@@ -181,6 +2164,28 @@ int main(int argc, char* argv[])
   stats("dump5.dot");
 
   printf("\n");
+  testThreadCache(a, b, s, count);
+  testRetire(a, count);
+  testRetain(a, count);
+  testArena();
+  testRegion(a, count);
+  testAlignment(a, count);
+  testSnapshot(a, count);
+  testNuma(a, count);
+  testNear();
+  testTrampolines();
+  testManyTrampolines();
+  testDualMappingNear();
+  testConcurrentFree(a, count);
+  testRetireMT(a, count);
+  testThreadCacheMT();
+  testThreadLocalKeys();
+  testCacheOutlivesManager();
+  testPermanent(true);
+  testPermanent(false);
+  testGrow();
+  testDirect();
+
   if (problems)
     printf("Status: Failure: %d problems found\n", problems);
   else
@@ -188,6 +2193,7 @@ int main(int argc, char* argv[])
 
   free(a);
   free(b);
+  free(s);
 
   return 0;
 }
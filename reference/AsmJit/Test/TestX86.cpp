@@ -1166,7 +1166,7 @@ struct X86TestSuite
   // [Methods]
   // --------------------------------------------------------------------------
 
-  void run();
+  void run(Context* context, MemoryManager* memmgr);
 
   // --------------------------------------------------------------------------
   // [Members]
@@ -1263,14 +1263,14 @@ X86TestSuite::~X86TestSuite()
   }
 }
 
-void X86TestSuite::run()
+void X86TestSuite::run(Context* context, MemoryManager* memmgr)
 {
   size_t i;
   size_t testCount = testList.getLength();
 
   for (i = 0; i < testCount; i++)
   {
-    X86Compiler compiler;
+    X86Compiler compiler(context);
     StringLogger logger;
 
     logger.setLogBinary(true);
@@ -1307,7 +1307,7 @@ void X86TestSuite::run()
         fprintf(stdout, "-------------------------------------------------------------------------------\n");
       }
 
-      MemoryManager::getGlobal()->free(func);
+      memmgr->free(func);
     }
     else
     {
@@ -1328,7 +1328,20 @@ void X86TestSuite::run()
 int main(int argc, char* argv[])
 {
   X86TestSuite testSuite;
-  testSuite.run();
+  testSuite.run(JitContext::getGlobal(), MemoryManager::getGlobal());
+
+  // Run again with the code memory which is never writeable and executable
+  // at the same time (if supported).
+  VirtualMemoryManager memmgr;
+
+  if (memmgr.setDualMapping(true))
+  {
+    JitContext context;
+    context.setMemoryManager(&memmgr);
+
+    fputs("Dual mapping:\n\n", stdout);
+    testSuite.run(&context, &memmgr);
+  }
 
   return testSuite.result;
 }
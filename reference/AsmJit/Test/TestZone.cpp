@@ -0,0 +1,191 @@
+// [AsmJit]
+// Complete JIT Assembler for C++ Language.
+//
+// [License]
+// Zlib - See COPYING file in this package.
+
+// This file is used to test that zones using pool of chunks don't allocate
+// heap memory after the first use (heap allocations are counted by malloc
+// hook, it's available only with glibc).
+
+// [Dependencies - AsmJit]
+#include <AsmJit/AsmJit.h>
+
+// [Dependencies - C]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace AsmJit;
+
+// ============================================================================
+// [Malloc Hook]
+// ============================================================================
+
+static size_t mallocCount = 0;
+
+#if defined(__GLIBC__)
+# define TEST_MALLOC_HOOK
+
+extern "C" void* __libc_malloc(size_t size);
+
+// Replaces malloc() of the C library, also for calls done by AsmJit.
+extern "C" void* malloc(size_t size)
+{
+  mallocCount++;
+  return __libc_malloc(size);
+}
+#endif // __GLIBC__
+
+// ============================================================================
+// [Tests]
+// ============================================================================
+
+typedef int (*MyFn)(int, int);
+
+static int problems = 0;
+
+// Allocate objects of various sizes as compiler does, some are larger than
+// the chunk.
+static void fillZone(ZoneMemory& zone)
+{
+  for (size_t i = 0; i < 2000; i++)
+  {
+    size_t size = (i % 100 == 99) ? 20000 : 16 + (i % 7) * 24;
+    void* p = zone.alloc(size);
+
+    if (p == NULL)
+    {
+      printf("Out of memory.\n");
+      exit(1);
+    }
+    memset(p, 0, size);
+  }
+}
+
+static void compile(ZonePool* pool, X86Assembler& a)
+{
+  X86Compiler c;
+  c.setZonePool(pool);
+
+  c.newFunc(kX86FuncConvDefault, FuncBuilder2<int, int, int>());
+
+  GpVar x(c.getGpArg(0));
+  GpVar y(c.getGpArg(1));
+  GpVar t(c.newGpVar());
+
+  Label L_Skip = c.newLabel();
+
+  c.mov(t, x);
+  c.cmp(t, y);
+  c.jg(L_Skip);
+  c.add(t, y);
+  c.bind(L_Skip);
+
+  c.ret(t);
+  c.endFunc();
+
+  a.clear();
+  c.serialize(a);
+}
+
+int main(int argc, char* argv[])
+{
+  size_t i;
+  size_t count;
+
+  // --------------------------------------------------------------------------
+  // [Zone]
+  // --------------------------------------------------------------------------
+
+  printf("Zone test...");
+  {
+    ZonePool pool;
+    ZoneMemory zone(16384 - sizeof(ZoneChunk) - 32);
+    zone.setPool(&pool);
+
+    // Warm-up, the pool gets all chunks needed (clear() keeps the last
+    // chunk in the zone, so the next allocations are placed differently).
+    fillZone(zone);
+    zone.clear();
+    fillZone(zone);
+    zone.reset();
+
+    count = mallocCount;
+    for (i = 0; i < 100; i++)
+    {
+      fillZone(zone);
+      if (i & 1) zone.clear(); else zone.reset();
+    }
+    count = mallocCount - count;
+    zone.reset();
+
+    printf("done\n");
+    printf("-- Pooled chunks: %d (%d bytes)\n", (int)pool.getChunkCount(), (int)pool.getChunkBytes());
+    printf("-- Heap allocations: %d\n", (int)count);
+
+#if defined(TEST_MALLOC_HOOK)
+    if (count != 0)
+    {
+      printf("Failed, pooled zone allocated heap memory\n");
+      problems++;
+    }
+#endif // TEST_MALLOC_HOOK
+  }
+
+  // --------------------------------------------------------------------------
+  // [Compiler]
+  // --------------------------------------------------------------------------
+
+  printf("\n");
+  printf("Compiler test...");
+  {
+    ZonePool* pool = ZonePool::getThreadPool();
+    X86Assembler a;
+
+    // Warm-up.
+    compile(NULL, a);
+    compile(pool, a);
+
+    size_t unpooled = mallocCount;
+    compile(NULL, a);
+    unpooled = mallocCount - unpooled;
+
+    size_t pooled = mallocCount;
+    compile(pool, a);
+    pooled = mallocCount - pooled;
+
+    printf("done\n");
+    printf("-- Pooled chunks: %d (%d bytes)\n", (int)pool->getChunkCount(), (int)pool->getChunkBytes());
+    printf("-- Heap allocations: %d unpooled, %d pooled\n", (int)unpooled, (int)pooled);
+
+#if defined(TEST_MALLOC_HOOK)
+    if (pooled != 0)
+    {
+      printf("Failed, pooled compiler allocated heap memory\n");
+      problems++;
+    }
+#endif // TEST_MALLOC_HOOK
+
+    MyFn fn = asmjit_cast<MyFn>(a.make());
+    if (fn == NULL || fn(1, 2) != 3 || fn(5, 2) != 5)
+    {
+      printf("Failed, compiled function returned wrong value\n");
+      problems++;
+    }
+
+    if (fn != NULL)
+      MemoryManager::getGlobal()->free((void*)fn);
+  }
+
+#if !defined(TEST_MALLOC_HOOK)
+  printf("\nHeap allocations are not counted on this platform.\n");
+#endif // TEST_MALLOC_HOOK
+
+  if (problems)
+    printf("Status: Failure: %d problems found\n", problems);
+  else
+    printf("Status: Success\n");
+
+  return 0;
+}